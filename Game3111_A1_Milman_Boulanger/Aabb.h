@@ -0,0 +1,114 @@
+//***************************************************************************************
+// Aabb.h
+//
+// Axis-aligned bounding box and frustum planes used by the CPU-side spatial
+// structures (SpatialGrid, Bvh, CullKernels).  Like Waves they have no DirectXMath
+// dependency; the app converts its DirectX::BoundingBox values with
+// AabbFromCenterExtents.
+//***************************************************************************************
+
+#ifndef AABB_H
+#define AABB_H
+
+#include <algorithm>
+
+// std::min/std::max are parenthesized throughout these headers because the app
+// includes them after <windows.h>, whose min/max macros would otherwise expand.
+
+struct Aabb
+{
+	float Min[3];
+	float Max[3];
+};
+
+// Six planes (a, b, c, d) whose normals point into the volume: a point p is inside
+// when a*p.x + b*p.y + c*p.z + d >= 0 for every plane.
+struct FrustumPlanes
+{
+	float Planes[6][4];
+};
+
+inline Aabb AabbFromCenterExtents(const float center[3], const float extents[3])
+{
+	Aabb box;
+	for(int a = 0; a < 3; ++a)
+	{
+		box.Min[a] = center[a] - extents[a];
+		box.Max[a] = center[a] + extents[a];
+	}
+	return box;
+}
+
+// Boxes that only touch count as overlapping, matching BoundingBox::Intersects.
+inline bool AabbOverlaps(const Aabb& a, const Aabb& b)
+{
+	return a.Min[0] <= b.Max[0] && b.Min[0] <= a.Max[0] &&
+		a.Min[1] <= b.Max[1] && b.Min[1] <= a.Max[1] &&
+		a.Min[2] <= b.Max[2] && b.Min[2] <= a.Max[2];
+}
+
+inline Aabb AabbUnion(const Aabb& a, const Aabb& b)
+{
+	Aabb box;
+	for(int k = 0; k < 3; ++k)
+	{
+		box.Min[k] = (std::min)(a.Min[k], b.Min[k]);
+		box.Max[k] = (std::max)(a.Max[k], b.Max[k]);
+	}
+	return box;
+}
+
+inline Aabb AabbTranslate(const Aabb& box, const float offset[3])
+{
+	Aabb moved;
+	for(int k = 0; k < 3; ++k)
+	{
+		moved.Min[k] = box.Min[k] + offset[k];
+		moved.Max[k] = box.Max[k] + offset[k];
+	}
+	return moved;
+}
+
+// Sweeps moving along delta against target.  Returns true if they first touch at a
+// fraction t in [0, 1] of delta; axis receives the axis of the contact normal.  Boxes
+// that already overlap (or only touch along a side) do not block, so an object can
+// always move out of or slide along one.
+inline bool AabbSweep(const Aabb& moving, const float delta[3], const Aabb& target, float& t, int& axis)
+{
+	float enter = -1.0f;
+	float exit = 2.0f;
+	int enterAxis = -1;
+
+	for(int a = 0; a < 3; ++a)
+	{
+		if(delta[a] == 0.0f)
+		{
+			// Not moving on this axis: the slabs must already overlap.
+			if(moving.Max[a] <= target.Min[a] || moving.Min[a] >= target.Max[a])
+				return false;
+			continue;
+		}
+
+		float invDelta = 1.0f / delta[a];
+		float t0 = (target.Min[a] - moving.Max[a]) * invDelta;
+		float t1 = (target.Max[a] - moving.Min[a]) * invDelta;
+		if(t0 > t1)
+			std::swap(t0, t1);
+
+		if(t0 > enter)
+		{
+			enter = t0;
+			enterAxis = a;
+		}
+		exit = (std::min)(exit, t1);
+	}
+
+	if(enterAxis < 0 || enter < 0.0f || enter > 1.0f || enter >= exit)
+		return false;
+
+	t = enter;
+	axis = enterAxis;
+	return true;
+}
+
+#endif // AABB_H
@@ -0,0 +1,127 @@
+//***************************************************************************************
+// CullBench.cpp
+//
+// Frustum culling of a scene of random boxes (100k by default) with each CullKernels
+// set.  The camera sits in the middle of the scene with a 60 degree field of view,
+// so about 6% of the boxes are visible.  Reports ms per pass and ns per box, and
+// checks that every kernel agrees with the scalar one.
+//
+//   cull_bench [boxCount...]
+//***************************************************************************************
+
+#include "CullKernels.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+using namespace CullKernels;
+
+namespace
+{
+	// Passes per measurement; the fastest is reported.
+	const int Repeats = 50;
+
+	unsigned gRandom = 6u;
+
+	float Random(float lo, float hi)
+	{
+		gRandom = gRandom*1664525u + 1013904223u;
+		return lo + (hi - lo)*((gRandom >> 8) / (float)(1u << 24));
+	}
+
+	// A camera at the origin looking down +z with a square 60 degree field of view,
+	// near plane 1 and far plane farZ.
+	FrustumPlanes CameraFrustum(float farZ)
+	{
+		const float halfFov = 30.0f*3.14159265f/180.0f;
+		const float c = std::cos(halfFov);
+		const float s = std::sin(halfFov);
+		const FrustumPlanes frustum =
+		{{
+			{ 0.0f, 0.0f, 1.0f, -1.0f },
+			{ 0.0f, 0.0f, -1.0f, farZ },
+			{ c, 0.0f, s, 0.0f },
+			{ -c, 0.0f, s, 0.0f },
+			{ 0.0f, c, s, 0.0f },
+			{ 0.0f, -c, s, 0.0f },
+		}};
+		return frustum;
+	}
+
+	int Run(int boxCount)
+	{
+		// Boxes around the camera in a cube of half-size world; the far plane is past
+		// the scene, so only the side planes cull.
+		const float world = 1000.0f;
+		BoxSoA boxes;
+		boxes.Resize(boxCount);
+		for(int id = 0; id < boxCount; ++id)
+		{
+			float center[3] = { Random(-world, world), Random(-world, world), Random(-world, world) };
+			float extents[3] = { Random(0.5f, 5.0f), Random(0.5f, 5.0f), Random(0.5f, 5.0f) };
+			boxes.Set(id, center, extents);
+		}
+
+		const FrustumPlanes frustum = CameraFrustum(4.0f*world);
+		const KernelSet* sets[] = { &Scalar(), Sse(), Avx() };
+
+		std::vector<std::uint32_t> expected(MaskWordCount(boxCount));
+		Scalar().Frustum(frustum, boxes, expected.data());
+
+		int visible = 0;
+		for(int id = 0; id < boxCount; ++id)
+			visible += IsVisible(expected.data(), id) ? 1 : 0;
+
+		int mismatches = 0;
+		double scalarMs = 0.0;
+		std::vector<std::uint32_t> mask(expected.size());
+		for(const KernelSet* kernels : sets)
+		{
+			if(kernels == nullptr)
+				continue;
+
+			double best = 1e30;
+			for(int r = 0; r < Repeats; ++r)
+			{
+				auto start = std::chrono::steady_clock::now();
+				kernels->Frustum(frustum, boxes, mask.data());
+				auto stop = std::chrono::steady_clock::now();
+				best = (std::min)(best, std::chrono::duration<double, std::milli>(stop - start).count());
+			}
+			if(kernels == &Scalar())
+				scalarMs = best;
+
+			bool same = mask == expected;
+			mismatches += same ? 0 : 1;
+
+			std::printf("%8d %8d %8s %10.3f %10.2f %9.1fx %6s\n", boxCount, visible, kernels->Name, best,
+				1.0e6*best / boxCount, scalarMs / best, same ? "ok" : "DIFFER");
+		}
+		return mismatches;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	std::vector<int> counts;
+	for(int a = 1; a < argc; ++a)
+		counts.push_back(std::atoi(argv[a]));
+	if(counts.empty())
+		counts = { 100000 };
+
+	std::printf("%8s %8s %8s %10s %10s %10s %6s\n", "boxes", "visible", "kernels", "ms/pass", "ns/box", "speedup", "check");
+
+	int mismatches = 0;
+	for(int count : counts)
+		mismatches += Run(count);
+
+	if(mismatches != 0)
+	{
+		std::printf("%d kernel sets differ from the scalar one\n", mismatches);
+		return 1;
+	}
+	return 0;
+}
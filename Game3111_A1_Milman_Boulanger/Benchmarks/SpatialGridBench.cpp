@@ -0,0 +1,155 @@
+//***************************************************************************************
+// SpatialGridBench.cpp
+//
+// SpatialGrid broad phase against a linear scan over the same boxes, on scenes of 10k
+// and 100k random boxes.  Reports the build time and ns per query for Overlaps (the
+// camera collision test) and Query, and checks that both agree with the scan.
+//
+//   spatial_bench [boxCount...]
+//***************************************************************************************
+
+#include "SpatialGrid.h"
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <vector>
+
+namespace
+{
+	const int QueryCount = 2000;
+
+	// Passes over the queries per measurement; the scan is slow enough for one.
+	const int GridRepeats = 20;
+	const int ScanRepeats = 1;
+
+	unsigned gRandom = 4u;
+
+	float Random(float lo, float hi)
+	{
+		gRandom = gRandom*1664525u + 1013904223u;
+		return lo + (hi - lo)*((gRandom >> 8) / (float)(1u << 24));
+	}
+
+	// A box of half-size up to maxExtent anywhere in a square world of half-size world,
+	// up to 20 units high: a scene that grows sideways, like the castle grounds.
+	Aabb RandomBox(float world, float maxExtent)
+	{
+		float center[3] = { Random(-world, world), Random(0.0f, 20.0f), Random(-world, world) };
+		float extents[3] = { Random(0.5f, maxExtent), Random(0.5f, maxExtent), Random(0.5f, maxExtent) };
+		return AabbFromCenterExtents(center, extents);
+	}
+
+	template<typename Fn>
+	double NsPerQuery(int repeats, Fn&& fn)
+	{
+		auto start = std::chrono::steady_clock::now();
+		for(int r = 0; r < repeats; ++r)
+			fn();
+		auto stop = std::chrono::steady_clock::now();
+		return std::chrono::duration<double, std::nano>(stop - start).count() / ((double)repeats*QueryCount);
+	}
+
+	// Returns the number of queries whose results differ from the linear scan.
+	int Run(int boxCount)
+	{
+		// Keep the density constant so a query sees the same number of neighbors at
+		// every scene size.
+		float world = 20.0f*std::sqrt((float)boxCount);
+
+		std::vector<Aabb> boxes(boxCount);
+		for(Aabb& box : boxes)
+			box = RandomBox(world, 5.0f);
+
+		std::vector<Aabb> queries(QueryCount);
+		for(Aabb& query : queries)
+			query = RandomBox(1.1f*world, 3.0f);
+
+		auto start = std::chrono::steady_clock::now();
+		SpatialGrid grid;
+		grid.Build(boxes.data(), boxCount);
+		auto stop = std::chrono::steady_clock::now();
+		double buildMs = std::chrono::duration<double, std::milli>(stop - start).count();
+
+		// The results also feed a checksum so the loops cannot be optimized away.
+		int hits[3] = { 0, 0, 0 };
+		std::vector<int> results;
+
+		double gridOverlaps = NsPerQuery(GridRepeats, [&]()
+		{
+			for(const Aabb& query : queries)
+				hits[0] += grid.Overlaps(query) ? 1 : 0;
+		});
+
+		double gridQuery = NsPerQuery(GridRepeats, [&]()
+		{
+			for(const Aabb& query : queries)
+			{
+				results.clear();
+				grid.Query(query, results);
+				hits[1] += (int)results.size();
+			}
+		});
+
+		double scanOverlaps = NsPerQuery(ScanRepeats, [&]()
+		{
+			for(const Aabb& query : queries)
+			{
+				for(const Aabb& box : boxes)
+				{
+					if(AabbOverlaps(box, query))
+					{
+						++hits[2];
+						break;
+					}
+				}
+			}
+		});
+
+		int mismatches = 0;
+		std::vector<int> expected;
+		for(const Aabb& query : queries)
+		{
+			expected.clear();
+			for(int id = 0; id < boxCount; ++id)
+			{
+				if(AabbOverlaps(boxes[id], query))
+					expected.push_back(id);
+			}
+
+			results.clear();
+			grid.Query(query, results);
+			std::sort(results.begin(), results.end());
+			if(results != expected || grid.Overlaps(query) != !expected.empty())
+				++mismatches;
+		}
+
+		std::printf("%8d %10.1f %9.2f %14.1f %12.1f %14.1f %9.0fx %6d\n", boxCount, buildMs, grid.CellSize(),
+			gridOverlaps, gridQuery, scanOverlaps, scanOverlaps / gridOverlaps, hits[0] + hits[1] + hits[2]);
+		return mismatches;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	std::vector<int> counts;
+	for(int a = 1; a < argc; ++a)
+		counts.push_back(std::atoi(argv[a]));
+	if(counts.empty())
+		counts = { 10000, 100000 };
+
+	std::printf("%8s %10s %9s %14s %12s %14s %10s %6s\n", "boxes", "build ms", "cell",
+		"grid overlaps", "grid query", "scan overlaps", "speedup", "check");
+
+	int mismatches = 0;
+	for(int count : counts)
+		mismatches += Run(count);
+
+	if(mismatches != 0)
+	{
+		std::printf("%d queries differ from the linear scan\n", mismatches);
+		return 1;
+	}
+	return 0;
+}
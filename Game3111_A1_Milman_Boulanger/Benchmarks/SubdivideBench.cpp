@@ -0,0 +1,161 @@
+//***************************************************************************************
+// SubdivideBench.cpp
+//
+// GeometryGenerator::Subdivide, which shares edge midpoints, against the original
+// copy-and-split version kept here as ReferenceSubdivide.  Starting from the geosphere
+// icosahedron, each level reports vertex count, vertex + index memory and the time
+// of one subdivision step for both, and checks that they produce the same triangles.
+//
+//   geometry_bench [maxLevel]
+//***************************************************************************************
+
+#include "GeometryGenerator.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+using namespace DirectX;
+
+namespace
+{
+	typedef GeometryGenerator::MeshData MeshData;
+	typedef GeometryGenerator::Vertex Vertex;
+	typedef GeometryGenerator::uint32 uint32;
+
+	// Both versions run this many times per level; the fastest run is reported.
+	const int Repeats = 5;
+
+	Vertex MidPoint(const Vertex& v0, const Vertex& v1)
+	{
+		XMVECTOR p0 = XMLoadFloat3(&v0.Position);
+		XMVECTOR p1 = XMLoadFloat3(&v1.Position);
+
+		XMVECTOR n0 = XMLoadFloat3(&v0.Normal);
+		XMVECTOR n1 = XMLoadFloat3(&v1.Normal);
+
+		XMVECTOR tan0 = XMLoadFloat3(&v0.TangentU);
+		XMVECTOR tan1 = XMLoadFloat3(&v1.TangentU);
+
+		XMVECTOR tex0 = XMLoadFloat2(&v0.TexC);
+		XMVECTOR tex1 = XMLoadFloat2(&v1.TexC);
+
+		Vertex v;
+		XMStoreFloat3(&v.Position, 0.5f*(p0 + p1));
+		XMStoreFloat3(&v.Normal, XMVector3Normalize(0.5f*(n0 + n1)));
+		XMStoreFloat3(&v.TangentU, XMVector3Normalize(0.5f*(tan0 + tan1)));
+		XMStoreFloat2(&v.TexC, 0.5f*(tex0 + tex1));
+		return v;
+	}
+
+	// Subdivide as it was before the midpoint cache: a full copy of the input, then
+	// six new vertices per triangle.
+	void ReferenceSubdivide(MeshData& meshData)
+	{
+		MeshData inputCopy = meshData;
+
+		meshData.Vertices.resize(0);
+		meshData.Indices32.resize(0);
+
+		uint32 numTris = (uint32)inputCopy.Indices32.size()/3;
+		for(uint32 i = 0; i < numTris; ++i)
+		{
+			Vertex v0 = inputCopy.Vertices[inputCopy.Indices32[i*3+0]];
+			Vertex v1 = inputCopy.Vertices[inputCopy.Indices32[i*3+1]];
+			Vertex v2 = inputCopy.Vertices[inputCopy.Indices32[i*3+2]];
+
+			Vertex m0 = MidPoint(v0, v1);
+			Vertex m1 = MidPoint(v1, v2);
+			Vertex m2 = MidPoint(v0, v2);
+
+			meshData.Vertices.push_back(v0);
+			meshData.Vertices.push_back(v1);
+			meshData.Vertices.push_back(v2);
+			meshData.Vertices.push_back(m0);
+			meshData.Vertices.push_back(m1);
+			meshData.Vertices.push_back(m2);
+
+			const uint32 triangles[12] =
+			{
+				i*6+0, i*6+3, i*6+5,
+				i*6+3, i*6+4, i*6+5,
+				i*6+5, i*6+4, i*6+2,
+				i*6+3, i*6+1, i*6+4
+			};
+			meshData.Indices32.insert(meshData.Indices32.end(), triangles, triangles + 12);
+		}
+	}
+
+	size_t MemoryBytes(const MeshData& meshData)
+	{
+		return meshData.Vertices.size()*sizeof(Vertex) + meshData.Indices32.size()*sizeof(uint32);
+	}
+
+	// Subdivides a copy of input with subdivide; returns the fastest time in ms and
+	// the result in output.
+	template<typename Fn>
+	double TimeSubdivide(const MeshData& input, MeshData& output, Fn&& subdivide)
+	{
+		double best = 1e30;
+		for(int r = 0; r < Repeats; ++r)
+		{
+			output = input;
+			auto start = std::chrono::steady_clock::now();
+			subdivide(output);
+			auto stop = std::chrono::steady_clock::now();
+			best = (std::min)(best, std::chrono::duration<double, std::milli>(stop - start).count());
+		}
+		return best;
+	}
+
+	// True if triangle t of a and b have the same corner positions.
+	bool SameTriangles(const MeshData& a, const MeshData& b)
+	{
+		if(a.Indices32.size() != b.Indices32.size())
+			return false;
+
+		for(size_t k = 0; k < a.Indices32.size(); ++k)
+		{
+			const XMFLOAT3& pa = a.Vertices[a.Indices32[k]].Position;
+			const XMFLOAT3& pb = b.Vertices[b.Indices32[k]].Position;
+			if(std::memcmp(&pa, &pb, sizeof(pa)) != 0)
+				return false;
+		}
+		return true;
+	}
+}
+
+int main(int argc, char* argv[])
+{
+	int maxLevel = argc > 1 ? std::atoi(argv[1]) : 6;
+
+	GeometryGenerator geoGen;
+	MeshData reference = geoGen.CreateGeosphere(1.0f, 0);
+	MeshData shared = reference;
+
+	std::printf("%5s %8s %18s %22s %20s\n", "level", "tris", "vertices old/new", "memory KB old/new", "time ms old/new");
+
+	int mismatches = 0;
+	for(int level = 1; level <= maxLevel; ++level)
+	{
+		MeshData nextReference, nextShared;
+		double referenceMs = TimeSubdivide(reference, nextReference, ReferenceSubdivide);
+		double sharedMs = TimeSubdivide(shared, nextShared, [&geoGen](MeshData& m) { geoGen.Subdivide(m); });
+
+		if(!SameTriangles(nextReference, nextShared))
+		{
+			std::printf("level %d: triangles differ from the reference\n", level);
+			++mismatches;
+		}
+
+		std::printf("%5d %8zu %8zu /%8zu %10.1f /%10.1f %9.3f /%9.3f\n", level, nextShared.Indices32.size()/3,
+			nextReference.Vertices.size(), nextShared.Vertices.size(),
+			MemoryBytes(nextReference)/1024.0, MemoryBytes(nextShared)/1024.0, referenceMs, sharedMs);
+
+		reference = std::move(nextReference);
+		shared = std::move(nextShared);
+	}
+
+	return mismatches == 0 ? 0 : 1;
+}
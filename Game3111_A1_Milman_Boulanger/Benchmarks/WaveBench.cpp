@@ -0,0 +1,190 @@
+//***************************************************************************************
+// WaveBench.cpp
+//
+// Wave solver throughput on the CPU, in ns per cell per time step, so it can be tracked
+// per commit without Windows or a GPU.
+//
+//   wave_bench [section] [maxSize]
+//
+// Runs every section, or only the named one, on square grids up to maxSize (4096 by
+// default).
+//***************************************************************************************
+
+#include "TaskScheduler.h"
+#include "WaveKernels.h"
+#include "Waves.h"
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+
+namespace
+{
+	// Each measurement steps about this many cells in total, so small grids run more
+	// steps than large ones and every size is timed over a similar amount of work.
+	const double CellStepsPerRun = 4.0e8;
+
+	const float SpatialStep = 1.0f;
+	const float TimeStep = 0.03f;
+	const float Speed = 4.0f;
+	const float Damping = 0.2f;
+
+	// Puts a ripple in every activity tile so the whole grid is stepped, as it is
+	// under a steady rain.
+	void Seed(Waves& waves, int tileSize)
+	{
+		const int m = waves.RowCount();
+		const int n = waves.ColumnCount();
+
+		unsigned state = 12345u;
+		for(int i = 2; i < m - 2; i += tileSize)
+		{
+			for(int j = 2; j < n - 2; j += tileSize)
+			{
+				state = state*1664525u + 1013904223u;
+				int di = (int)(state >> 8) % tileSize;
+				int dj = (int)(state >> 20) % tileSize;
+				waves.QueueDisturbance(i + di, j + dj, 0.5f);
+			}
+		}
+
+		waves.Step(1);
+	}
+
+	int StepsFor(int size)
+	{
+		int steps = (int)(CellStepsPerRun / ((double)size*size));
+		return steps < 4 ? 4 : steps;
+	}
+
+	// Times waves.Step(steps); returns ns per cell per step.
+	double TimeSteps(Waves& waves, int steps)
+	{
+		auto start = std::chrono::steady_clock::now();
+		waves.Step(steps);
+		auto stop = std::chrono::steady_clock::now();
+
+		double ns = std::chrono::duration<double, std::nano>(stop - start).count();
+		return ns / ((double)steps*waves.VertexCount());
+	}
+
+	// Row sweep over every cell: the solver's steady-state cost.
+	void RunSizes(int maxSize)
+	{
+		std::printf("%-12s %8s %14s %10s\n", "grid", "steps", "ns/cell/step", "stepped");
+		for(int size = 128; size <= maxSize; size *= 2)
+		{
+			WaveSolverDesc desc;
+			desc.RestEpsilon = 0.0f;
+
+			Waves waves(size, size, SpatialStep, TimeStep, Speed, Damping, nullptr, desc);
+			Seed(waves, desc.ActivityTileSize);
+
+			int steps = StepsFor(size);
+			double ns = TimeSteps(waves, steps);
+
+			WaveActivityStats activity = waves.ActivityStats();
+			char grid[32];
+			std::snprintf(grid, sizeof(grid), "%dx%d", size, size);
+			std::printf("%-12s %8d %14.3f %9.1f%%\n", grid, steps, ns,
+				100.0*activity.UpdatedTiles / activity.TileCount);
+		}
+	}
+
+	// Row sweep against the temporally blocked tiled mode on the grids it is meant for.
+	void RunTiled(int maxSize)
+	{
+		std::printf("%-12s %14s %14s %8s\n", "grid", "rows", "tiled", "speedup");
+		for(int size = 2048; size <= maxSize; size *= 2)
+		{
+			double ns[2];
+			for(int mode = 0; mode < 2; ++mode)
+			{
+				WaveSolverDesc desc;
+				desc.Mode = mode == 0 ? WaveSolverMode::RowSweep : WaveSolverMode::Tiled;
+				desc.RestEpsilon = 0.0f;
+
+				Waves waves(size, size, SpatialStep, TimeStep, Speed, Damping, nullptr, desc);
+				Seed(waves, desc.ActivityTileSize);
+
+				// Whole blocks of StepsPerTile steps, as a tiled pass advances.
+				int steps = StepsFor(size);
+				steps = (steps + desc.StepsPerTile - 1) / desc.StepsPerTile * desc.StepsPerTile;
+				ns[mode] = TimeSteps(waves, steps);
+			}
+
+			char grid[32];
+			std::snprintf(grid, sizeof(grid), "%dx%d", size, size);
+			std::printf("%-12s %14.3f %14.3f %7.2fx\n", grid, ns[0], ns[1], ns[0] / ns[1]);
+		}
+	}
+
+	// Row sweep with each height storage type.  Drift against Double is checked by
+	// wave_storage_test.
+	void RunStorage(int maxSize)
+	{
+		const WaveStorage storages[] = { WaveStorage::Half, WaveStorage::Single, WaveStorage::Double };
+		const char* names[] = { "half", "single", "double" };
+
+		std::printf("%-12s %-8s %-14s %14s\n", "grid", "storage", "kernels", "ns/cell/step");
+		for(int size = 1024; size <= maxSize; size *= 2)
+		{
+			for(int k = 0; k < 3; ++k)
+			{
+				WaveSolverDesc desc;
+				desc.Storage = storages[k];
+				desc.RestEpsilon = 0.0f;
+
+				Waves waves(size, size, SpatialStep, TimeStep, Speed, Damping, nullptr, desc);
+				Seed(waves, desc.ActivityTileSize);
+				double ns = TimeSteps(waves, StepsFor(size));
+
+				char grid[32];
+				std::snprintf(grid, sizeof(grid), "%dx%d", size, size);
+				std::printf("%-12s %-8s %-14s %14.3f\n", grid, names[k], waves.KernelName(), ns);
+			}
+		}
+	}
+
+	struct Section
+	{
+		const char* Name;
+		void (*Run)(int maxSize);
+	};
+
+	const Section Sections[] =
+	{
+		{ "sizes", RunSizes },
+		{ "tiled", RunTiled },
+		{ "storage", RunStorage },
+	};
+}
+
+int main(int argc, char* argv[])
+{
+	const char* only = argc > 1 ? argv[1] : nullptr;
+	int maxSize = argc > 2 ? std::atoi(argv[2]) : 4096;
+	if(only != nullptr && std::strcmp(only, "all") == 0)
+		only = nullptr;
+
+	std::printf("%u worker threads + caller, %s kernels\n",
+		TaskScheduler::Default().WorkerCount(), WaveKernels::Best().Name);
+
+	bool ran = false;
+	for(const Section& section : Sections)
+	{
+		if(only != nullptr && std::strcmp(only, section.Name) != 0)
+			continue;
+
+		std::printf("\n[%s]\n", section.Name);
+		section.Run(maxSize);
+		ran = true;
+	}
+
+	if(!ran)
+	{
+		std::fprintf(stderr, "unknown section '%s'\n", only);
+		return 1;
+	}
+	return 0;
+}
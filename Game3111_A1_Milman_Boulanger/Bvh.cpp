@@ -0,0 +1,370 @@
+//***************************************************************************************
+// Bvh.cpp
+//***************************************************************************************
+
+#include "Bvh.h"
+#include <algorithm>
+#include <cfloat>
+
+namespace
+{
+	const int BinCount = 16;
+
+	// Leaves never hold more boxes than this; smaller sets become leaves when the SAH
+	// says splitting them does not pay.
+	const int MaxLeafSize = 8;
+
+	// Keeps the traversal stacks (64 entries) from overflowing on degenerate input.
+	const int MaxDepth = 48;
+
+	// Cost of visiting a node relative to testing one box.
+	const float TraversalCost = 1.0f;
+
+	float HalfArea(const Aabb& box)
+	{
+		float dx = box.Max[0] - box.Min[0];
+		float dy = box.Max[1] - box.Min[1];
+		float dz = box.Max[2] - box.Min[2];
+		return dx*dy + dy*dz + dz*dx;
+	}
+
+	Aabb EmptyBox()
+	{
+		Aabb box;
+		for(int a = 0; a < 3; ++a)
+		{
+			box.Min[a] = FLT_MAX;
+			box.Max[a] = -FLT_MAX;
+		}
+		return box;
+	}
+
+	// Entry distance of the ray into box, clipped to [0, maxT]; false on a miss.
+	bool RayBox(const float origin[3], const float invDir[3], const Aabb& box, float maxT, float& tEnter)
+	{
+		float t0 = 0.0f;
+		float t1 = maxT;
+		for(int a = 0; a < 3; ++a)
+		{
+			if(invDir[a] == FLT_MAX)
+			{
+				// Parallel to this slab.
+				if(origin[a] < box.Min[a] || origin[a] > box.Max[a])
+					return false;
+				continue;
+			}
+
+			float tNear = (box.Min[a] - origin[a]) * invDir[a];
+			float tFar = (box.Max[a] - origin[a]) * invDir[a];
+			if(tNear > tFar)
+				std::swap(tNear, tFar);
+
+			t0 = std::max(t0, tNear);
+			t1 = std::min(t1, tFar);
+			if(t0 > t1)
+				return false;
+		}
+
+		tEnter = t0;
+		return true;
+	}
+}
+
+void Bvh::Build(const Aabb* boxes, int count)
+{
+	mBoxes.assign(boxes, boxes + count);
+	mNodes.clear();
+	mItems.resize(count);
+	for(int i = 0; i < count; ++i)
+		mItems[i] = i;
+
+	if(count == 0)
+		return;
+
+	std::vector<float> centroids(3*count);
+	for(int i = 0; i < count; ++i)
+	{
+		for(int a = 0; a < 3; ++a)
+			centroids[3*i + a] = 0.5f*(boxes[i].Min[a] + boxes[i].Max[a]);
+	}
+
+	mNodes.reserve(2*count - 1);
+	mNodes.emplace_back();
+	mNodes[0].First = 0;
+	mNodes[0].Count = count;
+	BuildNode(0, centroids, 0);
+}
+
+void Bvh::BuildNode(int index, const std::vector<float>& centroids, int depth)
+{
+	const int first = mNodes[index].First;
+	const int count = mNodes[index].Count;
+
+	Aabb bounds = EmptyBox();
+	Aabb centroidBounds = EmptyBox();
+	for(int k = first; k < first + count; ++k)
+	{
+		int id = mItems[k];
+		bounds = AabbUnion(bounds, mBoxes[id]);
+		for(int a = 0; a < 3; ++a)
+		{
+			centroidBounds.Min[a] = std::min(centroidBounds.Min[a], centroids[3*id + a]);
+			centroidBounds.Max[a] = std::max(centroidBounds.Max[a], centroids[3*id + a]);
+		}
+	}
+	mNodes[index].Bounds = bounds;
+
+	if(count <= 2 || depth >= MaxDepth)
+		return;
+
+	// Evaluate BinCount - 1 split planes per axis on the centroid bounds.
+	float bestCost = FLT_MAX;
+	int bestAxis = -1;
+	int bestBin = 0;
+	for(int a = 0; a < 3; ++a)
+	{
+		float extent = centroidBounds.Max[a] - centroidBounds.Min[a];
+		if(extent <= 0.0f)
+			continue;
+
+		int binCounts[BinCount] = {};
+		Aabb binBounds[BinCount];
+		for(int b = 0; b < BinCount; ++b)
+			binBounds[b] = EmptyBox();
+
+		float scale = BinCount / extent;
+		for(int k = first; k < first + count; ++k)
+		{
+			int id = mItems[k];
+			int b = std::min(BinCount - 1, (int)((centroids[3*id + a] - centroidBounds.Min[a]) * scale));
+			++binCounts[b];
+			binBounds[b] = AabbUnion(binBounds[b], mBoxes[id]);
+		}
+
+		// Sweep from the right to get the cost of every right-hand side, then from the
+		// left to combine.
+		float rightArea[BinCount];
+		int rightCount[BinCount];
+		Aabb acc = EmptyBox();
+		int accCount = 0;
+		for(int b = BinCount - 1; b > 0; --b)
+		{
+			acc = AabbUnion(acc, binBounds[b]);
+			accCount += binCounts[b];
+			rightArea[b] = accCount > 0 ? HalfArea(acc) : 0.0f;
+			rightCount[b] = accCount;
+		}
+
+		acc = EmptyBox();
+		accCount = 0;
+		for(int b = 0; b < BinCount - 1; ++b)
+		{
+			acc = AabbUnion(acc, binBounds[b]);
+			accCount += binCounts[b];
+			if(accCount == 0 || rightCount[b + 1] == 0)
+				continue;
+
+			float cost = HalfArea(acc)*accCount + rightArea[b + 1]*rightCount[b + 1];
+			if(cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = a;
+				bestBin = b;
+			}
+		}
+	}
+
+	const float leafCost = (float)count;
+	const float area = HalfArea(bounds);
+	if(bestAxis >= 0 && area > 0.0f)
+		bestCost = TraversalCost + bestCost / area;
+
+	if(count <= MaxLeafSize && (bestAxis < 0 || bestCost >= leafCost))
+		return;
+
+	int mid;
+	if(bestAxis >= 0)
+	{
+		const int a = bestAxis;
+		const float scale = BinCount / (centroidBounds.Max[a] - centroidBounds.Min[a]);
+		const float minC = centroidBounds.Min[a];
+		int* split = std::partition(&mItems[first], &mItems[first] + count, [&](int id)
+		{
+			return std::min(BinCount - 1, (int)((centroids[3*id + a] - minC) * scale)) <= bestBin;
+		});
+		mid = (int)(split - &mItems[0]);
+	}
+	else
+	{
+		// All centroids coincide: any split is as good as another.
+		mid = first + count/2;
+	}
+
+	int left = (int)mNodes.size();
+	mNodes[index].Left = left;
+	mNodes.emplace_back();
+	mNodes.emplace_back();
+	mNodes[left].First = first;
+	mNodes[left].Count = mid - first;
+	mNodes[left + 1].First = mid;
+	mNodes[left + 1].Count = first + count - mid;
+
+	BuildNode(left, centroids, depth + 1);
+	BuildNode(left + 1, centroids, depth + 1);
+}
+
+void Bvh::Refit(const Aabb* boxes)
+{
+	mBoxes.assign(boxes, boxes + mBoxes.size());
+
+	// Children always come after their parent, so one reverse pass suffices.
+	for(int i = (int)mNodes.size() - 1; i >= 0; --i)
+	{
+		Node& node = mNodes[i];
+		if(node.Left < 0)
+		{
+			Aabb bounds = mBoxes[mItems[node.First]];
+			for(int k = node.First + 1; k < node.First + node.Count; ++k)
+				bounds = AabbUnion(bounds, mBoxes[mItems[k]]);
+			node.Bounds = bounds;
+		}
+		else
+		{
+			node.Bounds = AabbUnion(mNodes[node.Left].Bounds, mNodes[node.Left + 1].Bounds);
+		}
+	}
+}
+
+int Bvh::BoxCount()const
+{
+	return (int)mBoxes.size();
+}
+
+int Bvh::NodeCount()const
+{
+	return (int)mNodes.size();
+}
+
+const Aabb& Bvh::Box(int id)const
+{
+	return mBoxes[id];
+}
+
+void Bvh::Query(const Aabb& query, std::vector<int>& results)const
+{
+	ForEachOverlap(query, [&results](int id)
+	{
+		results.push_back(id);
+		return true;
+	});
+}
+
+void Bvh::QueryFrustum(const FrustumPlanes& frustum, std::vector<int>& results)const
+{
+	ForEachInFrustum(frustum, [&results](int id)
+	{
+		results.push_back(id);
+	});
+}
+
+int Bvh::Raycast(const float origin[3], const float dir[3], float maxT, float& t)const
+{
+	if(mNodes.empty())
+		return -1;
+
+	float invDir[3];
+	for(int a = 0; a < 3; ++a)
+		invDir[a] = dir[a] != 0.0f ? 1.0f / dir[a] : FLT_MAX;
+
+	int hit = -1;
+	float best = maxT;
+
+	float rootT;
+	if(!RayBox(origin, invDir, mNodes[0].Bounds, best, rootT))
+		return -1;
+
+	// Children are visited nearest first and skipped once they start beyond the
+	// closest hit found so far.
+	struct Entry { int Node; float T; };
+	Entry stack[64];
+	int top = 0;
+	stack[top++] = { 0, rootT };
+	while(top > 0)
+	{
+		Entry entry = stack[--top];
+		if(entry.T > best)
+			continue;
+
+		const Node& node = mNodes[entry.Node];
+		if(node.Left < 0)
+		{
+			for(int k = node.First; k < node.First + node.Count; ++k)
+			{
+				float tBox;
+				if(RayBox(origin, invDir, mBoxes[mItems[k]], best, tBox) && (hit < 0 || tBox < best))
+				{
+					best = tBox;
+					hit = mItems[k];
+				}
+			}
+			continue;
+		}
+
+		float tLeft, tRight;
+		bool hitLeft = RayBox(origin, invDir, mNodes[node.Left].Bounds, best, tLeft);
+		bool hitRight = RayBox(origin, invDir, mNodes[node.Left + 1].Bounds, best, tRight);
+		if(hitLeft && hitRight)
+		{
+			if(tLeft <= tRight)
+			{
+				stack[top++] = { node.Left + 1, tRight };
+				stack[top++] = { node.Left, tLeft };
+			}
+			else
+			{
+				stack[top++] = { node.Left, tLeft };
+				stack[top++] = { node.Left + 1, tRight };
+			}
+		}
+		else if(hitLeft)
+		{
+			stack[top++] = { node.Left, tLeft };
+		}
+		else if(hitRight)
+		{
+			stack[top++] = { node.Left + 1, tRight };
+		}
+	}
+
+	if(hit >= 0)
+		t = best;
+	return hit;
+}
+
+bool Bvh::ClassifyFrustum(const Aabb& box, const FrustumPlanes& frustum, int& mask)
+{
+	for(int p = 0; p < 6; ++p)
+	{
+		if((mask & (1 << p)) == 0)
+			continue;
+
+		const float* plane = frustum.Planes[p];
+
+		// Distances of the box corners furthest along and against the plane normal.
+		float farthest = plane[3];
+		float nearest = plane[3];
+		for(int a = 0; a < 3; ++a)
+		{
+			float lo = plane[a]*box.Min[a];
+			float hi = plane[a]*box.Max[a];
+			farthest += std::max(lo, hi);
+			nearest += std::min(lo, hi);
+		}
+
+		if(farthest < 0.0f)
+			return false;
+		if(nearest >= 0.0f)
+			mask &= ~(1 << p);
+	}
+	return true;
+}
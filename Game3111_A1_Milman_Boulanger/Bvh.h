@@ -0,0 +1,152 @@
+//***************************************************************************************
+// Bvh.h
+//
+// Bounding volume hierarchy over a set of boxes, built top-down with a binned surface
+// area heuristic.  Unlike SpatialGrid it adapts to uneven object density and large
+// objects, and it answers ray and frustum queries as well as box queries, so picking
+// and culling can share it with collision.
+//
+// Box ids are their indices in the array given to Build.  Boxes that move can be
+// updated with Refit, which keeps the tree topology; rebuild when the scene changes
+// a lot.  Queries are const and may run concurrently.
+//***************************************************************************************
+
+#ifndef BVH_H
+#define BVH_H
+
+#include "Aabb.h"
+#include <vector>
+
+class Bvh
+{
+public:
+	void Build(const Aabb* boxes, int count);
+
+	// Replaces the boxes (same count and ids as Build) and recomputes node bounds
+	// bottom-up without changing the tree.
+	void Refit(const Aabb* boxes);
+
+	int BoxCount()const;
+	int NodeCount()const;
+	const Aabb& Box(int id)const;
+
+	// Appends the ids of all boxes overlapping query to results.
+	void Query(const Aabb& query, std::vector<int>& results)const;
+
+	// Appends the ids of all boxes at least partly inside frustum to results.
+	void QueryFrustum(const FrustumPlanes& frustum, std::vector<int>& results)const;
+
+	// Returns the id of the nearest box hit by the ray origin + t*dir, 0 <= t <= maxT,
+	// or -1.  t receives the entry distance (0 if origin is inside the box).
+	int Raycast(const float origin[3], const float dir[3], float maxT, float& t)const;
+
+	// Calls fn(id) for every box overlapping query until fn returns false.  Returns
+	// false if fn stopped the walk.
+	template<typename Fn>
+	bool ForEachOverlap(const Aabb& query, Fn&& fn)const
+	{
+		if(mNodes.empty())
+			return true;
+
+		int stack[64];
+		int top = 0;
+		stack[top++] = 0;
+		while(top > 0)
+		{
+			const Node& node = mNodes[stack[--top]];
+			if(!AabbOverlaps(node.Bounds, query))
+				continue;
+
+			if(node.Left < 0)
+			{
+				for(int k = node.First; k < node.First + node.Count; ++k)
+				{
+					int id = mItems[k];
+					if(AabbOverlaps(mBoxes[id], query) && !fn(id))
+						return false;
+				}
+			}
+			else
+			{
+				stack[top++] = node.Left + 1;
+				stack[top++] = node.Left;
+			}
+		}
+		return true;
+	}
+
+	// Calls fn(id) for every box at least partly inside frustum.  Subtrees entirely
+	// inside a plane stop testing against it, so subtrees entirely inside the frustum
+	// are reported without further tests.
+	template<typename Fn>
+	void ForEachInFrustum(const FrustumPlanes& frustum, Fn&& fn)const
+	{
+		if(mNodes.empty())
+			return;
+
+		// Node index and the mask of planes still to be tested.
+		struct Entry { int Node; int Planes; };
+		Entry stack[64];
+		int top = 0;
+		stack[top++] = { 0, AllPlanes };
+		while(top > 0)
+		{
+			Entry entry = stack[--top];
+			const Node& node = mNodes[entry.Node];
+
+			int planes = entry.Planes;
+			if(planes != 0 && !ClassifyFrustum(node.Bounds, frustum, planes))
+				continue;
+
+			if(planes == 0)
+			{
+				// Every box below node is inside; they are contiguous in mItems.
+				for(int k = node.First; k < node.First + node.Count; ++k)
+					fn(mItems[k]);
+				continue;
+			}
+
+			if(node.Left < 0)
+			{
+				for(int k = node.First; k < node.First + node.Count; ++k)
+				{
+					int leafPlanes = planes;
+					int id = mItems[k];
+					if(ClassifyFrustum(mBoxes[id], frustum, leafPlanes))
+						fn(id);
+				}
+			}
+			else
+			{
+				stack[top++] = { node.Left + 1, planes };
+				stack[top++] = { node.Left, planes };
+			}
+		}
+	}
+
+private:
+	struct Node
+	{
+		Aabb Bounds;
+		// Boxes below this node are mItems[First, First + Count).  Interior nodes have
+		// children Left and Left + 1; leaves have Left == -1.
+		int First = 0;
+		int Count = 0;
+		int Left = -1;
+	};
+
+	static const int AllPlanes = 0x3f;
+
+	// Returns false if box is outside one of the planes in mask; clears the bits of
+	// planes box is entirely inside.
+	static bool ClassifyFrustum(const Aabb& box, const FrustumPlanes& frustum, int& mask);
+
+	// Computes the bounds of node index and splits its boxes between two children.
+	void BuildNode(int index, const std::vector<float>& centroids, int depth);
+
+	std::vector<Aabb> mBoxes;
+	std::vector<Node> mNodes;
+	std::vector<int> mItems;
+};
+
+#endif // BVH_H
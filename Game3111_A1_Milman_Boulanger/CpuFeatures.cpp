@@ -0,0 +1,78 @@
+//***************************************************************************************
+// CpuFeatures.cpp
+//***************************************************************************************
+
+#include "CpuFeatures.h"
+
+#if CPU_X86
+#if defined(_MSC_VER)
+#include <intrin.h>
+#else
+#include <cpuid.h>
+#endif
+#endif
+
+namespace
+{
+#if CPU_X86
+	bool QueryAvx()
+	{
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 1);
+		bool osUsesXSave = (info[2] & (1 << 27)) != 0;
+		bool cpuHasAvx = (info[2] & (1 << 28)) != 0;
+		if(!osUsesXSave || !cpuHasAvx)
+			return false;
+
+		// The OS must also save the upper halves of the YMM registers.
+		return (_xgetbv(0) & 0x6) == 0x6;
+#else
+		return __builtin_cpu_supports("avx") != 0;
+#endif
+	}
+
+	bool QueryF16c()
+	{
+		if(!QueryAvx())
+			return false;
+
+#if defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 1);
+		return (info[2] & (1 << 29)) != 0;
+#else
+		unsigned eax, ebx, ecx, edx;
+		return __get_cpuid(1, &eax, &ebx, &ecx, &edx) && (ecx & (1u << 29)) != 0;
+#endif
+	}
+#endif
+}
+
+namespace CpuFeatures
+{
+	bool HasSse2()
+	{
+		return CPU_X86 != 0;
+	}
+
+	bool HasAvx()
+	{
+#if CPU_X86
+		static const bool supported = QueryAvx();
+		return supported;
+#else
+		return false;
+#endif
+	}
+
+	bool HasF16c()
+	{
+#if CPU_X86
+		static const bool supported = QueryF16c();
+		return supported;
+#else
+		return false;
+#endif
+	}
+}
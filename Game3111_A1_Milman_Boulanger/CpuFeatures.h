@@ -0,0 +1,40 @@
+//***************************************************************************************
+// CpuFeatures.h
+//
+// Runtime instruction-set detection shared by the SIMD kernel files (WaveKernels,
+// CullKernels).  Including it on x86 also brings in the intrinsics headers.
+//***************************************************************************************
+
+#ifndef CPUFEATURES_H
+#define CPUFEATURES_H
+
+#if defined(_M_IX86) || defined(_M_X64) || defined(__i386__) || defined(__x86_64__)
+#define CPU_X86 1
+#include <immintrin.h>
+#else
+#define CPU_X86 0
+#endif
+
+// MSVC lets any function use AVX intrinsics; GCC/Clang need the target enabled per function.
+#if defined(_MSC_VER)
+#define CPU_TARGET_AVX
+#define CPU_TARGET_F16C
+#else
+#define CPU_TARGET_AVX __attribute__((target("avx")))
+#define CPU_TARGET_F16C __attribute__((target("avx,f16c")))
+#endif
+
+namespace CpuFeatures
+{
+	// SSE2 is part of the x64 baseline and the default /arch for x86 builds, so this
+	// is true on any x86 target.
+	bool HasSse2();
+
+	// AVX, with the OS saving the upper halves of the YMM registers.
+	bool HasAvx();
+
+	// F16C conversions; implies HasAvx.
+	bool HasF16c();
+}
+
+#endif // CPUFEATURES_H
@@ -0,0 +1,221 @@
+//***************************************************************************************
+// CullKernels.cpp
+//***************************************************************************************
+
+#include "CullKernels.h"
+#include "CpuFeatures.h"
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	using CullKernels::BoxSoA;
+
+	// Clears the bits of the padding lanes past the last box.
+	void ClearPadding(int count, std::uint32_t* mask)
+	{
+		if(count & 31)
+			mask[count >> 5] &= (1u << (count & 31)) - 1;
+	}
+
+	void FrustumScalar(const FrustumPlanes& frustum, const BoxSoA& boxes, std::uint32_t* mask)
+	{
+		const int count = boxes.Count();
+		std::memset(mask, 0, CullKernels::MaskWordCount(count)*sizeof(std::uint32_t));
+
+		const float* cx = boxes.CenterX();
+		const float* cy = boxes.CenterY();
+		const float* cz = boxes.CenterZ();
+		const float* ex = boxes.ExtentX();
+		const float* ey = boxes.ExtentY();
+		const float* ez = boxes.ExtentZ();
+
+		for(int i = 0; i < count; ++i)
+		{
+			bool visible = true;
+			for(int p = 0; p < 6 && visible; ++p)
+			{
+				const float* plane = frustum.Planes[p];
+
+				// Signed distance of the center plus the box's projected radius.
+				float dist = cx[i]*plane[0] + cy[i]*plane[1] + cz[i]*plane[2] + plane[3];
+				float radius = ex[i]*std::fabs(plane[0]) + ey[i]*std::fabs(plane[1]) + ez[i]*std::fabs(plane[2]);
+				visible = !(dist + radius < 0.0f);
+			}
+
+			if(visible)
+				mask[i >> 5] |= 1u << (i & 31);
+		}
+	}
+
+#if CPU_X86
+	void FrustumSse(const FrustumPlanes& frustum, const BoxSoA& boxes, std::uint32_t* mask)
+	{
+		const int count = boxes.Count();
+		std::memset(mask, 0, CullKernels::MaskWordCount(count)*sizeof(std::uint32_t));
+
+		const __m128 zero = _mm_setzero_ps();
+		const __m128 absMask = _mm_castsi128_ps(_mm_set1_epi32(0x7fffffff));
+
+		__m128 a[6], b[6], c[6], d[6], absA[6], absB[6], absC[6];
+		for(int p = 0; p < 6; ++p)
+		{
+			a[p] = _mm_set1_ps(frustum.Planes[p][0]);
+			b[p] = _mm_set1_ps(frustum.Planes[p][1]);
+			c[p] = _mm_set1_ps(frustum.Planes[p][2]);
+			d[p] = _mm_set1_ps(frustum.Planes[p][3]);
+			absA[p] = _mm_and_ps(a[p], absMask);
+			absB[p] = _mm_and_ps(b[p], absMask);
+			absC[p] = _mm_and_ps(c[p], absMask);
+		}
+
+		for(int i = 0; i < count; i += 4)
+		{
+			__m128 cx = _mm_loadu_ps(boxes.CenterX() + i);
+			__m128 cy = _mm_loadu_ps(boxes.CenterY() + i);
+			__m128 cz = _mm_loadu_ps(boxes.CenterZ() + i);
+			__m128 ex = _mm_loadu_ps(boxes.ExtentX() + i);
+			__m128 ey = _mm_loadu_ps(boxes.ExtentY() + i);
+			__m128 ez = _mm_loadu_ps(boxes.ExtentZ() + i);
+
+			__m128 visible = _mm_castsi128_ps(_mm_set1_epi32(-1));
+			for(int p = 0; p < 6; ++p)
+			{
+				__m128 dist = _mm_add_ps(_mm_add_ps(_mm_add_ps(_mm_mul_ps(cx, a[p]), _mm_mul_ps(cy, b[p])), _mm_mul_ps(cz, c[p])), d[p]);
+				__m128 radius = _mm_add_ps(_mm_add_ps(_mm_mul_ps(ex, absA[p]), _mm_mul_ps(ey, absB[p])), _mm_mul_ps(ez, absC[p]));
+				visible = _mm_and_ps(visible, _mm_cmpnlt_ps(_mm_add_ps(dist, radius), zero));
+
+				// Stop once every lane is outside some plane.
+				if(_mm_movemask_ps(visible) == 0)
+					break;
+			}
+
+			mask[i >> 5] |= (std::uint32_t)_mm_movemask_ps(visible) << (i & 31);
+		}
+
+		ClearPadding(count, mask);
+	}
+
+	CPU_TARGET_AVX
+	void FrustumAvx(const FrustumPlanes& frustum, const BoxSoA& boxes, std::uint32_t* mask)
+	{
+		const int count = boxes.Count();
+		std::memset(mask, 0, CullKernels::MaskWordCount(count)*sizeof(std::uint32_t));
+
+		const __m256 zero = _mm256_setzero_ps();
+		const __m256 absMask = _mm256_castsi256_ps(_mm256_set1_epi32(0x7fffffff));
+
+		__m256 a[6], b[6], c[6], d[6], absA[6], absB[6], absC[6];
+		for(int p = 0; p < 6; ++p)
+		{
+			a[p] = _mm256_set1_ps(frustum.Planes[p][0]);
+			b[p] = _mm256_set1_ps(frustum.Planes[p][1]);
+			c[p] = _mm256_set1_ps(frustum.Planes[p][2]);
+			d[p] = _mm256_set1_ps(frustum.Planes[p][3]);
+			absA[p] = _mm256_and_ps(a[p], absMask);
+			absB[p] = _mm256_and_ps(b[p], absMask);
+			absC[p] = _mm256_and_ps(c[p], absMask);
+		}
+
+		for(int i = 0; i < count; i += 8)
+		{
+			__m256 cx = _mm256_loadu_ps(boxes.CenterX() + i);
+			__m256 cy = _mm256_loadu_ps(boxes.CenterY() + i);
+			__m256 cz = _mm256_loadu_ps(boxes.CenterZ() + i);
+			__m256 ex = _mm256_loadu_ps(boxes.ExtentX() + i);
+			__m256 ey = _mm256_loadu_ps(boxes.ExtentY() + i);
+			__m256 ez = _mm256_loadu_ps(boxes.ExtentZ() + i);
+
+			__m256 visible = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+			for(int p = 0; p < 6; ++p)
+			{
+				__m256 dist = _mm256_add_ps(_mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(cx, a[p]), _mm256_mul_ps(cy, b[p])), _mm256_mul_ps(cz, c[p])), d[p]);
+				__m256 radius = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(ex, absA[p]), _mm256_mul_ps(ey, absB[p])), _mm256_mul_ps(ez, absC[p]));
+				visible = _mm256_and_ps(visible, _mm256_cmp_ps(_mm256_add_ps(dist, radius), zero, _CMP_NLT_UQ));
+
+				// Stop once every lane is outside some plane.
+				if(_mm256_movemask_ps(visible) == 0)
+					break;
+			}
+
+			mask[i >> 5] |= (std::uint32_t)_mm256_movemask_ps(visible) << (i & 31);
+		}
+
+		_mm256_zeroupper();
+		ClearPadding(count, mask);
+	}
+#endif
+}
+
+namespace CullKernels
+{
+	void BoxSoA::Resize(int count)
+	{
+		mCount = count;
+
+		// Padding lanes are zero-sized boxes at the origin; ClearPadding drops them.
+		size_t padded = (size_t)((count + 7) & ~7);
+		mCenterX.resize(padded, 0.0f);
+		mCenterY.resize(padded, 0.0f);
+		mCenterZ.resize(padded, 0.0f);
+		mExtentX.resize(padded, 0.0f);
+		mExtentY.resize(padded, 0.0f);
+		mExtentZ.resize(padded, 0.0f);
+	}
+
+	void BoxSoA::Set(int id, const float center[3], const float extents[3])
+	{
+		mCenterX[id] = center[0];
+		mCenterY[id] = center[1];
+		mCenterZ[id] = center[2];
+		mExtentX[id] = extents[0];
+		mExtentY[id] = extents[1];
+		mExtentZ[id] = extents[2];
+	}
+
+	void BoxSoA::Set(int id, const Aabb& box)
+	{
+		float center[3], extents[3];
+		for(int a = 0; a < 3; ++a)
+		{
+			center[a] = 0.5f*(box.Min[a] + box.Max[a]);
+			extents[a] = 0.5f*(box.Max[a] - box.Min[a]);
+		}
+		Set(id, center, extents);
+	}
+
+	const KernelSet& Scalar()
+	{
+		static const KernelSet kernels = { "scalar", 1, FrustumScalar };
+		return kernels;
+	}
+
+	const KernelSet* Sse()
+	{
+#if CPU_X86
+		static const KernelSet kernels = { "sse", 4, FrustumSse };
+		return CpuFeatures::HasSse2() ? &kernels : nullptr;
+#else
+		return nullptr;
+#endif
+	}
+
+	const KernelSet* Avx()
+	{
+#if CPU_X86
+		static const KernelSet kernels = { "avx", 8, FrustumAvx };
+		return CpuFeatures::HasAvx() ? &kernels : nullptr;
+#else
+		return nullptr;
+#endif
+	}
+
+	const KernelSet& Best()
+	{
+		if(const KernelSet* avx = Avx())
+			return *avx;
+		if(const KernelSet* sse = Sse())
+			return *sse;
+		return Scalar();
+	}
+}
@@ -0,0 +1,77 @@
+//***************************************************************************************
+// CullKernels.h
+//
+// Batch frustum test over boxes stored as structure-of-arrays (one array per
+// center/extent component), so a SIMD kernel can test 4 or 8 boxes against a plane
+// with a handful of instructions and no branches.  Like WaveKernels there are scalar,
+// SSE and AVX versions chosen at runtime; all of them perform the same IEEE
+// operations in the same order and produce identical masks.
+//***************************************************************************************
+
+#ifndef CULLKERNELS_H
+#define CULLKERNELS_H
+
+#include "Aabb.h"
+#include <cstdint>
+#include <vector>
+
+namespace CullKernels
+{
+	// Boxes as centers and extents.  The arrays are padded to a multiple of 8 so the
+	// kernels never need a scalar tail; padding lanes are never reported visible.
+	class BoxSoA
+	{
+	public:
+		void Resize(int count);
+		int Count()const { return mCount; }
+
+		void Set(int id, const float center[3], const float extents[3]);
+		void Set(int id, const Aabb& box);
+
+		const float* CenterX()const { return mCenterX.data(); }
+		const float* CenterY()const { return mCenterY.data(); }
+		const float* CenterZ()const { return mCenterZ.data(); }
+		const float* ExtentX()const { return mExtentX.data(); }
+		const float* ExtentY()const { return mExtentY.data(); }
+		const float* ExtentZ()const { return mExtentZ.data(); }
+
+	private:
+		int mCount = 0;
+		std::vector<float> mCenterX, mCenterY, mCenterZ;
+		std::vector<float> mExtentX, mExtentY, mExtentZ;
+	};
+
+	// Number of 32-bit words in a visibility mask for count boxes.
+	inline int MaskWordCount(int count)
+	{
+		return (count + 31) / 32;
+	}
+
+	inline bool IsVisible(const std::uint32_t* mask, int id)
+	{
+		return ((mask[id >> 5] >> (id & 31)) & 1) != 0;
+	}
+
+	// Sets bit id of mask (MaskWordCount words) when box id is at least partly inside
+	// frustum, and clears it otherwise.  A box is culled when it lies entirely on the
+	// outer side of any plane.
+	typedef void (*FrustumFn)(const FrustumPlanes& frustum, const BoxSoA& boxes, std::uint32_t* mask);
+
+	struct KernelSet
+	{
+		const char* Name;
+		int Width; // boxes per instruction
+		FrustumFn Frustum;
+	};
+
+	const KernelSet& Scalar();
+
+	// Returns nullptr when the CPU (or target) does not support the instruction set.
+	const KernelSet* Sse();
+	const KernelSet* Avx();
+
+	// Widest supported kernel set.
+	const KernelSet& Best();
+}
+
+#endif // CULLKERNELS_H
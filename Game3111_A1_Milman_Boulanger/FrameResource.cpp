@@ -1,6 +1,7 @@
 #include "FrameResource.h"
 
-FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount, UINT waveVertCount)
+FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount,
+    UINT instanceCount, const std::vector<UINT>& waveVertCounts)
 {
     ThrowIfFailed(device->CreateCommandAllocator(
         D3D12_COMMAND_LIST_TYPE_DIRECT,
@@ -10,8 +11,10 @@ FrameResource::FrameResource(ID3D12Device* device, UINT passCount, UINT objectCo
     PassCB = std::make_unique<UploadBuffer<PassConstants>>(device, passCount, true);
     MaterialCB = std::make_unique<UploadBuffer<MaterialConstants>>(device, materialCount, true);
     ObjectCB = std::make_unique<UploadBuffer<ObjectConstants>>(device, objectCount, true);
+    InstanceBuffer = std::make_unique<UploadBuffer<ObjectConstants>>(device, instanceCount, false);
 
-	WavesVB = std::make_unique<UploadBuffer<Vertex>>(device, waveVertCount, false);
+	for(UINT waveVertCount : waveVertCounts)
+		WavesVB.push_back(std::make_unique<UploadBuffer<Vertex>>(device, waveVertCount, false));
 }
 
 FrameResource::~FrameResource()
@@ -5,6 +5,7 @@
 #include "UploadBuffer.h"
 
 
+// Also the element type of FrameResource::InstanceBuffer (gInstanceData in color.hlsl).
 struct ObjectConstants
 {
     DirectX::XMFLOAT4X4 World = MathHelper::Identity4x4();
@@ -51,7 +52,8 @@ struct FrameResource
 {
 public:
 
-    FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount, UINT waveVertCount);
+    FrameResource(ID3D12Device* device, UINT passCount, UINT objectCount, UINT materialCount,
+        UINT instanceCount, const std::vector<UINT>& waveVertCounts);
     FrameResource(const FrameResource& rhs) = delete;
     FrameResource& operator=(const FrameResource& rhs) = delete;
     ~FrameResource();
@@ -67,7 +69,11 @@ public:
     std::unique_ptr<UploadBuffer<MaterialConstants>> MaterialCB = nullptr;
     std::unique_ptr<UploadBuffer<ObjectConstants>> ObjectCB = nullptr;
 
-    std::unique_ptr<UploadBuffer<Vertex>> WavesVB = nullptr;
+    // Per-instance constants of this frame's instanced draws, rewritten every frame.
+    std::unique_ptr<UploadBuffer<ObjectConstants>> InstanceBuffer = nullptr;
+
+    // One dynamic vertex buffer per wave surface.
+    std::vector<std::unique_ptr<UploadBuffer<Vertex>>> WavesVB;
 	
     // Fence value to mark commands up to this fence point.  This lets us
     // check if these frame resources are still in use by the GPU.
@@ -4,6 +4,7 @@
 
 #include "GeometryGenerator.h"
 #include <algorithm>
+#include <unordered_map>
 
 using namespace DirectX;
 
@@ -388,13 +389,6 @@ GeometryGenerator::MeshData GeometryGenerator::CreateSphere(float radius, uint32
  
 void GeometryGenerator::Subdivide(MeshData& meshData)
 {
-	// Save a copy of the input geometry.
-	MeshData inputCopy = meshData;
-
-
-	meshData.Vertices.resize(0);
-	meshData.Indices32.resize(0);
-
 	//       v1
 	//       *
 	//      / \
@@ -405,48 +399,212 @@ void GeometryGenerator::Subdivide(MeshData& meshData)
 	// *-----*-----*
 	// v0    m2     v2
 
-	uint32 numTris = (uint32)inputCopy.Indices32.size()/3;
+	// The input vertices keep their indices and each edge's midpoint is appended once,
+	// shared by the triangles on both sides of the edge, so a welded mesh stays welded
+	// (V + E vertices instead of 6T).  Edges are keyed by their sorted vertex indices,
+	// so vertices duplicated along a seam still get separate midpoints.
+	std::vector<uint32> inputIndices;
+	inputIndices.swap(meshData.Indices32);
+
+	uint32 numTris = (uint32)inputIndices.size()/3;
+
+	// A closed mesh has 3T/2 edges; open boundaries add a few more.
+	std::unordered_map<std::uint64_t, uint32> midpoints;
+	midpoints.reserve(numTris*2);
+	meshData.Vertices.reserve(meshData.Vertices.size() + numTris*2);
+
+	auto midpoint = [&](uint32 a, uint32 b)
+	{
+		std::uint64_t key = a < b ? ((std::uint64_t)a << 32 | b) : ((std::uint64_t)b << 32 | a);
+		auto it = midpoints.find(key);
+		if(it != midpoints.end())
+			return it->second;
+
+		// Not a reference into Vertices: push_back may reallocate.
+		Vertex m = MidPoint(meshData.Vertices[a], meshData.Vertices[b]);
+		uint32 index = (uint32)meshData.Vertices.size();
+		meshData.Vertices.push_back(m);
+		midpoints.emplace(key, index);
+		return index;
+	};
+
+	meshData.Indices32.reserve(numTris*12);
 	for(uint32 i = 0; i < numTris; ++i)
 	{
-		Vertex v0 = inputCopy.Vertices[ inputCopy.Indices32[i*3+0] ];
-		Vertex v1 = inputCopy.Vertices[ inputCopy.Indices32[i*3+1] ];
-		Vertex v2 = inputCopy.Vertices[ inputCopy.Indices32[i*3+2] ];
+		uint32 v0 = inputIndices[i*3+0];
+		uint32 v1 = inputIndices[i*3+1];
+		uint32 v2 = inputIndices[i*3+2];
 
 		//
 		// Generate the midpoints.
 		//
 
-        Vertex m0 = MidPoint(v0, v1);
-        Vertex m1 = MidPoint(v1, v2);
-        Vertex m2 = MidPoint(v0, v2);
+		uint32 m0 = midpoint(v0, v1);
+		uint32 m1 = midpoint(v1, v2);
+		uint32 m2 = midpoint(v0, v2);
 
 		//
 		// Add new geometry.
 		//
 
-		meshData.Vertices.push_back(v0); // 0
-		meshData.Vertices.push_back(v1); // 1
-		meshData.Vertices.push_back(v2); // 2
-		meshData.Vertices.push_back(m0); // 3
-		meshData.Vertices.push_back(m1); // 4
-		meshData.Vertices.push_back(m2); // 5
- 
-		meshData.Indices32.push_back(i*6+0);
-		meshData.Indices32.push_back(i*6+3);
-		meshData.Indices32.push_back(i*6+5);
+		uint32 tris[12] =
+		{
+			v0, m0, m2,
+			m0, m1, m2,
+			m2, m1, v2,
+			m0, v1, m1
+		};
+		meshData.Indices32.insert(meshData.Indices32.end(), &tris[0], &tris[12]);
+	}
+}
+
+void GeometryGenerator::Optimize(MeshData& meshData, float weldTolerance, OptimizeStats* stats)
+{
+	static_assert(sizeof(Vertex) == 11*sizeof(float), "Vertex must be tightly packed floats");
+
+	const std::vector<Vertex>& vertices = meshData.Vertices;
+	std::vector<uint32> indices = meshData.Indices32;
+	if(vertices.empty())
+		return;
+
+	if(stats != nullptr)
+	{
+		stats->VerticesBefore = (uint32)vertices.size();
+		stats->CacheBefore = MeshOptimizer::AnalyzeVertexCache(indices.data(), indices.size(), vertices.size());
+	}
+
+	std::vector<uint32> weldRemap;
+	size_t weldedCount = MeshOptimizer::WeldVertices(&vertices[0].Position.x, vertices.size(),
+		(int)(sizeof(Vertex)/sizeof(float)), weldTolerance, weldRemap);
+	MeshOptimizer::RemapIndices(indices.data(), indices.size(), weldRemap);
+	indices.resize(MeshOptimizer::RemoveDegenerateTriangles(indices.data(), indices.size()));
+
+	MeshOptimizer::OptimizeVertexCache(indices.data(), indices.size(), weldedCount);
+
+	std::vector<uint32> fetchRemap;
+	size_t usedCount = MeshOptimizer::OptimizeVertexFetch(indices.data(), indices.size(), weldedCount, fetchRemap);
+	MeshOptimizer::RemapIndices(indices.data(), indices.size(), fetchRemap);
+
+	// Walk backwards so each welded vertex keeps the attributes of its first occurrence.
+	MeshData result;
+	result.Vertices.resize(usedCount);
+	for(size_t i = vertices.size(); i-- > 0; )
+	{
+		uint32 v = fetchRemap[weldRemap[i]];
+		if(v != MeshOptimizer::Unused)
+			result.Vertices[v] = vertices[i];
+	}
+	result.Indices32.swap(indices);
+
+	if(stats != nullptr)
+	{
+		stats->VerticesAfter = (uint32)result.Vertices.size();
+		stats->CacheAfter = MeshOptimizer::AnalyzeVertexCache(result.Indices32.data(), result.Indices32.size(), result.Vertices.size());
+	}
 
-		meshData.Indices32.push_back(i*6+3);
-		meshData.Indices32.push_back(i*6+4);
-		meshData.Indices32.push_back(i*6+5);
+	// Assigning a fresh MeshData also drops any 16-bit index copy made before.
+	meshData = std::move(result);
+}
+
+GeometryGenerator::MeshData GeometryGenerator::Simplify(const MeshData& meshData, float targetRatio, float maxError)
+{
+	MeshData result;
+	const std::vector<uint32>& indices = meshData.Indices32;
+	if(indices.empty())
+		return result;
+
+	size_t targetIndexCount = (size_t)(indices.size()/3 * targetRatio) * 3;
+
+	result.Indices32.resize(indices.size());
+	size_t count = MeshOptimizer::Simplify(result.Indices32.data(), indices.data(), indices.size(),
+		&meshData.Vertices[0].Position.x, meshData.Vertices.size(), (int)(sizeof(Vertex)/sizeof(float)),
+		targetIndexCount, maxError);
+	result.Indices32.resize(count);
+	result.Vertices = meshData.Vertices;
+
+	// Drops the collapsed vertices and restores the cache order the collapses disturbed.
+	Optimize(result);
+	return result;
+}
+
+// Tessellation count of the next coarser level of detail.
+static GeometryGenerator::uint32 CoarserCount(GeometryGenerator::uint32 count, GeometryGenerator::uint32 minimum)
+{
+	GeometryGenerator::uint32 coarser = (count + 1) / 2;
+	return coarser > minimum ? coarser : minimum;
+}
+
+GeometryGenerator::LodChain GeometryGenerator::CreateSphereLods(float radius, uint32 sliceCount, uint32 stackCount, uint32 levelCount)
+{
+	LodChain chain;
+	for(uint32 level = 0; level < levelCount; ++level)
+	{
+		chain.push_back(CreateSphere(radius, sliceCount, stackCount));
+
+		uint32 slices = CoarserCount(sliceCount, 3);
+		uint32 stacks = CoarserCount(stackCount, 2);
+		if(slices == sliceCount && stacks == stackCount)
+			break;
+		sliceCount = slices;
+		stackCount = stacks;
+	}
+	return chain;
+}
+
+GeometryGenerator::LodChain GeometryGenerator::CreateCylinderLods(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, uint32 levelCount)
+{
+	LodChain chain;
+	for(uint32 level = 0; level < levelCount; ++level)
+	{
+		chain.push_back(CreateCylinder(bottomRadius, topRadius, height, sliceCount, stackCount));
+
+		uint32 slices = CoarserCount(sliceCount, 3);
+		uint32 stacks = CoarserCount(stackCount, 1);
+		if(slices == sliceCount && stacks == stackCount)
+			break;
+		sliceCount = slices;
+		stackCount = stacks;
+	}
+	return chain;
+}
+
+GeometryGenerator::LodChain GeometryGenerator::CreateConeLods(float bottomRadius, float height, uint32 sliceCount, uint32 stackCount, uint32 levelCount)
+{
+	return CreateCylinderLods(bottomRadius, 0.0f, height, sliceCount, stackCount, levelCount);
+}
 
-		meshData.Indices32.push_back(i*6+5);
-		meshData.Indices32.push_back(i*6+4);
-		meshData.Indices32.push_back(i*6+2);
+GeometryGenerator::LodChain GeometryGenerator::CreateTorusLods(float tubeRadius, float ringRadius, uint32 sliceCount, uint32 stackCount, uint32 levelCount)
+{
+	LodChain chain;
+	for(uint32 level = 0; level < levelCount; ++level)
+	{
+		chain.push_back(CreateTorus(tubeRadius, ringRadius, sliceCount, stackCount));
+
+		uint32 slices = CoarserCount(sliceCount, 3);
+		uint32 stacks = CoarserCount(stackCount, 3);
+		if(slices == sliceCount && stacks == stackCount)
+			break;
+		sliceCount = slices;
+		stackCount = stacks;
+	}
+	return chain;
+}
 
-		meshData.Indices32.push_back(i*6+3);
-		meshData.Indices32.push_back(i*6+1);
-		meshData.Indices32.push_back(i*6+4);
+GeometryGenerator::LodChain GeometryGenerator::SimplifyLods(const MeshData& meshData, uint32 levelCount, float maxError)
+{
+	LodChain chain;
+	if(levelCount == 0)
+		return chain;
+
+	chain.push_back(meshData);
+	for(uint32 level = 1; level < levelCount; ++level)
+	{
+		MeshData coarser = Simplify(chain.back(), 0.25f, maxError);
+		if(coarser.Indices32.empty() || coarser.Indices32.size() >= chain.back().Indices32.size())
+			break;
+		chain.push_back(std::move(coarser));
 	}
+	return chain;
 }
 
 GeometryGenerator::MeshData GeometryGenerator::CreateTriangularPrism(float baseWidth, float height, float depth)
@@ -17,6 +17,7 @@
 #include <cstdint>
 #include <DirectXMath.h>
 #include <vector>
+#include "MeshOptimizer.h"
 
 class GeometryGenerator
 {
@@ -131,6 +132,11 @@ public:
 	/// Creates a quad aligned with the screen.  This is useful for postprocessing and screen effects.
 	///</summary>
     MeshData CreateQuad(float x, float y, float w, float h, float depth);
+
+	///<summary>
+	/// Splits every triangle into four at its edge midpoints.  Vertices are kept and
+	/// midpoints are shared between triangles with a common edge.
+	///</summary>
 	void Subdivide(MeshData& meshData);
 
 	///<summary>
@@ -140,6 +146,51 @@ public:
 
 	MeshData CreatePyramid(float baseWidth, float height, float depth);
 
+	struct OptimizeStats
+	{
+		uint32 VerticesBefore = 0;
+		uint32 VerticesAfter = 0;
+		MeshOptimizer::VertexCacheStats CacheBefore;
+		MeshOptimizer::VertexCacheStats CacheAfter;
+	};
+
+	///<summary>
+	/// Welds vertices whose attributes agree within weldTolerance, drops the triangles
+	/// that collapse, orders the triangles for the post-transform vertex cache and the
+	/// vertices by first use.  The triangles drawn are unchanged.
+	///</summary>
+	void Optimize(MeshData& meshData, float weldTolerance = 1e-5f, OptimizeStats* stats = nullptr);
+
+	///<summary>
+	/// Levels of detail of one shape, finest first.  Each level has about a quarter
+	/// of the triangles of the one before.
+	///</summary>
+	using LodChain = std::vector<MeshData>;
+
+	///<summary>
+	/// Re-tessellate the shape with the slice and stack counts halved per level, down
+	/// to the smallest counts that still make the shape.  The chain stops early when
+	/// the counts cannot be reduced any further.
+	///</summary>
+	LodChain CreateSphereLods(float radius, uint32 sliceCount, uint32 stackCount, uint32 levelCount);
+	LodChain CreateCylinderLods(float bottomRadius, float topRadius, float height, uint32 sliceCount, uint32 stackCount, uint32 levelCount);
+	LodChain CreateConeLods(float bottomRadius, float height, uint32 sliceCount, uint32 stackCount, uint32 levelCount);
+	LodChain CreateTorusLods(float tubeRadius, float ringRadius, uint32 sliceCount, uint32 stackCount, uint32 levelCount);
+
+	///<summary>
+	/// Builds the chain of an arbitrary optimized mesh with Simplify, for meshes with
+	/// no parameters to re-tessellate by.  Level 0 is a copy of meshData.  The chain
+	/// stops early once maxError keeps a level from getting any smaller.
+	///</summary>
+	LodChain SimplifyLods(const MeshData& meshData, uint32 levelCount, float maxError);
+
+	///<summary>
+	/// Returns a copy of an optimized mesh with about targetRatio of its triangles,
+	/// removed by quadric error edge collapses that move the surface by at most maxError.
+	/// The result is optimized and only keeps the vertices it uses.
+	///</summary>
+	MeshData Simplify(const MeshData& meshData, float targetRatio, float maxError);
+
 private:
 	DirectX::XMFLOAT3 getNormal(DirectX::XMFLOAT3 p0, DirectX::XMFLOAT3 p1, DirectX::XMFLOAT3 p2);
 
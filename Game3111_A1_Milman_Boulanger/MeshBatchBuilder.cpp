@@ -0,0 +1,72 @@
+//***************************************************************************************
+// MeshBatchBuilder.cpp
+//***************************************************************************************
+
+#include "MeshBatchBuilder.h"
+#include "TaskScheduler.h"
+
+using namespace DirectX;
+
+void MeshBatchBuilder::Add(const std::string& name, const GeometryGenerator::MeshData& meshData)
+{
+	assert(meshData.Vertices.size() <= 0x10000);
+
+	Entry entry;
+	entry.Name = name;
+	entry.Mesh = &meshData;
+	entry.Submesh.IndexCount = (UINT)meshData.Indices32.size();
+	entry.Submesh.StartIndexLocation = mIndexCount;
+	entry.Submesh.BaseVertexLocation = (INT)mVertexCount;
+	mEntries.push_back(entry);
+
+	mVertexCount += (UINT)meshData.Vertices.size();
+	mIndexCount += (UINT)meshData.Indices32.size();
+}
+
+void MeshBatchBuilder::Build(std::vector<Vertex>& vertices, std::vector<std::uint16_t>& indices,
+	std::unordered_map<std::string, SubmeshGeometry>& drawArgs, TaskScheduler* scheduler)const
+{
+	vertices.resize(mVertexCount);
+	indices.resize(mIndexCount);
+
+	std::vector<BoundingBox> bounds(mEntries.size());
+
+	if(scheduler == nullptr)
+		scheduler = &TaskScheduler::Default();
+
+	// The meshes write disjoint ranges, so they can be copied in any order.
+	scheduler->ParallelFor(0, (int)mEntries.size(), [&](int e)
+	{
+		const Entry& entry = mEntries[e];
+		const GeometryGenerator::MeshData& mesh = *entry.Mesh;
+
+		// Keep only the attributes Vertex has, and grow the bounds on the way.
+		Vertex* dst = vertices.data() + entry.Submesh.BaseVertexLocation;
+		XMVECTOR vMin = XMVectorReplicate(MathHelper::Infinity);
+		XMVECTOR vMax = XMVectorReplicate(-MathHelper::Infinity);
+		for(const GeometryGenerator::Vertex& v : mesh.Vertices)
+		{
+			dst->Pos = v.Position;
+			dst->Normal = v.Normal;
+			dst->TexC = v.TexC;
+			++dst;
+
+			XMVECTOR p = XMLoadFloat3(&v.Position);
+			vMin = XMVectorMin(vMin, p);
+			vMax = XMVectorMax(vMax, p);
+		}
+		if(!mesh.Vertices.empty())
+			BoundingBox::CreateFromPoints(bounds[e], vMin, vMax);
+
+		std::uint16_t* dstIndex = indices.data() + entry.Submesh.StartIndexLocation;
+		for(std::uint32_t index : mesh.Indices32)
+			*dstIndex++ = (std::uint16_t)index;
+	});
+
+	for(size_t e = 0; e < mEntries.size(); ++e)
+	{
+		SubmeshGeometry submesh = mEntries[e].Submesh;
+		submesh.Bounds = bounds[e];
+		drawArgs[mEntries[e].Name] = submesh;
+	}
+}
@@ -0,0 +1,50 @@
+//***************************************************************************************
+// MeshBatchBuilder.h
+//
+// Concatenates named GeometryGenerator meshes into one Vertex buffer and one 16-bit
+// index buffer.  Add assigns each mesh its vertex and index ranges in call order;
+// Build fills both buffers, each mesh in a single pass over its ranges with the meshes
+// spread over a TaskScheduler, and returns the DrawArgs with their bounds.  Adding a
+// mesh to a MeshGeometry is then one Add call.
+//***************************************************************************************
+
+#pragma once
+
+#include "d3dUtil.h"
+#include "FrameResource.h"
+#include "GeometryGenerator.h"
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+class TaskScheduler;
+
+class MeshBatchBuilder
+{
+public:
+	// meshData is read by Build, so it must outlive that call.  Indices are stored
+	// relative to the mesh's BaseVertexLocation, so each mesh may have up to 65536
+	// vertices.
+	void Add(const std::string& name, const GeometryGenerator::MeshData& meshData);
+
+	UINT VertexCount()const { return mVertexCount; }
+	UINT IndexCount()const { return mIndexCount; }
+
+	// Resizes vertices and indices to the totals and fills them.  drawArgs receives
+	// a SubmeshGeometry per mesh, Bounds being the box of the mesh's vertices.
+	// nullptr uses TaskScheduler::Default().
+	void Build(std::vector<Vertex>& vertices, std::vector<std::uint16_t>& indices,
+		std::unordered_map<std::string, SubmeshGeometry>& drawArgs, TaskScheduler* scheduler = nullptr)const;
+
+private:
+	struct Entry
+	{
+		std::string Name;
+		const GeometryGenerator::MeshData* Mesh = nullptr;
+		SubmeshGeometry Submesh;
+	};
+
+	std::vector<Entry> mEntries;
+	UINT mVertexCount = 0;
+	UINT mIndexCount = 0;
+};
@@ -0,0 +1,662 @@
+//***************************************************************************************
+// MeshOptimizer.cpp
+//***************************************************************************************
+
+#include "MeshOptimizer.h"
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <queue>
+#include <utility>
+
+namespace
+{
+	// Vertices whose positions differ by no more than this in every coordinate are the
+	// same point of the surface, on two sides of an attribute seam.
+	const float SeamTolerance = 1e-5f;
+
+	std::uint32_t HashCell(std::int32_t x, std::int32_t y, std::int32_t z)
+	{
+		return (std::uint32_t)x*73856093u ^ (std::uint32_t)y*19349663u ^ (std::uint32_t)z*83492791u;
+	}
+
+	bool WithinTolerance(const float* a, const float* b, int count, float tolerance)
+	{
+		for(int k = 0; k < count; ++k)
+		{
+			if(!(std::fabs(a[k] - b[k]) <= tolerance))
+				return false;
+		}
+		return true;
+	}
+
+	void Cross(const double a[3], const double b[3], double out[3])
+	{
+		out[0] = a[1]*b[2] - a[2]*b[1];
+		out[1] = a[2]*b[0] - a[0]*b[2];
+		out[2] = a[0]*b[1] - a[1]*b[0];
+	}
+
+	double Dot(const double a[3], const double b[3])
+	{
+		return a[0]*b[0] + a[1]*b[1] + a[2]*b[2];
+	}
+
+	// Unnormalized normal of the triangle p0 p1 p2.
+	void TriangleNormal(const float* p0, const float* p1, const float* p2, double out[3])
+	{
+		double e1[3] = { (double)p1[0] - p0[0], (double)p1[1] - p0[1], (double)p1[2] - p0[2] };
+		double e2[3] = { (double)p2[0] - p0[0], (double)p2[1] - p0[1], (double)p2[2] - p0[2] };
+		Cross(e1, e2, out);
+	}
+
+	// Sum of the squared distance functions of a set of planes, stored as the upper
+	// triangle of a symmetric 4x4 matrix.
+	struct Quadric
+	{
+		double A00 = 0.0, A01 = 0.0, A02 = 0.0, A11 = 0.0, A12 = 0.0, A22 = 0.0;
+		double B0 = 0.0, B1 = 0.0, B2 = 0.0;
+		double C = 0.0;
+
+		// n must be unit length; the plane is n.p + d = 0.
+		void AddPlane(const double n[3], double d)
+		{
+			A00 += n[0]*n[0]; A01 += n[0]*n[1]; A02 += n[0]*n[2];
+			A11 += n[1]*n[1]; A12 += n[1]*n[2]; A22 += n[2]*n[2];
+			B0 += n[0]*d; B1 += n[1]*d; B2 += n[2]*d;
+			C += d*d;
+		}
+
+		void Add(const Quadric& q)
+		{
+			A00 += q.A00; A01 += q.A01; A02 += q.A02;
+			A11 += q.A11; A12 += q.A12; A22 += q.A22;
+			B0 += q.B0; B1 += q.B1; B2 += q.B2;
+			C += q.C;
+		}
+
+		double Evaluate(const float* p)const
+		{
+			double x = p[0], y = p[1], z = p[2];
+			double r = A00*x*x + A11*y*y + A22*z*z + 2.0*(A01*x*y + A02*x*z + A12*y*z) +
+				2.0*(B0*x + B1*y + B2*z) + C;
+			return r > 0.0 ? r : 0.0;
+		}
+	};
+
+	// Candidate collapse of From into To.  It is stale once either vertex has changed.
+	struct Collapse
+	{
+		double Cost;
+		std::uint32_t From;
+		std::uint32_t To;
+		std::uint32_t FromVersion;
+		std::uint32_t ToVersion;
+
+		bool operator>(const Collapse& rhs)const { return Cost > rhs.Cost; }
+	};
+}
+
+namespace MeshOptimizer
+{
+	VertexCacheStats AnalyzeVertexCache(const std::uint32_t* indices, std::size_t indexCount,
+		std::size_t vertexCount, int cacheSize)
+	{
+		VertexCacheStats stats;
+		if(indexCount < 3)
+			return stats;
+
+		// cachedAt[v] is the miss count when v entered the cache; v is still cached while
+		// fewer than cacheSize misses have happened since.
+		std::vector<std::size_t> cachedAt(vertexCount, 0);
+		std::vector<bool> referenced(vertexCount, false);
+		std::size_t misses = 0;
+		std::size_t uniqueCount = 0;
+		for(std::size_t i = 0; i < indexCount; ++i)
+		{
+			std::uint32_t v = indices[i];
+			if(!referenced[v])
+			{
+				referenced[v] = true;
+				++uniqueCount;
+			}
+			else if(misses - cachedAt[v] < (std::size_t)cacheSize)
+			{
+				continue;
+			}
+
+			++misses;
+			cachedAt[v] = misses;
+		}
+
+		stats.Acmr = (float)misses / (float)(indexCount / 3);
+		stats.Atvr = (float)misses / (float)uniqueCount;
+		return stats;
+	}
+
+	std::size_t WeldVertices(const float* vertices, std::size_t vertexCount, int floatsPerVertex,
+		float tolerance, std::vector<std::uint32_t>& remap)
+	{
+		remap.resize(vertexCount);
+
+		// Unique vertices are chained by the hash of their position's grid cell.  Cells
+		// are at least tolerance wide, so a match lies in the vertex's cell or one of its
+		// 26 neighbours.
+		const float cellSize = std::max(tolerance, 1e-6f);
+		const float invCellSize = 1.0f / cellSize;
+
+		std::size_t bucketCount = 1;
+		while(bucketCount < 2*vertexCount)
+			bucketCount *= 2;
+		const std::uint32_t bucketMask = (std::uint32_t)(bucketCount - 1);
+
+		std::vector<std::uint32_t> head(bucketCount, Unused);
+		std::vector<std::uint32_t> next;
+		std::vector<std::uint32_t> uniqueSource;
+		next.reserve(vertexCount);
+		uniqueSource.reserve(vertexCount);
+
+		for(std::size_t i = 0; i < vertexCount; ++i)
+		{
+			const float* v = vertices + i*floatsPerVertex;
+			std::int32_t cell[3];
+			for(int a = 0; a < 3; ++a)
+				cell[a] = (std::int32_t)std::floor(v[a] * invCellSize);
+
+			std::uint32_t match = Unused;
+			for(int dz = -1; dz <= 1 && match == Unused; ++dz)
+			{
+				for(int dy = -1; dy <= 1 && match == Unused; ++dy)
+				{
+					for(int dx = -1; dx <= 1 && match == Unused; ++dx)
+					{
+						std::uint32_t bucket = HashCell(cell[0] + dx, cell[1] + dy, cell[2] + dz) & bucketMask;
+						for(std::uint32_t u = head[bucket]; u != Unused; u = next[u])
+						{
+							if(WithinTolerance(v, vertices + uniqueSource[u]*floatsPerVertex, floatsPerVertex, tolerance))
+							{
+								match = u;
+								break;
+							}
+						}
+					}
+				}
+			}
+
+			if(match == Unused)
+			{
+				match = (std::uint32_t)uniqueSource.size();
+				std::uint32_t bucket = HashCell(cell[0], cell[1], cell[2]) & bucketMask;
+				uniqueSource.push_back((std::uint32_t)i);
+				next.push_back(head[bucket]);
+				head[bucket] = match;
+			}
+			remap[i] = match;
+		}
+
+		return uniqueSource.size();
+	}
+
+	void RemapIndices(std::uint32_t* indices, std::size_t indexCount, const std::vector<std::uint32_t>& remap)
+	{
+		for(std::size_t i = 0; i < indexCount; ++i)
+			indices[i] = remap[indices[i]];
+	}
+
+	std::size_t RemoveDegenerateTriangles(std::uint32_t* indices, std::size_t indexCount)
+	{
+		std::size_t kept = 0;
+		for(std::size_t i = 0; i + 2 < indexCount; i += 3)
+		{
+			std::uint32_t a = indices[i];
+			std::uint32_t b = indices[i + 1];
+			std::uint32_t c = indices[i + 2];
+			if(a == b || b == c || a == c)
+				continue;
+
+			indices[kept++] = a;
+			indices[kept++] = b;
+			indices[kept++] = c;
+		}
+		return kept;
+	}
+
+	void OptimizeVertexCache(std::uint32_t* indices, std::size_t indexCount, std::size_t vertexCount,
+		int cacheSize)
+	{
+		const std::size_t triCount = indexCount / 3;
+		if(triCount < 2)
+			return;
+
+		// Triangles around each vertex, and how many of them are not emitted yet.
+		std::vector<std::uint32_t> adjStart(vertexCount + 1, 0);
+		for(std::size_t i = 0; i < 3*triCount; ++i)
+			++adjStart[indices[i] + 1];
+		for(std::size_t v = 0; v < vertexCount; ++v)
+			adjStart[v + 1] += adjStart[v];
+
+		std::vector<std::uint32_t> adjacency(3*triCount);
+		std::vector<std::uint32_t> fill(adjStart.begin(), adjStart.end() - 1);
+		for(std::size_t i = 0; i < 3*triCount; ++i)
+			adjacency[fill[indices[i]]++] = (std::uint32_t)(i / 3);
+
+		std::vector<int> live(vertexCount);
+		for(std::size_t v = 0; v < vertexCount; ++v)
+			live[v] = (int)(adjStart[v + 1] - adjStart[v]);
+
+		// timestamp[v] is the time v was last transformed; v is in the cache while
+		// time - timestamp[v] <= cacheSize.
+		std::vector<int> timestamp(vertexCount, 0);
+		std::vector<bool> emitted(triCount, false);
+		std::vector<std::uint32_t> deadEnd;
+		std::vector<std::uint32_t> candidates;
+		std::vector<std::uint32_t> output;
+		output.reserve(3*triCount);
+
+		int time = cacheSize + 1;
+		std::size_t cursor = 0;
+		std::int64_t fan = 0;
+		while(fan >= 0)
+		{
+			// Emit every remaining triangle around the fanning vertex.
+			candidates.clear();
+			for(std::uint32_t k = adjStart[fan]; k < adjStart[fan + 1]; ++k)
+			{
+				std::uint32_t t = adjacency[k];
+				if(emitted[t])
+					continue;
+
+				for(int c = 0; c < 3; ++c)
+				{
+					std::uint32_t v = indices[3*t + c];
+					output.push_back(v);
+					deadEnd.push_back(v);
+					candidates.push_back(v);
+					--live[v];
+					if(time - timestamp[v] > cacheSize)
+						timestamp[v] = time++;
+				}
+				emitted[t] = true;
+			}
+
+			// Next fan: the candidate that has been in the cache longest and will still be
+			// there after its remaining triangles are emitted.
+			fan = -1;
+			int bestPriority = -1;
+			for(std::uint32_t v : candidates)
+			{
+				if(live[v] <= 0)
+					continue;
+
+				int priority = 0;
+				if(time - timestamp[v] + 2*live[v] <= cacheSize)
+					priority = time - timestamp[v];
+				if(priority > bestPriority)
+				{
+					bestPriority = priority;
+					fan = v;
+				}
+			}
+
+			// Dead end: back up to a recently used vertex with triangles left, or scan on.
+			while(fan < 0 && !deadEnd.empty())
+			{
+				std::uint32_t v = deadEnd.back();
+				deadEnd.pop_back();
+				if(live[v] > 0)
+					fan = v;
+			}
+			while(fan < 0 && cursor < vertexCount)
+			{
+				if(live[cursor] > 0)
+					fan = (std::int64_t)cursor;
+				++cursor;
+			}
+		}
+
+		std::copy(output.begin(), output.end(), indices);
+	}
+
+	std::size_t Simplify(std::uint32_t* destination, const std::uint32_t* indices, std::size_t indexCount,
+		const float* vertices, std::size_t vertexCount, int floatsPerVertex,
+		std::size_t targetIndexCount, float maxError)
+	{
+		const std::size_t triCount = indexCount / 3;
+		std::vector<std::uint32_t> tris(indices, indices + 3*triCount);
+		std::vector<bool> triAlive(triCount, true);
+
+		std::vector<std::vector<std::uint32_t>> vertexTris(vertexCount);
+		for(std::size_t i = 0; i < 3*triCount; ++i)
+			vertexTris[tris[i]].push_back((std::uint32_t)(i / 3));
+
+		auto position = [&](std::uint32_t v) { return vertices + v*floatsPerVertex; };
+
+		auto hasVertex = [&](std::uint32_t t, std::uint32_t v)
+		{
+			return tris[3*t] == v || tris[3*t + 1] == v || tris[3*t + 2] == v;
+		};
+
+		// Live triangles using the edge a-b.
+		auto edgeTriangleCount = [&](std::uint32_t a, std::uint32_t b)
+		{
+			int count = 0;
+			for(std::uint32_t t : vertexTris[a])
+			{
+				if(triAlive[t] && hasVertex(t, b))
+					++count;
+			}
+			return count;
+		};
+
+		auto neighbours = [&](std::uint32_t v, std::vector<std::uint32_t>& out)
+		{
+			out.clear();
+			for(std::uint32_t t : vertexTris[v])
+			{
+				if(!triAlive[t])
+					continue;
+				for(int c = 0; c < 3; ++c)
+				{
+					if(tris[3*t + c] != v)
+						out.push_back(tris[3*t + c]);
+				}
+			}
+			std::sort(out.begin(), out.end());
+			out.erase(std::unique(out.begin(), out.end()), out.end());
+		};
+
+		// Every vertex starts with the planes of its triangles.  Border edges add a plane
+		// through the edge perpendicular to the triangle, so moving a border vertex off
+		// its border costs as much as moving it off the surface.
+		std::vector<Quadric> quadrics(vertexCount);
+		std::vector<bool> border(vertexCount, false);
+		for(std::size_t t = 0; t < triCount; ++t)
+		{
+			const std::uint32_t* tri = &tris[3*t];
+			double n[3];
+			TriangleNormal(position(tri[0]), position(tri[1]), position(tri[2]), n);
+			double length = std::sqrt(Dot(n, n));
+			if(length == 0.0)
+				continue;
+			for(int k = 0; k < 3; ++k)
+				n[k] /= length;
+
+			const float* p0 = position(tri[0]);
+			double d = -(n[0]*p0[0] + n[1]*p0[1] + n[2]*p0[2]);
+			for(int c = 0; c < 3; ++c)
+				quadrics[tri[c]].AddPlane(n, d);
+
+			for(int c = 0; c < 3; ++c)
+			{
+				std::uint32_t a = tri[c];
+				std::uint32_t b = tri[(c + 1) % 3];
+				if(edgeTriangleCount(a, b) != 1)
+					continue;
+
+				border[a] = true;
+				border[b] = true;
+
+				const float* pa = position(a);
+				const float* pb = position(b);
+				double e[3] = { (double)pb[0] - pa[0], (double)pb[1] - pa[1], (double)pb[2] - pa[2] };
+				double m[3];
+				Cross(e, n, m);
+				double mLength = std::sqrt(Dot(m, m));
+				if(mLength == 0.0)
+					continue;
+				for(int k = 0; k < 3; ++k)
+					m[k] /= mLength;
+
+				double md = -(m[0]*pa[0] + m[1]*pa[1] + m[2]*pa[2]);
+				quadrics[a].AddPlane(m, md);
+				quadrics[b].AddPlane(m, md);
+			}
+		}
+
+		// Vertices at the same position, the sides of an attribute seam, are chained in a
+		// ring by sibling; a vertex off any seam is its own sibling.
+		std::vector<std::uint32_t> sibling(vertexCount);
+		{
+			std::vector<float> positions(3*vertexCount);
+			for(std::size_t v = 0; v < vertexCount; ++v)
+				std::copy(position((std::uint32_t)v), position((std::uint32_t)v) + 3, &positions[3*v]);
+			std::vector<std::uint32_t> positionRemap;
+			std::size_t positionCount = WeldVertices(positions.data(), vertexCount, 3, SeamTolerance, positionRemap);
+
+			std::vector<std::uint32_t> first(positionCount, Unused);
+			std::vector<std::uint32_t> last(positionCount, Unused);
+			for(std::uint32_t v = 0; v < (std::uint32_t)vertexCount; ++v)
+			{
+				std::uint32_t p = positionRemap[v];
+				if(first[p] == Unused)
+					first[p] = v;
+				else
+					sibling[last[p]] = v;
+				last[p] = v;
+			}
+			for(std::size_t p = 0; p < positionCount; ++p)
+				sibling[last[p]] = first[p];
+		}
+
+		auto hasLiveTriangle = [&](std::uint32_t v)
+		{
+			for(std::uint32_t t : vertexTris[v])
+			{
+				if(triAlive[t])
+					return true;
+			}
+			return false;
+		};
+
+		// A seam vertex only moves together with its siblings, each into a sibling of to
+		// along an edge on its own side, so the sides of the seam keep meeting.  Fills
+		// plan with the collapses that make up from into to; false when a side has no
+		// such edge.
+		typedef std::vector<std::pair<std::uint32_t, std::uint32_t>> CollapsePlan;
+		auto planCollapse = [&](std::uint32_t from, std::uint32_t to, CollapsePlan& plan)
+		{
+			plan.clear();
+			plan.push_back(std::make_pair(from, to));
+			for(std::uint32_t s = sibling[from]; s != from; s = sibling[s])
+			{
+				if(!hasLiveTriangle(s))
+					continue;
+
+				std::uint32_t match = to;
+				while(edgeTriangleCount(s, match) == 0)
+				{
+					match = sibling[match];
+					if(match == to)
+						return false;
+				}
+				plan.push_back(std::make_pair(s, match));
+			}
+			return true;
+		};
+
+		std::vector<std::uint32_t> version(vertexCount, 0);
+		std::priority_queue<Collapse, std::vector<Collapse>, std::greater<Collapse>> heap;
+		CollapsePlan pushPlan;
+		auto push = [&](std::uint32_t from, std::uint32_t to)
+		{
+			if(!planCollapse(from, to, pushPlan))
+				return;
+
+			double cost = 0.0;
+			for(const auto& step : pushPlan)
+			{
+				Quadric q = quadrics[step.first];
+				q.Add(quadrics[step.second]);
+				cost += q.Evaluate(position(step.second));
+			}
+			Collapse c = { cost, from, to, version[from], version[to] };
+			heap.push(c);
+		};
+
+		for(std::size_t t = 0; t < triCount; ++t)
+		{
+			for(int c = 0; c < 3; ++c)
+			{
+				push(tris[3*t + c], tris[3*t + (c + 1) % 3]);
+				push(tris[3*t + (c + 1) % 3], tris[3*t + c]);
+			}
+		}
+
+		std::vector<std::uint32_t> ringFrom, ringTo;
+		auto canCollapse = [&](std::uint32_t from, std::uint32_t to)
+		{
+			int shared = edgeTriangleCount(from, to);
+			if(shared == 0)
+				return false;
+
+			// Border vertices may only slide along their border.
+			if(border[from] && shared != 1)
+				return false;
+
+			// Link condition: the only common neighbours are the vertices opposite the
+			// edge, otherwise the collapse pinches the surface.
+			neighbours(from, ringFrom);
+			neighbours(to, ringTo);
+			std::size_t common = 0;
+			for(std::size_t i = 0, j = 0; i < ringFrom.size() && j < ringTo.size(); )
+			{
+				if(ringFrom[i] < ringTo[j])
+					++i;
+				else if(ringTo[j] < ringFrom[i])
+					++j;
+				else
+				{
+					++common;
+					++i;
+					++j;
+				}
+			}
+			if(common != (std::size_t)shared)
+				return false;
+
+			// No remaining triangle may flip or become degenerate.
+			for(std::uint32_t t : vertexTris[from])
+			{
+				if(!triAlive[t] || hasVertex(t, to))
+					continue;
+
+				const float* p[3];
+				const float* q[3];
+				for(int c = 0; c < 3; ++c)
+				{
+					p[c] = position(tris[3*t + c]);
+					q[c] = tris[3*t + c] == from ? position(to) : p[c];
+				}
+
+				double before[3], after[3];
+				TriangleNormal(p[0], p[1], p[2], before);
+				TriangleNormal(q[0], q[1], q[2], after);
+				if(Dot(before, after) <= 0.0)
+					return false;
+			}
+			return true;
+		};
+
+		std::size_t liveIndexCount = 3*triCount;
+		auto collapse = [&](std::uint32_t from, std::uint32_t to)
+		{
+			quadrics[to].Add(quadrics[from]);
+
+			for(std::uint32_t t : vertexTris[from])
+			{
+				if(!triAlive[t])
+					continue;
+
+				if(hasVertex(t, to))
+				{
+					triAlive[t] = false;
+					liveIndexCount -= 3;
+					continue;
+				}
+
+				for(int k = 0; k < 3; ++k)
+				{
+					if(tris[3*t + k] == from)
+						tris[3*t + k] = to;
+				}
+				vertexTris[to].push_back(t);
+			}
+			vertexTris[from].clear();
+
+			std::vector<std::uint32_t>& toTris = vertexTris[to];
+			toTris.erase(std::remove_if(toTris.begin(), toTris.end(),
+				[&](std::uint32_t t) { return !triAlive[t]; }), toTris.end());
+
+			++version[from];
+		};
+
+		const double maxCost = (double)maxError*maxError;
+		CollapsePlan plan;
+		std::vector<std::uint32_t> ring;
+		while(liveIndexCount > targetIndexCount && !heap.empty())
+		{
+			Collapse c = heap.top();
+			heap.pop();
+			if(c.FromVersion != version[c.From] || c.ToVersion != version[c.To])
+				continue;
+
+			// Every live candidate left costs at least this much.
+			if(c.Cost > maxCost)
+				break;
+
+			if(!planCollapse(c.From, c.To, plan))
+				continue;
+
+			bool allowed = true;
+			for(const auto& step : plan)
+				allowed = allowed && canCollapse(step.first, step.second);
+			if(!allowed)
+				continue;
+
+			for(const auto& step : plan)
+				collapse(step.first, step.second);
+
+			// Every step collapsed into a sibling of c.To; collapses into or out of any of
+			// them now cost differently.
+			std::uint32_t v = c.To;
+			do
+			{
+				++version[v];
+				neighbours(v, ring);
+				for(std::uint32_t w : ring)
+				{
+					push(v, w);
+					push(w, v);
+				}
+				v = sibling[v];
+			} while(v != c.To);
+		}
+
+		std::size_t count = 0;
+		for(std::size_t t = 0; t < triCount; ++t)
+		{
+			if(!triAlive[t])
+				continue;
+
+			destination[count++] = tris[3*t];
+			destination[count++] = tris[3*t + 1];
+			destination[count++] = tris[3*t + 2];
+		}
+		return count;
+	}
+
+	std::size_t OptimizeVertexFetch(const std::uint32_t* indices, std::size_t indexCount,
+		std::size_t vertexCount, std::vector<std::uint32_t>& remap)
+	{
+		remap.assign(vertexCount, Unused);
+
+		std::uint32_t next = 0;
+		for(std::size_t i = 0; i < indexCount; ++i)
+		{
+			std::uint32_t v = indices[i];
+			if(remap[v] == Unused)
+				remap[v] = next++;
+		}
+		return next;
+	}
+}
@@ -0,0 +1,83 @@
+//***************************************************************************************
+// MeshOptimizer.h
+//
+// Index and vertex buffer optimizations run on generated meshes before upload:
+//   - WeldVertices merges vertices whose attributes agree within a tolerance,
+//   - OptimizeVertexCache reorders triangles for the post-transform vertex cache
+//     (Tipsify, Sander et al. 2007),
+//   - OptimizeVertexFetch renumbers vertices in order of first use so the vertex
+//     fetches walk the buffer forwards.
+//   - Simplify removes triangles by quadric error edge collapses, for LOD chains of
+//     meshes that cannot simply be re-tessellated.
+// AnalyzeVertexCache measures the result with a FIFO cache model.  Like Waves these
+// work on plain arrays without DirectXMath; GeometryGenerator::Optimize runs the whole
+// pipeline on a MeshData.
+//***************************************************************************************
+
+#ifndef MESHOPTIMIZER_H
+#define MESHOPTIMIZER_H
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace MeshOptimizer
+{
+	// Post-transform cache size assumed by default; current GPUs hold at least this many
+	// vertices.
+	const int DefaultCacheSize = 16;
+
+	// Index of vertices that no index references after OptimizeVertexFetch.
+	const std::uint32_t Unused = 0xffffffff;
+
+	struct VertexCacheStats
+	{
+		// Average cache miss ratio: transformed vertices per triangle, 0.5 to 3.
+		float Acmr = 0.0f;
+
+		// Average transform to vertex ratio: transformed vertices per referenced vertex,
+		// 1 at best.
+		float Atvr = 0.0f;
+	};
+
+	// Simulates a FIFO cache of cacheSize vertices over the triangle list.
+	VertexCacheStats AnalyzeVertexCache(const std::uint32_t* indices, std::size_t indexCount,
+		std::size_t vertexCount, int cacheSize = DefaultCacheSize);
+
+	// vertices holds vertexCount vertices of floatsPerVertex floats, the first three of
+	// which are the position.  A vertex is merged into an earlier one when every float
+	// differs by at most tolerance.  remap receives the new index of each vertex; new
+	// indices follow the order of first occurrence.  Returns the unique vertex count.
+	std::size_t WeldVertices(const float* vertices, std::size_t vertexCount, int floatsPerVertex,
+		float tolerance, std::vector<std::uint32_t>& remap);
+
+	// Replaces every index i by remap[i].
+	void RemapIndices(std::uint32_t* indices, std::size_t indexCount, const std::vector<std::uint32_t>& remap);
+
+	// Removes triangles with a repeated index; returns the new index count.
+	std::size_t RemoveDegenerateTriangles(std::uint32_t* indices, std::size_t indexCount);
+
+	// Reorders the triangles of the list in place.  The triangles themselves, including
+	// their winding, are unchanged.
+	void OptimizeVertexCache(std::uint32_t* indices, std::size_t indexCount, std::size_t vertexCount,
+		int cacheSize = DefaultCacheSize);
+
+	// Quadric error metric simplification (Garland and Heckbert 1997) by half-edge
+	// collapses: a vertex is merged into a neighbour, so no vertex moves and the result
+	// indexes the same vertex buffer.  Collapses are made cheapest first until at most
+	// targetIndexCount indices remain or the next one would move the surface by more than
+	// maxError.  Open borders, which include the attribute seams welding left open, only
+	// collapse along themselves, and the sides of a seam collapse together so they keep
+	// meeting.  vertices is laid out as for WeldVertices.  Writes the triangles to
+	// destination (room for indexCount) and returns their index count.
+	std::size_t Simplify(std::uint32_t* destination, const std::uint32_t* indices, std::size_t indexCount,
+		const float* vertices, std::size_t vertexCount, int floatsPerVertex,
+		std::size_t targetIndexCount, float maxError);
+
+	// Computes remap so vertices are numbered in order of first use by indices and
+	// unreferenced vertices get Unused.  Returns the number of referenced vertices.
+	std::size_t OptimizeVertexFetch(const std::uint32_t* indices, std::size_t indexCount,
+		std::size_t vertexCount, std::vector<std::uint32_t>& remap);
+}
+
+#endif // MESHOPTIMIZER_H
@@ -0,0 +1,62 @@
+//***************************************************************************************
+// RadixSort.cpp
+//***************************************************************************************
+
+#include "RadixSort.h"
+#include <cstring>
+
+namespace
+{
+	const int DigitBits = 8;
+	const int DigitCount = 64 / DigitBits;
+	const int BucketCount = 1 << DigitBits;
+
+	inline int Digit(std::uint64_t key, int d)
+	{
+		return (int)((key >> (d*DigitBits)) & (BucketCount - 1));
+	}
+}
+
+void RadixSort(SortEntry* entries, SortEntry* scratch, int count)
+{
+	if(count < 2)
+		return;
+
+	int histograms[DigitCount][BucketCount] = {};
+	for(int i = 0; i < count; ++i)
+	{
+		std::uint64_t key = entries[i].Key;
+		for(int d = 0; d < DigitCount; ++d)
+			++histograms[d][Digit(key, d)];
+	}
+
+	SortEntry* src = entries;
+	SortEntry* dst = scratch;
+	for(int d = 0; d < DigitCount; ++d)
+	{
+		int* histogram = histograms[d];
+
+		// Every key has the same digit here: the pass would not move anything.
+		if(histogram[Digit(src[0].Key, d)] == count)
+			continue;
+
+		// Turn the counts into the first output slot of each bucket.
+		int offset = 0;
+		for(int b = 0; b < BucketCount; ++b)
+		{
+			int n = histogram[b];
+			histogram[b] = offset;
+			offset += n;
+		}
+
+		for(int i = 0; i < count; ++i)
+			dst[histogram[Digit(src[i].Key, d)]++] = src[i];
+
+		SortEntry* t = src;
+		src = dst;
+		dst = t;
+	}
+
+	if(src != entries)
+		std::memcpy(entries, src, count*sizeof(SortEntry));
+}
@@ -0,0 +1,25 @@
+//***************************************************************************************
+// RadixSort.h
+//
+// Stable least-significant-digit radix sort of 64-bit keys carrying a 32-bit value,
+// used to order the frame's draws by their sort keys.  It takes 8-bit digits.
+// Histograms for all digits come from a single pass, and digits that are the same in
+// every key cost nothing, so keys that only use a few bits sort in a few passes.
+//***************************************************************************************
+
+#ifndef RADIXSORT_H
+#define RADIXSORT_H
+
+#include <cstdint>
+
+struct SortEntry
+{
+	std::uint64_t Key;
+	std::uint32_t Value;
+};
+
+// Sorts entries[0, count) by ascending Key; entries with equal keys keep their order.
+// scratch must hold count entries.  The result is always left in entries.
+void RadixSort(SortEntry* entries, SortEntry* scratch, int count);
+
+#endif // RADIXSORT_H
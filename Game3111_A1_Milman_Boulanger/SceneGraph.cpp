@@ -0,0 +1,190 @@
+//***************************************************************************************
+// SceneGraph.cpp
+//***************************************************************************************
+
+#include "SceneGraph.h"
+#include <algorithm>
+#include <cassert>
+
+namespace
+{
+	// Fewer changed nodes than this are updated on the calling thread.
+	const int ParallelMinNodes = 256;
+}
+
+SceneGraph::SceneGraph(TaskScheduler* scheduler)
+{
+	mScheduler = scheduler != nullptr ? scheduler : &TaskScheduler::Default();
+}
+
+SceneGraph::NodeId SceneGraph::AddNode(NodeId parent, const Float4x4& local)
+{
+	assert(parent >= NoParent && parent < NodeCount());
+
+	// The node goes at the end until the next Linearize puts it after its parent.
+	NodeId id = NodeCount();
+	mParent.push_back(parent);
+	mSlot.push_back(id);
+	mQueued.push_back(1);
+	mChanged.push_back(id);
+
+	mNodeAt.push_back(id);
+	mParentSlot.push_back(-1);
+	mSubtreeEnd.push_back(id + 1);
+	mLocal.push_back(local);
+	mWorld.push_back(Float4x4Identity());
+
+	mNeedsLinearize = true;
+	return id;
+}
+
+int SceneGraph::NodeCount()const
+{
+	return (int)mParent.size();
+}
+
+SceneGraph::NodeId SceneGraph::Parent(NodeId node)const
+{
+	return mParent[node];
+}
+
+const Float4x4& SceneGraph::Local(NodeId node)const
+{
+	return mLocal[mSlot[node]];
+}
+
+void SceneGraph::SetLocal(NodeId node, const Float4x4& local)
+{
+	mLocal[mSlot[node]] = local;
+	if(!mQueued[node])
+	{
+		mQueued[node] = 1;
+		mChanged.push_back(node);
+	}
+}
+
+const Float4x4& SceneGraph::World(NodeId node)const
+{
+	return mWorld[mSlot[node]];
+}
+
+int SceneGraph::UpdateWorld()
+{
+	if(mNeedsLinearize)
+		Linearize();
+
+	mUpdated.clear();
+	if(mChanged.empty())
+		return 0;
+
+	std::vector<int> slots;
+	slots.reserve(mChanged.size());
+	for(NodeId node : mChanged)
+	{
+		slots.push_back(mSlot[node]);
+		mQueued[node] = 0;
+	}
+	mChanged.clear();
+	std::sort(slots.begin(), slots.end());
+
+	// Changed nodes inside an already collected subtree are covered by it.
+	int updated = 0;
+	int coveredEnd = 0;
+	for(int slot : slots)
+	{
+		if(slot < coveredEnd)
+			continue;
+
+		coveredEnd = mSubtreeEnd[slot];
+		mUpdated.push_back({ slot, coveredEnd });
+		updated += coveredEnd - slot;
+	}
+
+	// Within a range every parent precedes its children; the range root's parent
+	// lies outside all ranges and is already up to date.
+	auto sweep = [this](const Range& range)
+	{
+		for(int slot = range.Begin; slot < range.End; ++slot)
+		{
+			int parent = mParentSlot[slot];
+			mWorld[slot] = parent < 0 ? mLocal[slot] : Multiply(mLocal[slot], mWorld[parent]);
+		}
+	};
+
+	if(mUpdated.size() > 1 && updated >= ParallelMinNodes)
+	{
+		mScheduler->ParallelFor(0, (int)mUpdated.size(), [this, &sweep](int k)
+		{
+			sweep(mUpdated[k]);
+		});
+	}
+	else
+	{
+		for(const Range& range : mUpdated)
+			sweep(range);
+	}
+
+	return updated;
+}
+
+void SceneGraph::Linearize()
+{
+	const int count = NodeCount();
+
+	// Children of each node in id order.
+	std::vector<int> childStart(count + 2, 0);
+	for(NodeId node = 0; node < count; ++node)
+		++childStart[mParent[node] + 2];
+	for(int k = 1; k < count + 2; ++k)
+		childStart[k] += childStart[k - 1];
+
+	// Slot 0 of childStart holds the roots (parent NoParent).
+	std::vector<NodeId> children(count);
+	std::vector<int> fill(childStart.begin(), childStart.end() - 1);
+	for(NodeId node = 0; node < count; ++node)
+		children[fill[mParent[node] + 1]++] = node;
+
+	// Depth-first order; children are pushed in reverse so they come out in id order.
+	std::vector<int> slot(count);
+	std::vector<NodeId> order;
+	order.reserve(count);
+	std::vector<NodeId> stack;
+	for(int k = childStart[1] - 1; k >= childStart[0]; --k)
+		stack.push_back(children[k]);
+	while(!stack.empty())
+	{
+		NodeId node = stack.back();
+		stack.pop_back();
+		slot[node] = (int)order.size();
+		order.push_back(node);
+
+		for(int k = childStart[node + 2] - 1; k >= childStart[node + 1]; --k)
+			stack.push_back(children[k]);
+	}
+
+	std::vector<Float4x4> local(count);
+	std::vector<Float4x4> world(count);
+	for(NodeId node = 0; node < count; ++node)
+	{
+		local[slot[node]] = mLocal[mSlot[node]];
+		world[slot[node]] = mWorld[mSlot[node]];
+	}
+	mLocal.swap(local);
+	mWorld.swap(world);
+	mSlot.swap(slot);
+	mNodeAt.swap(order);
+
+	for(int s = 0; s < count; ++s)
+	{
+		NodeId parent = mParent[mNodeAt[s]];
+		mParentSlot[s] = parent == NoParent ? -1 : mSlot[parent];
+		mSubtreeEnd[s] = s + 1;
+	}
+	for(int s = count - 1; s >= 0; --s)
+	{
+		if(mParentSlot[s] >= 0)
+			mSubtreeEnd[mParentSlot[s]] = std::max(mSubtreeEnd[mParentSlot[s]], mSubtreeEnd[s]);
+	}
+
+	mNeedsLinearize = false;
+}
@@ -0,0 +1,113 @@
+//***************************************************************************************
+// SceneGraph.h
+//
+// Transform hierarchy: each node has a transform relative to its parent, and
+// UpdateWorld derives world transforms for the nodes whose local transform (or an
+// ancestor's) changed.  Nodes are kept in depth-first order in flat arrays, so a
+// subtree is one contiguous range that is updated in a single forward sweep, with
+// every parent computed before its children.  Separate changed subtrees are
+// independent and are updated in parallel.
+//
+// Matrices use the DirectXMath row-vector convention: world = local * parentWorld.
+// Like Waves it has no DirectXMath dependency.
+//***************************************************************************************
+
+#ifndef SCENEGRAPH_H
+#define SCENEGRAPH_H
+
+#include "TaskScheduler.h"
+#include <vector>
+
+struct Float4x4
+{
+	float M[4][4];
+};
+
+inline Float4x4 Float4x4Identity()
+{
+	Float4x4 r = {};
+	for(int i = 0; i < 4; ++i)
+		r.M[i][i] = 1.0f;
+	return r;
+}
+
+inline Float4x4 Multiply(const Float4x4& a, const Float4x4& b)
+{
+	Float4x4 r;
+	for(int i = 0; i < 4; ++i)
+	{
+		for(int j = 0; j < 4; ++j)
+			r.M[i][j] = a.M[i][0]*b.M[0][j] + a.M[i][1]*b.M[1][j] + a.M[i][2]*b.M[2][j] + a.M[i][3]*b.M[3][j];
+	}
+	return r;
+}
+
+class SceneGraph
+{
+public:
+	typedef int NodeId;
+	static const NodeId NoParent = -1;
+
+	// nullptr uses TaskScheduler::Default().
+	explicit SceneGraph(TaskScheduler* scheduler = nullptr);
+
+	// Adds a node under parent (or a root for NoParent) and returns its id.  Ids are
+	// assigned in order and stay valid.
+	NodeId AddNode(NodeId parent, const Float4x4& local);
+
+	int NodeCount()const;
+	NodeId Parent(NodeId node)const;
+
+	const Float4x4& Local(NodeId node)const;
+	void SetLocal(NodeId node, const Float4x4& local);
+
+	// World transform as of the last UpdateWorld.
+	const Float4x4& World(NodeId node)const;
+
+	// Recomputes the world transforms of every changed node and its descendants.
+	// Returns the number of nodes updated.
+	int UpdateWorld();
+
+	// Calls fn(node) for each node updated by the last UpdateWorld, parents first.
+	template<typename Fn>
+	void ForEachUpdated(Fn&& fn)const
+	{
+		for(const Range& range : mUpdated)
+		{
+			for(int slot = range.Begin; slot < range.End; ++slot)
+				fn(mNodeAt[slot]);
+		}
+	}
+
+private:
+	struct Range
+	{
+		int Begin;
+		int End;
+	};
+
+	// Reorders the slot arrays depth-first after nodes were added.
+	void Linearize();
+
+	TaskScheduler* mScheduler = nullptr;
+
+	// Indexed by node id.
+	std::vector<NodeId> mParent;
+	std::vector<int> mSlot;
+	std::vector<unsigned char> mQueued;
+
+	// Indexed by slot (depth-first position).  The subtree at slot s is
+	// [s, mSubtreeEnd[s]); mParentSlot is -1 for roots.
+	std::vector<NodeId> mNodeAt;
+	std::vector<int> mParentSlot;
+	std::vector<int> mSubtreeEnd;
+	std::vector<Float4x4> mLocal;
+	std::vector<Float4x4> mWorld;
+
+	// Nodes whose local transform changed since the last UpdateWorld.
+	std::vector<NodeId> mChanged;
+	std::vector<Range> mUpdated;
+	bool mNeedsLinearize = false;
+};
+
+#endif // SCENEGRAPH_H
@@ -30,12 +30,25 @@ SamplerState gsamLinearClamp      : register(s3);
 SamplerState gsamAnisotropicWrap  : register(s4);
 SamplerState gsamAnisotropicClamp : register(s5);
 
-// Constant data that varies per frame.
-cbuffer cbPerObject : register(b0)
+// Per-object data of every instance drawn this frame.  Each instanced draw reads
+// gInstanceData[gInstanceBase + SV_InstanceID].
+struct InstanceData
 {
-    float4x4 gWorld;
-    float4x4 tWorld;
-    float4x4 gTexTransform;
+    float4x4 World;
+    float4x4 TWorld;
+    float4x4 TexTransform;
+};
+
+StructuredBuffer<InstanceData> gInstanceData : register(t0, space1);
+
+cbuffer cbInstance : register(b3)
+{
+    uint gInstanceBase;
+
+    // Box the packed positions of the drawn submesh are quantized to; see
+    // VertexPacking.h.
+    float3 gPosOffset;
+    float3 gPosScale;
 };
 
 // Constant data that varies per material.
@@ -72,12 +85,31 @@ cbuffer cbMaterial : register(b2)
     float4x4 gMatTransform;
 };
 
+#ifdef PACKED_VERTICES
+// 16-byte vertices: unorm16 position within the submesh bounds, octahedral snorm16
+// normal and half-float texture coordinates.
+struct VertexIn
+{
+    float3 PosQ      : POSITION;
+    float2 NormalOct : NORMAL;
+    float2 TexC      : TEXCOORD;
+};
+
+float3 DecodeOctahedral(float2 e)
+{
+    float3 n = float3(e, 1.0f - abs(e.x) - abs(e.y));
+    float t = saturate(-n.z);
+    n.xy += n.xy >= 0.0f ? -t : t;
+    return normalize(n);
+}
+#else
 struct VertexIn
 {
     float3 PosL    : POSITION;
     float3 NormalL : NORMAL;
     float2 TexC    : TEXCOORD;
 };
+#endif
 
 struct VertexOut
 {
@@ -87,16 +119,29 @@ struct VertexOut
     float2 TexC    : TEXCOORD;
 };
 
-VertexOut VS(VertexIn vin)
+VertexOut VS(VertexIn vin, uint instanceID : SV_InstanceID)
 {
     VertexOut vout = (VertexOut)0.0f;
 
+    InstanceData instData = gInstanceData[gInstanceBase + instanceID];
+    float4x4 gWorld = instData.World;
+    float4x4 tWorld = instData.TWorld;
+    float4x4 gTexTransform = instData.TexTransform;
+
+#ifdef PACKED_VERTICES
+    float3 posL = gPosOffset + vin.PosQ*gPosScale;
+    float3 normalL = DecodeOctahedral(vin.NormalOct);
+#else
+    float3 posL = vin.PosL;
+    float3 normalL = vin.NormalL;
+#endif
+
     // Transform to world space.
-    float4 posW = mul(float4(vin.PosL, 1.0f), gWorld);
+    float4 posW = mul(float4(posL, 1.0f), gWorld);
     vout.PosW = posW.xyz;
      
     // Assumes nonuniform scaling; otherwise, need to use inverse-transpose of world matrix.
-    vout.NormalW = mul(vin.NormalL, (float3x3)tWorld);
+    vout.NormalW = mul(normalL, (float3x3)tWorld);
 
     // Transform to homogeneous clip space.
     vout.PosH = mul(posW, gViewProj);
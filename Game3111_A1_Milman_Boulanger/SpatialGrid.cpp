@@ -0,0 +1,222 @@
+//***************************************************************************************
+// SpatialGrid.cpp
+//***************************************************************************************
+
+#include "SpatialGrid.h"
+#include <cmath>
+
+namespace
+{
+	// Boxes covering more cells than this go on the oversized list instead.
+	const int MaxCellsPerBox = 64;
+}
+
+void SpatialGrid::Build(const Aabb* boxes, int count, float cellSize)
+{
+	mBoxes.assign(boxes, boxes + count);
+	mCellStart.clear();
+	mCellItems.clear();
+	mFirstCell.assign(3*count, 0);
+	mOversized.clear();
+	mDims[0] = mDims[1] = mDims[2] = 0;
+
+	if(count == 0)
+		return;
+
+	Aabb world = boxes[0];
+	double meanSize = 0.0;
+	for(int i = 0; i < count; ++i)
+	{
+		world = AabbUnion(world, boxes[i]);
+		meanSize += std::max(boxes[i].Max[0] - boxes[i].Min[0],
+			std::max(boxes[i].Max[1] - boxes[i].Min[1], boxes[i].Max[2] - boxes[i].Min[2]));
+	}
+	meanSize /= count;
+
+	if(cellSize <= 0.0f)
+		cellSize = meanSize > 0.0 ? (float)meanSize : 1.0f;
+
+	// Keep the number of cells proportional to the number of boxes, so sparse scenes
+	// with a few far-away objects do not allocate huge empty grids.
+	const double maxCells = std::max(4.0*count, 64.0);
+	for(;;)
+	{
+		double cells = 1.0;
+		for(int a = 0; a < 3; ++a)
+			cells *= std::max(1.0, std::ceil((world.Max[a] - world.Min[a]) / (double)cellSize));
+		if(cells <= maxCells)
+			break;
+		cellSize *= 2.0f;
+	}
+
+	mCellSize = cellSize;
+	mInvCellSize = 1.0f / cellSize;
+	for(int a = 0; a < 3; ++a)
+	{
+		mOrigin[a] = world.Min[a];
+		mDims[a] = std::max(1, (int)std::ceil((world.Max[a] - world.Min[a]) * mInvCellSize));
+	}
+
+	// Counting sort of box ids into cells.
+	const int cellCount = mDims[0]*mDims[1]*mDims[2];
+	mCellStart.assign(cellCount + 1, 0);
+
+	std::vector<unsigned char> binned(count, 0);
+	for(int pass = 0; pass < 2; ++pass)
+	{
+		for(int id = 0; id < count; ++id)
+		{
+			int lo[3], hi[3];
+			CellRange(boxes[id], lo, hi);
+
+			if(pass == 0)
+			{
+				int covered = (hi[0] - lo[0] + 1)*(hi[1] - lo[1] + 1)*(hi[2] - lo[2] + 1);
+				if(covered > MaxCellsPerBox)
+				{
+					mOversized.push_back(id);
+					continue;
+				}
+
+				binned[id] = 1;
+				mFirstCell[3*id + 0] = lo[0];
+				mFirstCell[3*id + 1] = lo[1];
+				mFirstCell[3*id + 2] = lo[2];
+			}
+			else if(!binned[id])
+			{
+				continue;
+			}
+
+			for(int z = lo[2]; z <= hi[2]; ++z)
+			{
+				for(int y = lo[1]; y <= hi[1]; ++y)
+				{
+					for(int x = lo[0]; x <= hi[0]; ++x)
+					{
+						int cell = (z*mDims[1] + y)*mDims[0] + x;
+						if(pass == 0)
+							++mCellStart[cell + 1];
+						else
+							mCellItems[mCellStart[cell]++] = id;
+					}
+				}
+			}
+		}
+
+		if(pass == 0)
+		{
+			for(int c = 0; c < cellCount; ++c)
+				mCellStart[c + 1] += mCellStart[c];
+			mCellItems.resize(mCellStart[cellCount]);
+		}
+	}
+
+	// The fill pass advanced each start to the next cell's start; shift them back.
+	for(int c = cellCount; c > 0; --c)
+		mCellStart[c] = mCellStart[c - 1];
+	mCellStart[0] = 0;
+}
+
+int SpatialGrid::BoxCount()const
+{
+	return (int)mBoxes.size();
+}
+
+float SpatialGrid::CellSize()const
+{
+	return mCellSize;
+}
+
+const Aabb& SpatialGrid::Box(int id)const
+{
+	return mBoxes[id];
+}
+
+void SpatialGrid::Query(const Aabb& query, std::vector<int>& results)const
+{
+	ForEachOverlap(query, [&results](int id)
+	{
+		results.push_back(id);
+		return true;
+	});
+}
+
+bool SpatialGrid::Overlaps(const Aabb& query)const
+{
+	return !ForEachOverlap(query, [](int)
+	{
+		return false;
+	});
+}
+
+float SpatialGrid::SlideMove(const Aabb& box, const float delta[3], float moved[3],
+	int maxIterations, float skin)const
+{
+	moved[0] = moved[1] = moved[2] = 0.0f;
+
+	// Each slide only shrinks the move, so every position reached stays inside the
+	// box swept by the original move and one query finds all possible contacts.
+	std::vector<int> candidates;
+	Query(AabbUnion(box, AabbTranslate(box, delta)), candidates);
+
+	float firstImpact = 1.0f;
+	float remaining[3] = { delta[0], delta[1], delta[2] };
+	for(int iteration = 0; iteration < maxIterations; ++iteration)
+	{
+		float length = std::sqrt(remaining[0]*remaining[0] + remaining[1]*remaining[1] + remaining[2]*remaining[2]);
+		if(length <= 0.0f)
+			break;
+
+		Aabb current = AabbTranslate(box, moved);
+		float hitTime = 1.0f;
+		int hitAxis = -1;
+		for(int id : candidates)
+		{
+			float t;
+			int axis;
+			if(AabbSweep(current, remaining, mBoxes[id], t, axis) && t < hitTime)
+			{
+				hitTime = t;
+				hitAxis = axis;
+			}
+		}
+
+		if(hitAxis < 0)
+		{
+			for(int a = 0; a < 3; ++a)
+				moved[a] += remaining[a];
+			break;
+		}
+
+		if(iteration == 0)
+			firstImpact = hitTime;
+
+		// Stop short of the contact, then keep only the part of the move that runs
+		// along the contact face.
+		float travel = std::max(hitTime - skin / length, 0.0f);
+		for(int a = 0; a < 3; ++a)
+		{
+			moved[a] += travel*remaining[a];
+			remaining[a] *= 1.0f - hitTime;
+		}
+		remaining[hitAxis] = 0.0f;
+	}
+
+	return firstImpact;
+}
+
+bool SpatialGrid::CellRange(const Aabb& box, int lo[3], int hi[3])const
+{
+	for(int a = 0; a < 3; ++a)
+	{
+		float minCell = std::floor((box.Min[a] - mOrigin[a]) * mInvCellSize);
+		float maxCell = std::floor((box.Max[a] - mOrigin[a]) * mInvCellSize);
+		if(maxCell < 0.0f || minCell >= (float)mDims[a])
+			return false;
+
+		lo[a] = minCell < 0.0f ? 0 : (int)minCell;
+		hi[a] = maxCell >= (float)mDims[a] ? mDims[a] - 1 : (int)maxCell;
+	}
+	return true;
+}
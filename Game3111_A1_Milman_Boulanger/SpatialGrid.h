@@ -0,0 +1,108 @@
+//***************************************************************************************
+// SpatialGrid.h
+//
+// Static uniform grid over a set of boxes, used as a collision broad phase.  Boxes are
+// binned once by Build; a query only visits the cells its box covers, so its cost
+// depends on the number of nearby boxes rather than on the size of the scene.
+//
+// Box ids are their indices in the array given to Build.  Queries are const and may
+// run concurrently.
+//***************************************************************************************
+
+#ifndef SPATIALGRID_H
+#define SPATIALGRID_H
+
+#include "Aabb.h"
+#include <vector>
+
+class SpatialGrid
+{
+public:
+	// Bins count boxes.  cellSize <= 0 derives the cell size from the mean box size.
+	void Build(const Aabb* boxes, int count, float cellSize = 0.0f);
+
+	int BoxCount()const;
+	float CellSize()const;
+	const Aabb& Box(int id)const;
+
+	// Appends the ids of all boxes overlapping query to results (each id once).
+	void Query(const Aabb& query, std::vector<int>& results)const;
+
+	// True if any box overlaps query; stops at the first hit.
+	bool Overlaps(const Aabb& query)const;
+
+	// Moves box along delta, stopping skin short of the first box it would hit and
+	// sliding the rest of the move along that box's face (up to maxIterations
+	// contacts).  The whole move is covered by a single broad-phase query.  moved
+	// receives the offset actually applied; returns the time of first impact as a
+	// fraction of delta (1 if nothing was hit).
+	float SlideMove(const Aabb& box, const float delta[3], float moved[3],
+		int maxIterations = 3, float skin = 0.01f)const;
+
+	// Calls fn(id) for every box overlapping query, each id once, until fn returns false.
+	// Returns false if fn stopped the walk.
+	template<typename Fn>
+	bool ForEachOverlap(const Aabb& query, Fn&& fn)const
+	{
+		// Boxes too large to bin are tested directly.
+		for(int id : mOversized)
+		{
+			if(AabbOverlaps(mBoxes[id], query) && !fn(id))
+				return false;
+		}
+
+		if(mCellStart.empty())
+			return true;
+
+		int lo[3], hi[3];
+		if(!CellRange(query, lo, hi))
+			return true;
+
+		for(int z = lo[2]; z <= hi[2]; ++z)
+		{
+			for(int y = lo[1]; y <= hi[1]; ++y)
+			{
+				for(int x = lo[0]; x <= hi[0]; ++x)
+				{
+					int cell = (z*mDims[1] + y)*mDims[0] + x;
+					for(int k = mCellStart[cell]; k < mCellStart[cell + 1]; ++k)
+					{
+						// A box spanning several cells is reported only from the first
+						// cell it shares with the query.
+						int id = mCellItems[k];
+						const int* first = &mFirstCell[3*id];
+						if(x != (std::max)(first[0], lo[0]) || y != (std::max)(first[1], lo[1]) || z != (std::max)(first[2], lo[2]))
+							continue;
+
+						if(AabbOverlaps(mBoxes[id], query) && !fn(id))
+							return false;
+					}
+				}
+			}
+		}
+
+		return true;
+	}
+
+private:
+	// Clamped cell range covered by box; false if box lies outside the grid.
+	bool CellRange(const Aabb& box, int lo[3], int hi[3])const;
+
+	std::vector<Aabb> mBoxes;
+
+	// Cell c holds mCellItems[mCellStart[c], mCellStart[c+1]).
+	std::vector<int> mCellStart;
+	std::vector<int> mCellItems;
+
+	// Lowest cell (x, y, z) of each binned box.
+	std::vector<int> mFirstCell;
+
+	std::vector<int> mOversized;
+
+	float mOrigin[3] = { 0.0f, 0.0f, 0.0f };
+	float mCellSize = 1.0f;
+	float mInvCellSize = 1.0f;
+	int mDims[3] = { 0, 0, 0 };
+};
+
+#endif // SPATIALGRID_H
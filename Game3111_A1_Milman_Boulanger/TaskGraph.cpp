@@ -0,0 +1,75 @@
+//***************************************************************************************
+// TaskGraph.cpp
+//***************************************************************************************
+
+#include "TaskGraph.h"
+#include <cassert>
+
+TaskGraph::TaskId TaskGraph::Add(const std::string& name, std::function<void()> fn)
+{
+	auto task = std::make_unique<Task>();
+	task->Name = name;
+	task->Fn = std::move(fn);
+	task->Remaining = 0;
+	mTasks.push_back(std::move(task));
+	return (TaskId)mTasks.size() - 1;
+}
+
+void TaskGraph::Precede(TaskId before, TaskId after)
+{
+	assert(before != after);
+	mTasks[before]->Successors.push_back(after);
+	++mTasks[after]->PredecessorCount;
+}
+
+int TaskGraph::TaskCount()const
+{
+	return (int)mTasks.size();
+}
+
+const std::string& TaskGraph::Name(TaskId task)const
+{
+	return mTasks[task]->Name;
+}
+
+void TaskGraph::Run(TaskScheduler& scheduler)
+{
+	if(mTasks.empty())
+		return;
+
+	for(auto& task : mTasks)
+		task->Remaining = task->PredecessorCount;
+	mPending = (int)mTasks.size();
+
+	// Queue all roots but one, which the calling thread runs itself.
+	TaskId first = -1;
+	for(TaskId id = 0; id < (TaskId)mTasks.size(); ++id)
+	{
+		if(mTasks[id]->PredecessorCount != 0)
+			continue;
+
+		if(first < 0)
+			first = id;
+		else
+			scheduler.Submit([this, &scheduler, id] { Execute(scheduler, id); });
+	}
+
+	assert(first >= 0 && "task graph has a cycle");
+	Execute(scheduler, first);
+	scheduler.Wait(mPending);
+}
+
+void TaskGraph::Execute(TaskScheduler& scheduler, TaskId id)
+{
+	Task& task = *mTasks[id];
+	task.Fn();
+
+	// Queue the successors this task was the last dependency of.
+	for(TaskId next : task.Successors)
+	{
+		if(mTasks[next]->Remaining.fetch_sub(1) == 1)
+			scheduler.Submit([this, &scheduler, next] { Execute(scheduler, next); });
+	}
+
+	mPending.fetch_sub(1);
+}
@@ -0,0 +1,52 @@
+//***************************************************************************************
+// TaskGraph.h
+//
+// Set of tasks with "runs before" edges, executed on a TaskScheduler.  A task is
+// submitted as soon as all of its predecessors have finished, so independent tasks
+// run concurrently.  The graph is built once and can be run any number of times.
+//***************************************************************************************
+
+#ifndef TASKGRAPH_H
+#define TASKGRAPH_H
+
+#include "TaskScheduler.h"
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <string>
+#include <vector>
+
+class TaskGraph
+{
+public:
+	typedef int TaskId;
+
+	TaskId Add(const std::string& name, std::function<void()> fn);
+
+	// before must finish before after starts.
+	void Precede(TaskId before, TaskId after);
+
+	int TaskCount()const;
+	const std::string& Name(TaskId task)const;
+
+	// Runs every task once and returns when all have finished.  The calling thread
+	// helps run them.  Must not be called while the graph is already running.
+	void Run(TaskScheduler& scheduler);
+
+private:
+	struct Task
+	{
+		std::string Name;
+		std::function<void()> Fn;
+		std::vector<TaskId> Successors;
+		int PredecessorCount = 0;
+		std::atomic<int> Remaining;
+	};
+
+	void Execute(TaskScheduler& scheduler, TaskId task);
+
+	std::vector<std::unique_ptr<Task>> mTasks;
+	std::atomic<int> mPending;
+};
+
+#endif // TASKGRAPH_H
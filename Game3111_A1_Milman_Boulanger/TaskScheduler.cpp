@@ -0,0 +1,248 @@
+//***************************************************************************************
+// TaskScheduler.cpp
+//***************************************************************************************
+
+#include "TaskScheduler.h"
+#include <algorithm>
+
+namespace
+{
+	// Worker deque of the current thread, if it is a worker of Owner.
+	struct WorkerSlot
+	{
+		const TaskScheduler* Owner;
+		int Index;
+	};
+
+	thread_local WorkerSlot tWorkerSlot = { nullptr, -1 };
+}
+
+TaskScheduler::TaskScheduler(unsigned workerCount)
+{
+	if(workerCount == 0)
+	{
+		unsigned hardwareThreads = std::thread::hardware_concurrency();
+		workerCount = hardwareThreads > 1 ? hardwareThreads - 1 : 1;
+	}
+
+	// One deque per worker plus one for all other threads.
+	mQueuedTasks = 0;
+	for(unsigned i = 0; i <= workerCount; ++i)
+		mQueues.push_back(std::make_unique<TaskQueue>());
+
+	for(unsigned i = 0; i < workerCount; ++i)
+		mWorkers.emplace_back(&TaskScheduler::WorkerMain, this, (int)i);
+}
+
+TaskScheduler::~TaskScheduler()
+{
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mQuit = true;
+	}
+	mWake.notify_all();
+
+	for(auto& worker : mWorkers)
+		worker.join();
+}
+
+unsigned TaskScheduler::WorkerCount()const
+{
+	return (unsigned)mWorkers.size();
+}
+
+TaskScheduler& TaskScheduler::Default()
+{
+	static TaskScheduler scheduler;
+	return scheduler;
+}
+
+void TaskScheduler::ParallelForRange(int begin, int end, const std::function<void(int, int)>& body)
+{
+	if(end <= begin)
+		return;
+
+	int count = end - begin;
+	if(mWorkers.empty() || count == 1)
+	{
+		body(begin, end);
+		return;
+	}
+
+	// A few chunks per thread keeps everyone busy without paying for one task per index.
+	Job job;
+	job.Body = &body;
+	job.End = end;
+	job.Grain = std::max(1, count / (int)(4*(mWorkers.size() + 1)));
+	job.Next = begin;
+	job.Remaining = count;
+	job.Active = 0;
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mJobs.push_back(&job);
+	}
+	mWake.notify_all();
+
+	RunChunks(job);
+
+	// Chunks taken by other threads may still be running; help with other queued
+	// work (e.g. a nested ParallelFor) rather than blocking.
+	while(job.Remaining.load() > 0)
+	{
+		if(!HelpOne())
+			std::this_thread::yield();
+	}
+
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mJobs.erase(std::find(mJobs.begin(), mJobs.end(), &job));
+	}
+
+	// The job lives on our stack, so wait until no worker can still touch it.
+	while(job.Active.load() > 0)
+		std::this_thread::yield();
+}
+
+void TaskScheduler::Submit(std::function<void()> task)
+{
+	TaskQueue& queue = *mQueues[QueueIndex()];
+	{
+		std::lock_guard<std::mutex> lock(queue.Mutex);
+		queue.Tasks.push_back(std::move(task));
+	}
+	mQueuedTasks.fetch_add(1);
+
+	// Taking the lock orders the count update before a sleeping worker's check.
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+	}
+	mWake.notify_one();
+}
+
+void TaskScheduler::Wait(const std::atomic<int>& pending)
+{
+	while(pending.load() > 0)
+	{
+		if(!HelpOne())
+			std::this_thread::yield();
+	}
+}
+
+int TaskScheduler::QueueIndex()const
+{
+	if(tWorkerSlot.Owner == this)
+		return tWorkerSlot.Index;
+	return (int)mQueues.size() - 1;
+}
+
+bool TaskScheduler::RunTask()
+{
+	if(mQueuedTasks.load() == 0)
+		return false;
+
+	std::function<void()> task;
+	const int own = QueueIndex();
+	const int queueCount = (int)mQueues.size();
+	for(int k = 0; k < queueCount && !task; ++k)
+	{
+		TaskQueue& queue = *mQueues[(own + k) % queueCount];
+		std::lock_guard<std::mutex> lock(queue.Mutex);
+		if(queue.Tasks.empty())
+			continue;
+
+		// Newest from our own deque (its data is likely still in cache), oldest
+		// from anyone else's.
+		if(k == 0)
+		{
+			task = std::move(queue.Tasks.back());
+			queue.Tasks.pop_back();
+		}
+		else
+		{
+			task = std::move(queue.Tasks.front());
+			queue.Tasks.pop_front();
+		}
+	}
+
+	if(!task)
+		return false;
+
+	mQueuedTasks.fetch_sub(1);
+	task();
+	return true;
+}
+
+bool TaskScheduler::RunChunks(Job& job)
+{
+	bool didWork = false;
+	for(;;)
+	{
+		int first = job.Next.fetch_add(job.Grain);
+		if(first >= job.End)
+			break;
+
+		int last = std::min(first + job.Grain, job.End);
+		(*job.Body)(first, last);
+		job.Remaining.fetch_sub(last - first);
+		didWork = true;
+	}
+	return didWork;
+}
+
+bool TaskScheduler::HelpOne()
+{
+	if(RunTask())
+		return true;
+
+	Job* job = nullptr;
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		for(Job* j : mJobs)
+		{
+			if(j->Next.load() < j->End)
+			{
+				job = j;
+				break;
+			}
+		}
+
+		if(job == nullptr)
+			return false;
+
+		job->Active.fetch_add(1);
+	}
+
+	bool didWork = RunChunks(*job);
+	job->Active.fetch_sub(1);
+	return didWork;
+}
+
+void TaskScheduler::WorkerMain(int index)
+{
+	tWorkerSlot.Owner = this;
+	tWorkerSlot.Index = index;
+
+	for(;;)
+	{
+		{
+			std::unique_lock<std::mutex> lock(mMutex);
+			mWake.wait(lock, [this]
+			{
+				if(mQuit || mQueuedTasks.load() > 0)
+					return true;
+				for(Job* j : mJobs)
+				{
+					if(j->Next.load() < j->End)
+						return true;
+				}
+				return false;
+			});
+
+			if(mQuit)
+				return;
+		}
+
+		HelpOne();
+	}
+}
@@ -0,0 +1,101 @@
+//***************************************************************************************
+// TaskScheduler.h
+//
+// Small portable worker pool built on std::thread.  It replaces the PPL
+// concurrency::parallel_for calls so that CPU-only code (e.g. the wave solver) has no
+// Windows dependency and can be given a scheduler by the client.
+//
+// ParallelFor may be called from any thread, including from inside another
+// ParallelFor body; the calling thread always helps run the work it submits.
+//
+// Independent tasks (see Submit and TaskGraph) go on per-thread deques: a thread
+// runs its own newest task first and, when it has none, steals the oldest task of
+// another thread.
+//***************************************************************************************
+
+#ifndef TASKSCHEDULER_H
+#define TASKSCHEDULER_H
+
+#include <atomic>
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class TaskScheduler
+{
+public:
+	// workerCount == 0 uses one worker per hardware thread minus the caller.
+	explicit TaskScheduler(unsigned workerCount = 0);
+	TaskScheduler(const TaskScheduler& rhs) = delete;
+	TaskScheduler& operator=(const TaskScheduler& rhs) = delete;
+	~TaskScheduler();
+
+	// Number of background threads (the calling thread is not counted).
+	unsigned WorkerCount()const;
+
+	// Calls body(i) for every i in [begin, end) and returns when all calls are done.
+	template<typename Fn>
+	void ParallelFor(int begin, int end, Fn&& body)
+	{
+		ParallelForRange(begin, end, [&body](int first, int last)
+		{
+			for(int i = first; i < last; ++i)
+				body(i);
+		});
+	}
+
+	// Calls body(first, last) over disjoint chunks that cover [begin, end).
+	void ParallelForRange(int begin, int end, const std::function<void(int, int)>& body);
+
+	// Queues task on the calling thread's deque and returns immediately.
+	void Submit(std::function<void()> task);
+
+	// Runs queued work until pending drops to zero.
+	void Wait(const std::atomic<int>& pending);
+
+	// Process-wide scheduler used when a client does not supply its own.
+	static TaskScheduler& Default();
+
+private:
+	struct Job
+	{
+		const std::function<void(int, int)>* Body = nullptr;
+		int End = 0;
+		int Grain = 1;
+		std::atomic<int> Next;
+		std::atomic<int> Remaining;
+		std::atomic<int> Active;
+	};
+
+	// Runs chunks of job until it has none left.  Returns true if any work was done.
+	static bool RunChunks(Job& job);
+	struct TaskQueue
+	{
+		std::mutex Mutex;
+		std::deque<std::function<void()>> Tasks;
+	};
+
+	// Runs chunks of some queued job or one queued task; used by waiting threads so
+	// nesting cannot deadlock.
+	bool HelpOne();
+	// Pops the newest task of the calling thread's deque, or steals the oldest task of
+	// another deque.
+	bool RunTask();
+	// Deque owned by the calling thread; threads that are not workers share the last one.
+	int QueueIndex()const;
+	void WorkerMain(int index);
+
+	std::vector<std::thread> mWorkers;
+	std::vector<std::unique_ptr<TaskQueue>> mQueues;
+	std::atomic<int> mQueuedTasks;
+	std::vector<Job*> mJobs;
+	std::mutex mMutex;
+	std::condition_variable mWake;
+	bool mQuit = false;
+};
+
+#endif // TASKSCHEDULER_H
@@ -0,0 +1,286 @@
+//***************************************************************************************
+// BvhTest.cpp
+//
+// Checks every Bvh query against a brute-force scan over the same boxes: Query and
+// ForEachOverlap (including stopping early), QueryFrustum, whose plane masks skip
+// tests for subtrees already inside a plane, and Raycast, with rays along the axes and
+// rays starting inside boxes.  Each scene is checked after Build and again after
+// boxes move and the tree is refit.
+//***************************************************************************************
+
+#include "Bvh.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <string>
+#include <vector>
+
+namespace
+{
+	int gFailures = 0;
+
+	void Check(bool passed, const char* scene, const char* what)
+	{
+		if(!passed)
+		{
+			std::printf("FAIL %s: %s\n", scene, what);
+			++gFailures;
+		}
+	}
+
+	unsigned gRandom = 7u;
+
+	float Random(float lo, float hi)
+	{
+		gRandom = gRandom*1664525u + 1013904223u;
+		return lo + (hi - lo)*((gRandom >> 8) / (float)(1u << 24));
+	}
+
+	Aabb RandomBox(float world, float maxExtent)
+	{
+		float center[3] = { Random(-world, world), Random(-world, world), Random(-world, world) };
+		float extents[3] = { Random(0.0f, maxExtent), Random(0.0f, maxExtent), Random(0.0f, maxExtent) };
+		return AabbFromCenterExtents(center, extents);
+	}
+
+	// Six random half-spaces containing the ball of the given radius around center.
+	FrustumPlanes RandomFrustum(const float center[3], float radius)
+	{
+		FrustumPlanes frustum;
+		for(int p = 0; p < 6; ++p)
+		{
+			float n[3];
+			float length;
+			do
+			{
+				for(int a = 0; a < 3; ++a)
+					n[a] = Random(-1.0f, 1.0f);
+				length = std::sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+			} while(length < 0.1f || length > 1.0f);
+
+			float* plane = frustum.Planes[p];
+			for(int a = 0; a < 3; ++a)
+				plane[a] = n[a] / length;
+			plane[3] = radius - (plane[0]*center[0] + plane[1]*center[1] + plane[2]*center[2]);
+		}
+		return frustum;
+	}
+
+	// The frustum test of Bvh::ClassifyFrustum against all six planes.
+	bool InFrustum(const Aabb& box, const FrustumPlanes& frustum)
+	{
+		for(int p = 0; p < 6; ++p)
+		{
+			const float* plane = frustum.Planes[p];
+			float farthest = plane[3];
+			for(int a = 0; a < 3; ++a)
+				farthest += (std::max)(plane[a]*box.Min[a], plane[a]*box.Max[a]);
+			if(farthest < 0.0f)
+				return false;
+		}
+		return true;
+	}
+
+	// Entry distance of the ray into box in [0, maxT], by the slab test; false on a miss.
+	bool RayHits(const float origin[3], const float dir[3], const Aabb& box, float maxT, float& t)
+	{
+		float t0 = 0.0f;
+		float t1 = maxT;
+		for(int a = 0; a < 3; ++a)
+		{
+			if(dir[a] == 0.0f)
+			{
+				if(origin[a] < box.Min[a] || origin[a] > box.Max[a])
+					return false;
+				continue;
+			}
+
+			float invDir = 1.0f / dir[a];
+			float tNear = (box.Min[a] - origin[a])*invDir;
+			float tFar = (box.Max[a] - origin[a])*invDir;
+			if(tNear > tFar)
+				std::swap(tNear, tFar);
+			t0 = (std::max)(t0, tNear);
+			t1 = (std::min)(t1, tFar);
+			if(t0 > t1)
+				return false;
+		}
+		t = t0;
+		return true;
+	}
+
+	std::vector<int> Sorted(std::vector<int> ids)
+	{
+		std::sort(ids.begin(), ids.end());
+		return ids;
+	}
+
+	void CheckQueries(const Bvh& bvh, const std::vector<Aabb>& boxes, float world, const char* scene)
+	{
+		const int count = (int)boxes.size();
+		std::vector<int> results, expected;
+
+		// Box queries, from empty to most of the scene.
+		int boxHits = 0;
+		for(int q = 0; q < 300; ++q)
+		{
+			Aabb query = RandomBox(world, q < 200 ? 0.1f*world : world);
+			if(q % 50 == 0 && count > 0)
+				query = boxes[q % count]; // touches at least itself
+
+			expected.clear();
+			for(int id = 0; id < count; ++id)
+			{
+				if(AabbOverlaps(boxes[id], query))
+					expected.push_back(id);
+			}
+			results.clear();
+			bvh.Query(query, results);
+			Check(Sorted(results) == expected, scene, "Query matches the scan");
+			boxHits += (int)expected.size();
+
+			// ForEachOverlap stops at the first false.
+			int calls = 0;
+			bool finished = bvh.ForEachOverlap(query, [&calls](int) { ++calls; return false; });
+			Check(finished == expected.empty() && calls == (expected.empty() ? 0 : 1), scene, "ForEachOverlap stops early");
+		}
+
+		// Frustums small enough to cull most boxes and large enough to contain whole
+		// subtrees, which the plane masks then report without further tests.
+		int frustumHits = 0;
+		for(int q = 0; q < 200; ++q)
+		{
+			float center[3] = { Random(-world, world), Random(-world, world), Random(-world, world) };
+			FrustumPlanes frustum = RandomFrustum(center, Random(0.05f, 1.5f)*world);
+
+			expected.clear();
+			for(int id = 0; id < count; ++id)
+			{
+				if(InFrustum(boxes[id], frustum))
+					expected.push_back(id);
+			}
+			results.clear();
+			bvh.QueryFrustum(frustum, results);
+			Check(Sorted(results) == expected, scene, "QueryFrustum matches the scan");
+			frustumHits += (int)expected.size();
+		}
+
+		// Rays in random directions, along the axes, and from inside boxes.
+		int rayHits = 0;
+		for(int q = 0; q < 600; ++q)
+		{
+			float origin[3] = { Random(-1.5f*world, 1.5f*world), Random(-1.5f*world, 1.5f*world), Random(-1.5f*world, 1.5f*world) };
+			float dir[3] = { Random(-1.0f, 1.0f), Random(-1.0f, 1.0f), Random(-1.0f, 1.0f) };
+			if(q % 3 == 1)
+			{
+				int axis = q % 6 / 2;
+				dir[0] = dir[1] = dir[2] = 0.0f;
+				dir[axis] = q % 2 == 0 ? 1.0f : -1.0f;
+			}
+			if(q % 5 == 2 && count > 0)
+			{
+				const Aabb& box = boxes[q % count];
+				for(int a = 0; a < 3; ++a)
+					origin[a] = 0.5f*(box.Min[a] + box.Max[a]);
+			}
+			float maxT = q % 4 == 0 ? 0.5f*world : 4.0f*world;
+
+			float nearest = FLT_MAX;
+			for(int id = 0; id < count; ++id)
+			{
+				float t;
+				if(RayHits(origin, dir, boxes[id], maxT, t))
+					nearest = (std::min)(nearest, t);
+			}
+
+			float t = -1.0f;
+			int hit = bvh.Raycast(origin, dir, maxT, t);
+			if(nearest == FLT_MAX)
+			{
+				Check(hit < 0, scene, "Raycast misses when the scan does");
+				continue;
+			}
+
+			// Ties between boxes may pick either; the distance must be the nearest.
+			float hitT;
+			Check(hit >= 0 && t == nearest, scene, "Raycast finds the nearest hit");
+			Check(hit >= 0 && RayHits(origin, dir, boxes[hit], maxT, hitT) && hitT == t, scene, "Raycast reports the box it hit");
+			++rayHits;
+		}
+
+		std::printf("  %-18s %6d boxes %4d nodes: %7d box, %7d frustum, %4d ray hits\n", scene, count, bvh.NodeCount(),
+			boxHits, frustumHits, rayHits);
+	}
+
+	void RunScene(const char* scene, std::vector<Aabb> boxes, float world)
+	{
+		Bvh bvh;
+		bvh.Build(boxes.data(), (int)boxes.size());
+		Check(bvh.BoxCount() == (int)boxes.size(), scene, "BoxCount");
+		CheckQueries(bvh, boxes, world, scene);
+
+		// Most boxes drift a little, some jump across the scene; the topology stays.
+		for(size_t id = 0; id < boxes.size(); ++id)
+		{
+			float offset[3] = { Random(-1.0f, 1.0f), Random(-1.0f, 1.0f), Random(-1.0f, 1.0f) };
+			if(id % 10 == 0)
+			{
+				for(float& o : offset)
+					o *= world;
+			}
+			boxes[id] = AabbTranslate(boxes[id], offset);
+		}
+
+		int nodes = bvh.NodeCount();
+		bvh.Refit(boxes.data());
+		Check(bvh.NodeCount() == nodes, scene, "Refit keeps the topology");
+		for(size_t id = 0; id < boxes.size(); ++id)
+			Check(std::memcmp(&boxes[id], &bvh.Box((int)id), sizeof(Aabb)) == 0, scene, "Refit replaces the boxes");
+		CheckQueries(bvh, boxes, world, (std::string(scene) + " refit").c_str());
+	}
+}
+
+int main()
+{
+	RunScene("empty", {}, 10.0f);
+
+	const float origin[3] = { 0.0f, 0.0f, 0.0f };
+	const float unit[3] = { 1.0f, 1.0f, 1.0f };
+	RunScene("one box", { AabbFromCenterExtents(origin, unit) }, 10.0f);
+
+	std::vector<Aabb> boxes;
+	for(int i = 0; i < 5000; ++i)
+		boxes.push_back(RandomBox(100.0f, 4.0f));
+	RunScene("random", boxes, 100.0f);
+
+	// Small boxes in a few tight clusters plus a few boxes spanning the scene.
+	boxes.clear();
+	for(int i = 0; i < 3000; ++i)
+	{
+		Aabb box = RandomBox(5.0f, 0.5f);
+		float offset[3] = { (float)(i % 4)*60.0f - 90.0f, 0.0f, (float)(i % 3)*60.0f - 60.0f };
+		boxes.push_back(AabbTranslate(box, offset));
+	}
+	for(int i = 0; i < 20; ++i)
+		boxes.push_back(RandomBox(50.0f, 80.0f));
+	RunScene("clustered", boxes, 100.0f);
+
+	// Every centroid coincides, so no split plane separates them.
+	boxes.clear();
+	for(int i = 0; i < 500; ++i)
+	{
+		float extents[3] = { Random(0.1f, 5.0f), Random(0.1f, 5.0f), Random(0.1f, 5.0f) };
+		boxes.push_back(AabbFromCenterExtents(origin, extents));
+	}
+	RunScene("same center", boxes, 10.0f);
+
+	if(gFailures != 0)
+	{
+		std::printf("%d failures\n", gFailures);
+		return 1;
+	}
+	std::printf("every query matches the brute-force scan\n");
+	return 0;
+}
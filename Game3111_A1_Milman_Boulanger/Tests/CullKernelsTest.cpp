@@ -0,0 +1,221 @@
+//***************************************************************************************
+// CullKernelsTest.cpp
+//
+// Checks that the SSE and AVX frustum kernels give the same visibility masks as the
+// scalar one on random boxes and frustums, for box counts that are not a multiple of
+// the vector width.  The boxes in the padding lanes are left visible on purpose, so
+// a kernel that does not clear those bits fails; the mask is filled with garbage
+// first so one that does not clear the whole mask fails too.
+//***************************************************************************************
+
+#include "CullKernels.h"
+#include <cmath>
+#include <cstdio>
+#include <iterator>
+#include <vector>
+
+using namespace CullKernels;
+
+namespace
+{
+	int gFailures = 0;
+
+	unsigned gRandom = 5u;
+
+	// Uniform in [lo, hi).
+	float Random(float lo, float hi)
+	{
+		gRandom = gRandom*1664525u + 1013904223u;
+		return lo + (hi - lo)*((gRandom >> 8) / (float)(1u << 24));
+	}
+
+	// Six random half-spaces that all contain the ball of radius 10 around the origin,
+	// so boxes in [-20, 20] are a mix of inside, outside and straddling.
+	FrustumPlanes RandomFrustum()
+	{
+		FrustumPlanes frustum;
+		for(int p = 0; p < 6; ++p)
+		{
+			float n[3];
+			float length;
+			do
+			{
+				for(int a = 0; a < 3; ++a)
+					n[a] = Random(-1.0f, 1.0f);
+				length = std::sqrt(n[0]*n[0] + n[1]*n[1] + n[2]*n[2]);
+			} while(length < 0.1f || length > 1.0f);
+
+			for(int a = 0; a < 3; ++a)
+				frustum.Planes[p][a] = n[a] / length;
+			frustum.Planes[p][3] = Random(10.0f, 14.0f);
+		}
+		return frustum;
+	}
+
+	// Random boxes; every eighth one is flat on one axis and every sixteenth one is a
+	// point on x = 4, which the last trial of Compare makes a frustum plane, so
+	// dist + radius is exactly 0 there.
+	void FillBoxes(BoxSoA& boxes, int count)
+	{
+		boxes.Resize(count);
+		for(int id = 0; id < count; ++id)
+		{
+			float center[3] = { Random(-20.0f, 20.0f), Random(-20.0f, 20.0f), Random(-20.0f, 20.0f) };
+			float extents[3] = { Random(0.0f, 3.0f), Random(0.0f, 3.0f), Random(0.0f, 3.0f) };
+
+			if(id % 8 == 3)
+				extents[id % 3] = 0.0f;
+
+			if(id % 16 == 5)
+			{
+				// An axis plane through x = 4: center on it, zero extents.
+				center[0] = 4.0f;
+				extents[0] = extents[1] = extents[2] = 0.0f;
+			}
+
+			boxes.Set(id, center, extents);
+		}
+	}
+
+	bool SameMask(const std::vector<std::uint32_t>& a, const std::vector<std::uint32_t>& b, int count, int& first)
+	{
+		for(int id = 0; id < count; ++id)
+		{
+			if(IsVisible(a.data(), id) != IsVisible(b.data(), id))
+			{
+				first = id;
+				return false;
+			}
+		}
+
+		// Bits past count must be clear in both.
+		for(int id = count; id < 32*MaskWordCount(count); ++id)
+		{
+			if(IsVisible(a.data(), id) || IsVisible(b.data(), id))
+			{
+				first = id;
+				return false;
+			}
+		}
+		return true;
+	}
+
+	void Compare(const KernelSet* tested)
+	{
+		if(tested == nullptr)
+			return;
+
+		std::printf("%s vs scalar\n", tested->Name);
+
+		const int largeCounts[] = { 1000, 1003, 4099, 100001 };
+		std::vector<int> counts;
+		for(int count = 0; count <= 8*tested->Width + 3; ++count)
+			counts.push_back(count);
+		counts.insert(counts.end(), std::begin(largeCounts), std::end(largeCounts));
+
+		int visibleTotal = 0, boxTotal = 0;
+		for(int count : counts)
+		{
+			for(int trial = 0; trial < 4; ++trial)
+			{
+				FrustumPlanes frustum = RandomFrustum();
+				if(trial == 3)
+				{
+					// Make the x = 4 plane of FillBoxes one of the frustum planes.
+					frustum.Planes[2][0] = 1.0f;
+					frustum.Planes[2][1] = 0.0f;
+					frustum.Planes[2][2] = 0.0f;
+					frustum.Planes[2][3] = -4.0f;
+				}
+
+				// Fill up to the padded size with boxes inside the frustum, then shrink, so
+				// the padding lanes hold visible boxes.
+				BoxSoA boxes;
+				int padded = (count + 7) & ~7;
+				FillBoxes(boxes, padded);
+				const float origin[3] = { 0.0f, 0.0f, 0.0f };
+				const float extents[3] = { 1.0f, 1.0f, 1.0f };
+				for(int id = count; id < padded; ++id)
+					boxes.Set(id, origin, extents);
+				boxes.Resize(count);
+
+				int words = MaskWordCount(count);
+				std::vector<std::uint32_t> expected(words + 1, 0xdeadbeef);
+				std::vector<std::uint32_t> mask(words + 1, 0xdeadbeef);
+				Scalar().Frustum(frustum, boxes, expected.data());
+				tested->Frustum(frustum, boxes, mask.data());
+
+				int first = -1;
+				if(!SameMask(expected, mask, count, first))
+				{
+					std::printf("FAIL %s: %d boxes, trial %d, first difference at box %d\n", tested->Name, count, trial, first);
+					++gFailures;
+				}
+				if(expected[words] != 0xdeadbeef || mask[words] != 0xdeadbeef)
+				{
+					std::printf("FAIL %s: %d boxes, trial %d, wrote past the mask\n", tested->Name, count, trial);
+					++gFailures;
+				}
+
+				for(int id = 0; id < count; ++id)
+					visibleTotal += IsVisible(expected.data(), id) ? 1 : 0;
+				boxTotal += count;
+			}
+		}
+
+		// A test where everything is culled (or nothing is) would prove little.
+		std::printf("  %d of %d boxes visible\n", visibleTotal, boxTotal);
+		if(visibleTotal == 0 || visibleTotal == boxTotal)
+		{
+			std::printf("FAIL %s: the scenes do not mix visible and culled boxes\n", tested->Name);
+			++gFailures;
+		}
+	}
+
+	// The scalar kernel against the plane test written out per box.
+	void CheckScalar()
+	{
+		FrustumPlanes frustum = RandomFrustum();
+		BoxSoA boxes;
+		FillBoxes(boxes, 1000);
+
+		std::vector<std::uint32_t> mask(MaskWordCount(1000));
+		Scalar().Frustum(frustum, boxes, mask.data());
+
+		for(int id = 0; id < 1000; ++id)
+		{
+			bool visible = true;
+			for(int p = 0; p < 6; ++p)
+			{
+				const float* plane = frustum.Planes[p];
+				float dist = boxes.CenterX()[id]*plane[0] + boxes.CenterY()[id]*plane[1] + boxes.CenterZ()[id]*plane[2] + plane[3];
+				float radius = boxes.ExtentX()[id]*std::fabs(plane[0]) + boxes.ExtentY()[id]*std::fabs(plane[1]) +
+					boxes.ExtentZ()[id]*std::fabs(plane[2]);
+				if(dist + radius < 0.0f)
+					visible = false;
+			}
+
+			if(visible != IsVisible(mask.data(), id))
+			{
+				std::printf("FAIL scalar: box %d\n", id);
+				++gFailures;
+				return;
+			}
+		}
+	}
+}
+
+int main()
+{
+	CheckScalar();
+	Compare(Sse());
+	Compare(Avx());
+
+	if(gFailures != 0)
+	{
+		std::printf("%d failures\n", gFailures);
+		return 1;
+	}
+	std::printf("all kernels match\n");
+	return 0;
+}
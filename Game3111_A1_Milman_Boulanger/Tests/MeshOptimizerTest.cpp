@@ -0,0 +1,385 @@
+//***************************************************************************************
+// MeshOptimizerTest.cpp
+//
+// Checks the pipeline GeometryGenerator::Optimize runs, on meshes in its vertex layout:
+//   - WeldVertices merges a vertex exactly when an earlier unique vertex is within
+//     tolerance in every float (compared with a brute-force scan), keeps the seams and
+//     box corners whose attributes differ, and numbers vertices by first occurrence,
+//   - OptimizeVertexCache keeps the same multiset of triangles, up to rotation of
+//     their indices, and does not make the ACMR worse on grids, spheres, a torus and
+//     a box, in their generated order or shuffled,
+//   - OptimizeVertexFetch numbers vertices by first use,
+//   - the whole pipeline draws the same triangles as the original mesh.
+//***************************************************************************************
+
+#include "MeshOptimizer.h"
+#include "TestMeshes.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+using namespace TestMeshes;
+
+namespace
+{
+	int gFailures = 0;
+
+	void Check(bool passed, const char* mesh, const char* what)
+	{
+		if(!passed)
+		{
+			std::printf("FAIL %s: %s\n", mesh, what);
+			++gFailures;
+		}
+	}
+
+	unsigned gRandom = 12u;
+
+	unsigned RandomIndex(unsigned count)
+	{
+		gRandom = gRandom*1664525u + 1013904223u;
+		return (gRandom >> 8) % count;
+	}
+
+	float Random(float lo, float hi)
+	{
+		gRandom = gRandom*1664525u + 1013904223u;
+		return lo + (hi - lo)*((gRandom >> 8) / (float)(1u << 24));
+	}
+
+	bool WithinTolerance(const float* a, const float* b, float tolerance)
+	{
+		for(int k = 0; k < FloatsPerVertex; ++k)
+		{
+			if(!(std::fabs(a[k] - b[k]) <= tolerance))
+				return false;
+		}
+		return true;
+	}
+
+	struct Triangle
+	{
+		std::uint32_t V[3];
+
+		bool operator<(const Triangle& rhs)const
+		{
+			return std::lexicographical_compare(V, V + 3, rhs.V, rhs.V + 3);
+		}
+		bool operator==(const Triangle& rhs)const
+		{
+			return std::equal(V, V + 3, rhs.V);
+		}
+	};
+
+	// The triangles rotated to start at their lowest index, sorted: equal for two index
+	// lists exactly when they hold the same triangles with the same winding.
+	std::vector<Triangle> CanonicalTriangles(const std::vector<std::uint32_t>& indices)
+	{
+		std::vector<Triangle> triangles(indices.size() / 3);
+		for(std::size_t t = 0; t < triangles.size(); ++t)
+		{
+			const std::uint32_t* tri = &indices[3*t];
+			int first = (int)(std::min_element(tri, tri + 3) - tri);
+			for(int k = 0; k < 3; ++k)
+				triangles[t].V[k] = tri[(first + k) % 3];
+		}
+		std::sort(triangles.begin(), triangles.end());
+		return triangles;
+	}
+
+	void ShuffleTriangles(std::vector<std::uint32_t>& indices)
+	{
+		for(std::size_t t = indices.size()/3; t > 1; --t)
+		{
+			std::size_t other = RandomIndex((unsigned)t);
+			for(int k = 0; k < 3; ++k)
+				std::swap(indices[3*(t - 1) + k], indices[3*other + k]);
+		}
+	}
+
+	// remap numbers each new value one past the highest so far.
+	bool FirstOccurrenceOrder(const std::vector<std::uint32_t>& remap, std::size_t count)
+	{
+		std::uint32_t nextNew = 0;
+		for(std::uint32_t r : remap)
+		{
+			if(r > nextNew)
+				return false;
+			if(r == nextNew)
+				++nextNew;
+		}
+		return nextNew == count;
+	}
+
+	void CheckWeld(const char* name, const Mesh& mesh, float tolerance, std::size_t expectedCount)
+	{
+		std::vector<std::uint32_t> remap;
+		std::size_t count = MeshOptimizer::WeldVertices(mesh.Vertices.data(), mesh.VertexCount(),
+			FloatsPerVertex, tolerance, remap);
+
+		Check(count == expectedCount, name, "unique vertex count");
+		Check(remap.size() == mesh.VertexCount() && FirstOccurrenceOrder(remap, count), name,
+			"remap numbers vertices by first occurrence");
+
+		// A vertex starts a new unique vertex exactly when no earlier unique vertex is
+		// within tolerance; otherwise it is within tolerance of the one it joins.
+		std::vector<std::uint32_t> source;
+		bool rule = true;
+		for(std::uint32_t v = 0; v < (std::uint32_t)mesh.VertexCount() && rule; ++v)
+		{
+			bool anyMatch = false;
+			for(std::uint32_t s : source)
+				anyMatch = anyMatch || WithinTolerance(mesh.Vertex(v), mesh.Vertex(s), tolerance);
+
+			if(remap[v] == source.size())
+			{
+				rule = !anyMatch;
+				source.push_back(v);
+			}
+			else
+			{
+				rule = anyMatch && remap[v] < source.size() &&
+					WithinTolerance(mesh.Vertex(v), mesh.Vertex(source[remap[v]]), tolerance);
+			}
+			if(!rule)
+				std::printf("  vertex %u welded wrongly\n", v);
+		}
+		Check(rule, name, "welds exactly the vertices within tolerance");
+	}
+
+	void TestWelding()
+	{
+		const float tolerance = 1e-3f;
+		const Mesh sphere = Sphere(1.0f, 16, 12);
+		const std::size_t sphereCount = sphere.VertexCount();
+
+		// An exact copy of every vertex per triangle welds back to the sphere, seams and
+		// all: the poles and seam columns differ in their texture coordinates.
+		Mesh soup = Unwelded(sphere);
+		CheckWeld("sphere soup", soup, tolerance, sphereCount);
+		CheckWeld("sphere soup, zero tolerance", soup, 0.0f, sphereCount);
+
+		// Every float of every copy nudged by up to 0.3 tolerance: copies of one vertex
+		// differ by at most 0.6 tolerance and still weld.
+		Mesh nudged = soup;
+		for(float& f : nudged.Vertices)
+			f += Random(-0.3f, 0.3f)*tolerance;
+		CheckWeld("nudged sphere soup", nudged, tolerance, sphereCount);
+
+		// Copies whose texture coordinate or normal is 1.5 tolerance off do not.
+		Mesh offAttribute = sphere;
+		for(std::uint32_t v = 0; v < (std::uint32_t)sphereCount; ++v)
+		{
+			const float* p = sphere.Vertex(v);
+			offAttribute.Vertices.insert(offAttribute.Vertices.end(), p, p + FloatsPerVertex);
+			offAttribute.Vertices[offAttribute.Vertices.size() - (v % 2 == 0 ? 1 : 8)] += 1.5f*tolerance;
+		}
+		CheckWeld("attribute 1.5 tolerance off", offAttribute, tolerance, 2*sphereCount);
+
+		// Once the attributes agree, the seams close: one vertex per ring position.
+		CheckWeld("sphere positions", PositionsOnly(soup), tolerance, 2 + 11*16);
+
+		// The box's faces share corner and edge positions but not normals.
+		const int divisions = 5;
+		Mesh box = SubdividedBox(divisions);
+		CheckWeld("box", Unwelded(box), tolerance, box.VertexCount());
+		CheckWeld("box positions", PositionsOnly(box), tolerance, 6*divisions*divisions + 2);
+
+		// Random points about a tolerance apart along one axis, so both sides of the
+		// boundary and chains of near neighbours occur; the brute-force rule decides.
+		Mesh cloud;
+		for(int i = 0; i < 2000; ++i)
+		{
+			float x = RandomIndex(40)*0.9f*tolerance;
+			cloud.AddVertex(x, RandomIndex(3)*0.7f*tolerance, Random(-0.5f, 0.5f)*tolerance,
+				0.0f, 1.0f, 0.0f, RandomIndex(2)*1.2f*tolerance, 0.0f);
+		}
+		std::vector<std::uint32_t> remap;
+		std::size_t cloudCount = MeshOptimizer::WeldVertices(cloud.Vertices.data(), cloud.VertexCount(),
+			FloatsPerVertex, tolerance, remap);
+		CheckWeld("point cloud", cloud, tolerance, cloudCount);
+		Check(cloudCount > 1 && cloudCount < cloud.VertexCount(), "point cloud", "welds some but not all points");
+	}
+
+	// Reorders the triangles, checks the multiset and returns the ACMR after.
+	float CheckCacheOrder(const char* name, const std::vector<std::uint32_t>& indices, std::size_t vertexCount,
+		float maxAcmr)
+	{
+		float before = MeshOptimizer::AnalyzeVertexCache(indices.data(), indices.size(), vertexCount).Acmr;
+
+		std::vector<std::uint32_t> optimized = indices;
+		MeshOptimizer::OptimizeVertexCache(optimized.data(), optimized.size(), vertexCount);
+		float after = MeshOptimizer::AnalyzeVertexCache(optimized.data(), optimized.size(), vertexCount).Acmr;
+
+		Check(CanonicalTriangles(optimized) == CanonicalTriangles(indices), name,
+			"same triangles with the same winding");
+		Check(after <= before, name, "ACMR does not get worse");
+		Check(after <= maxAcmr, name, "ACMR within the bound");
+		std::printf("  %-22s ACMR %.3f -> %.3f\n", name, before, after);
+		return after;
+	}
+
+	void TestVertexCache()
+	{
+		struct Case { const char* Name; Mesh Shape; float MaxAcmr; };
+		const Case cases[] =
+		{
+			{ "grid 64x64", Grid(10.0f, 10.0f, 64, 64), 0.65f },
+			{ "grid 100x20", Grid(10.0f, 2.0f, 100, 20), 0.65f },
+			{ "sphere 20x20", Sphere(1.0f, 20, 20), 0.72f },
+			{ "sphere 64x48", Sphere(1.0f, 64, 48), 0.68f },
+			{ "torus 48x16", Torus(0.5f, 1.0f, 48, 16), 0.68f },
+			{ "box 10", SubdividedBox(10), 0.75f },
+		};
+
+		for(const Case& c : cases)
+		{
+			CheckCacheOrder(c.Name, c.Shape.Indices, c.Shape.VertexCount(), c.MaxAcmr);
+
+			// Shuffled triangles start near 3 transforms per triangle; the optimized order
+			// must meet the same bound as from the generated order.
+			std::vector<std::uint32_t> shuffled = c.Shape.Indices;
+			ShuffleTriangles(shuffled);
+			CheckCacheOrder((std::string(c.Name) + " shuffled").c_str(), shuffled, c.Shape.VertexCount(), c.MaxAcmr);
+		}
+
+		// Degenerate inputs: nothing, one triangle, a vertex shared by every triangle.
+		std::vector<std::uint32_t> none;
+		MeshOptimizer::OptimizeVertexCache(none.data(), 0, 0);
+		CheckCacheOrder("one triangle", { 2, 0, 1 }, 3, 3.0f);
+		std::vector<std::uint32_t> fan;
+		for(std::uint32_t k = 1; k <= 200; ++k)
+		{
+			fan.push_back(0);
+			fan.push_back(k);
+			fan.push_back(k % 200 + 1);
+		}
+		CheckCacheOrder("fan", fan, 201, 1.1f);
+	}
+
+	void TestVertexFetch()
+	{
+		// Vertices 0, 3 and 7 are never referenced.
+		const std::vector<std::uint32_t> indices = { 5, 2, 6, 6, 2, 1, 8, 4, 5, 1, 2, 4 };
+		std::vector<std::uint32_t> remap;
+		std::size_t used = MeshOptimizer::OptimizeVertexFetch(indices.data(), indices.size(), 9, remap);
+
+		const std::uint32_t U = MeshOptimizer::Unused;
+		const std::vector<std::uint32_t> expected = { U, 3, 1, U, 5, 0, 2, U, 4 };
+		Check(used == 6, "vertex fetch", "referenced vertex count");
+		Check(remap == expected, "vertex fetch", "vertices numbered by first use");
+
+		std::vector<std::uint32_t> renumbered = indices;
+		MeshOptimizer::RemapIndices(renumbered.data(), renumbered.size(), remap);
+		std::uint32_t highest = 0;
+		bool forwards = true;
+		for(std::uint32_t index : renumbered)
+		{
+			forwards = forwards && index <= highest + 1;
+			highest = std::max(highest, index);
+		}
+		Check(forwards, "vertex fetch", "indices walk the buffer forwards");
+	}
+
+	// The triangles of a mesh by vertex data, rotated to start at their smallest vertex.
+	std::vector<std::vector<float>> DrawnTriangles(const Mesh& mesh)
+	{
+		std::vector<std::vector<float>> triangles;
+		for(std::size_t t = 0; t < mesh.Indices.size()/3; ++t)
+		{
+			std::vector<float> corners[3];
+			for(int k = 0; k < 3; ++k)
+			{
+				const float* v = mesh.Vertex(mesh.Indices[3*t + k]);
+				corners[k].assign(v, v + FloatsPerVertex);
+			}
+			int first = (int)(std::min_element(corners, corners + 3) - corners);
+
+			std::vector<float> triangle;
+			for(int k = 0; k < 3; ++k)
+				triangle.insert(triangle.end(), corners[(first + k) % 3].begin(), corners[(first + k) % 3].end());
+			triangles.push_back(triangle);
+		}
+		std::sort(triangles.begin(), triangles.end());
+		return triangles;
+	}
+
+	// GeometryGenerator::Optimize on the plain arrays.
+	Mesh Optimize(const Mesh& mesh, float tolerance)
+	{
+		std::vector<std::uint32_t> indices = mesh.Indices;
+		std::vector<std::uint32_t> weldRemap;
+		std::size_t weldedCount = MeshOptimizer::WeldVertices(mesh.Vertices.data(), mesh.VertexCount(),
+			FloatsPerVertex, tolerance, weldRemap);
+		MeshOptimizer::RemapIndices(indices.data(), indices.size(), weldRemap);
+		indices.resize(MeshOptimizer::RemoveDegenerateTriangles(indices.data(), indices.size()));
+		MeshOptimizer::OptimizeVertexCache(indices.data(), indices.size(), weldedCount);
+
+		std::vector<std::uint32_t> fetchRemap;
+		std::size_t usedCount = MeshOptimizer::OptimizeVertexFetch(indices.data(), indices.size(), weldedCount, fetchRemap);
+		MeshOptimizer::RemapIndices(indices.data(), indices.size(), fetchRemap);
+
+		Mesh result;
+		result.Vertices.resize(usedCount*FloatsPerVertex);
+		for(std::size_t i = mesh.VertexCount(); i-- > 0; )
+		{
+			std::uint32_t v = fetchRemap[weldRemap[i]];
+			if(v != MeshOptimizer::Unused)
+				std::copy(mesh.Vertex((std::uint32_t)i), mesh.Vertex((std::uint32_t)i) + FloatsPerVertex, &result.Vertices[v*FloatsPerVertex]);
+		}
+		result.Indices = indices;
+		return result;
+	}
+
+	void TestPipeline()
+	{
+		// With zero tolerance only exact copies weld, so the drawn triangles are
+		// unchanged down to the bit.
+		const Mesh shapes[] = { Sphere(1.0f, 24, 16), SubdividedBox(4), Torus(0.3f, 1.0f, 24, 12), Grid(4.0f, 4.0f, 20, 20) };
+		const char* names[] = { "sphere pipeline", "box pipeline", "torus pipeline", "grid pipeline" };
+		for(int s = 0; s < 4; ++s)
+		{
+			Mesh soup = Unwelded(shapes[s]);
+			ShuffleTriangles(soup.Indices);
+			Mesh optimized = Optimize(soup, 0.0f);
+
+			Check(optimized.VertexCount() == shapes[s].VertexCount(), names[s], "welds the soup back to the shape");
+			Check(DrawnTriangles(optimized) == DrawnTriangles(shapes[s]), names[s], "draws the same triangles");
+
+			float acmr = MeshOptimizer::AnalyzeVertexCache(optimized.Indices.data(), optimized.Indices.size(),
+				optimized.VertexCount()).Acmr;
+			Check(acmr < 0.85f, names[s], "ACMR of the result");
+		}
+
+		// Welding positions only closes the seams without collapsing any triangle; a
+		// vertex moved onto its neighbour collapses the two triangles they share, which
+		// RemoveDegenerateTriangles drops.
+		Mesh sphere = PositionsOnly(Sphere(1.0f, 12, 8));
+		Mesh optimized = Optimize(sphere, 1e-5f);
+		Check(optimized.Indices.size() == sphere.Indices.size(), "sphere positions pipeline", "no triangle lost");
+
+		Mesh grid = Grid(1.0f, 1.0f, 3, 3);
+		grid.Vertices[4*FloatsPerVertex] = grid.Vertices[3*FloatsPerVertex];
+		optimized = Optimize(PositionsOnly(grid), 1e-5f);
+		Check(optimized.VertexCount() == 8 && optimized.Indices.size() == 3*6, "collapsed grid pipeline",
+			"drops the two triangles a weld made degenerate");
+	}
+}
+
+int main()
+{
+	TestWelding();
+	TestVertexCache();
+	TestVertexFetch();
+	TestPipeline();
+
+	if(gFailures != 0)
+	{
+		std::printf("%d failures\n", gFailures);
+		return 1;
+	}
+	std::printf("welding, reordering and vertex fetch order hold\n");
+	return 0;
+}
@@ -0,0 +1,458 @@
+//***************************************************************************************
+// MeshSimplifyTest.cpp
+//
+// Checks MeshOptimizer::Simplify on meshes in GeometryGenerator's vertex layout:
+//   - the result never has more indices than the target, and reaches it when
+//     maxError allows,
+//   - faceted flat faces collapse at zero error, curved ones do not,
+//   - the sampled Hausdorff distance between the original and the result, both ways,
+//     stays within a small multiple of maxError,
+//   - open borders keep their outline and corners, and seams stay closed,
+//   - no collapse flips a triangle, and closed surfaces stay closed 2-manifolds of the
+//     same Euler characteristic however far they are simplified (the link condition).
+//***************************************************************************************
+
+#include "MeshOptimizer.h"
+#include "TestMeshes.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <map>
+#include <set>
+#include <utility>
+#include <vector>
+
+using namespace TestMeshes;
+
+namespace
+{
+	// Sampled Hausdorff distance allowed per unit of maxError.  A collapse costs the sum
+	// of squared distances to the planes of every triangle merged into the vertex, which
+	// bounds how far the surface moves near it; measured ratios stay below 0.5.
+	const float HausdorffFactor = 1.0f;
+
+	int gFailures = 0;
+
+	void Check(bool passed, const char* mesh, const char* what)
+	{
+		if(!passed)
+		{
+			std::printf("FAIL %s: %s\n", mesh, what);
+			++gFailures;
+		}
+	}
+
+	struct Vec3
+	{
+		double X, Y, Z;
+	};
+
+	Vec3 operator+(Vec3 a, Vec3 b) { return { a.X + b.X, a.Y + b.Y, a.Z + b.Z }; }
+	Vec3 operator-(Vec3 a, Vec3 b) { return { a.X - b.X, a.Y - b.Y, a.Z - b.Z }; }
+	Vec3 operator*(double s, Vec3 a) { return { s*a.X, s*a.Y, s*a.Z }; }
+	double Dot(Vec3 a, Vec3 b) { return a.X*b.X + a.Y*b.Y + a.Z*b.Z; }
+	Vec3 Cross(Vec3 a, Vec3 b) { return { a.Y*b.Z - a.Z*b.Y, a.Z*b.X - a.X*b.Z, a.X*b.Y - a.Y*b.X }; }
+	double Length(Vec3 a) { return std::sqrt(Dot(a, a)); }
+
+	Vec3 Position(const Mesh& mesh, std::uint32_t v)
+	{
+		const float* p = mesh.Vertex(v);
+		return { p[0], p[1], p[2] };
+	}
+
+	Vec3 TriangleNormal(const Mesh& mesh, const std::uint32_t* tri)
+	{
+		Vec3 p0 = Position(mesh, tri[0]);
+		return Cross(Position(mesh, tri[1]) - p0, Position(mesh, tri[2]) - p0);
+	}
+
+	// Closest point on triangle abc to p (Ericson, Real-Time Collision Detection 5.1.5).
+	Vec3 ClosestPointOnTriangle(Vec3 p, Vec3 a, Vec3 b, Vec3 c)
+	{
+		Vec3 ab = b - a, ac = c - a, ap = p - a;
+		double d1 = Dot(ab, ap), d2 = Dot(ac, ap);
+		if(d1 <= 0.0 && d2 <= 0.0)
+			return a;
+
+		Vec3 bp = p - b;
+		double d3 = Dot(ab, bp), d4 = Dot(ac, bp);
+		if(d3 >= 0.0 && d4 <= d3)
+			return b;
+
+		double vc = d1*d4 - d3*d2;
+		if(vc <= 0.0 && d1 >= 0.0 && d3 <= 0.0)
+			return a + (d1 / (d1 - d3))*ab;
+
+		Vec3 cp = p - c;
+		double d5 = Dot(ab, cp), d6 = Dot(ac, cp);
+		if(d6 >= 0.0 && d5 <= d6)
+			return c;
+
+		double vb = d5*d2 - d1*d6;
+		if(vb <= 0.0 && d2 >= 0.0 && d6 <= 0.0)
+			return a + (d2 / (d2 - d6))*ac;
+
+		double va = d3*d6 - d5*d4;
+		if(va <= 0.0 && d4 - d3 >= 0.0 && d5 - d6 >= 0.0)
+			return b + ((d4 - d3) / ((d4 - d3) + (d5 - d6)))*(c - b);
+
+		double denom = 1.0 / (va + vb + vc);
+		return a + (vb*denom)*ab + (vc*denom)*ac;
+	}
+
+	double DistanceToMesh(Vec3 p, const Mesh& mesh)
+	{
+		double best = 1e30;
+		for(std::size_t t = 0; t < mesh.Indices.size(); t += 3)
+		{
+			const std::uint32_t* tri = &mesh.Indices[t];
+			Vec3 q = ClosestPointOnTriangle(p, Position(mesh, tri[0]), Position(mesh, tri[1]), Position(mesh, tri[2]));
+			best = std::min(best, Length(p - q));
+		}
+		return best;
+	}
+
+	double DistanceToSegment(Vec3 p, Vec3 a, Vec3 b)
+	{
+		Vec3 ab = b - a;
+		double t = Dot(p - a, ab) / Dot(ab, ab);
+		t = std::max(0.0, std::min(1.0, t));
+		return Length(p - (a + t*ab));
+	}
+
+	// Largest distance from points spread over from's triangles to the surface of to.
+	double DirectedHausdorff(const Mesh& from, const Mesh& to)
+	{
+		const int steps = 4;
+		double worst = 0.0;
+		for(std::size_t t = 0; t < from.Indices.size(); t += 3)
+		{
+			Vec3 a = Position(from, from.Indices[t]);
+			Vec3 b = Position(from, from.Indices[t + 1]);
+			Vec3 c = Position(from, from.Indices[t + 2]);
+			for(int i = 0; i <= steps; ++i)
+			{
+				for(int j = 0; i + j <= steps; ++j)
+				{
+					Vec3 p = a + ((double)i/steps)*(b - a) + ((double)j/steps)*(c - a);
+					worst = std::max(worst, DistanceToMesh(p, to));
+				}
+			}
+		}
+		return worst;
+	}
+
+	Mesh Simplify(const Mesh& mesh, std::size_t targetIndexCount, float maxError)
+	{
+		Mesh result;
+		result.Vertices = mesh.Vertices;
+		result.Indices.resize(mesh.Indices.size());
+		std::size_t count = MeshOptimizer::Simplify(result.Indices.data(), mesh.Indices.data(), mesh.Indices.size(),
+			mesh.Vertices.data(), mesh.VertexCount(), FloatsPerVertex, targetIndexCount, maxError);
+		result.Indices.resize(count);
+		return result;
+	}
+
+	// Welds the positions of a closed shape so it has no seams left.
+	Mesh Closed(const Mesh& mesh)
+	{
+		Mesh positions = PositionsOnly(mesh);
+		std::vector<std::uint32_t> remap;
+		std::size_t count = MeshOptimizer::WeldVertices(positions.Vertices.data(), positions.VertexCount(),
+			FloatsPerVertex, 1e-5f, remap);
+
+		Mesh closed;
+		closed.Vertices.resize(count*FloatsPerVertex);
+		for(std::size_t v = positions.VertexCount(); v-- > 0; )
+			std::copy(positions.Vertex((std::uint32_t)v), positions.Vertex((std::uint32_t)v) + FloatsPerVertex, &closed.Vertices[remap[v]*FloatsPerVertex]);
+		closed.Indices = positions.Indices;
+		MeshOptimizer::RemapIndices(closed.Indices.data(), closed.Indices.size(), remap);
+		closed.Indices.resize(MeshOptimizer::RemoveDegenerateTriangles(closed.Indices.data(), closed.Indices.size()));
+		return closed;
+	}
+
+	// Directed edges used by exactly one triangle, whose reverse is used by none.
+	std::vector<std::pair<std::uint32_t, std::uint32_t>> BorderEdges(const Mesh& mesh)
+	{
+		std::multiset<std::pair<std::uint32_t, std::uint32_t>> edges;
+		for(std::size_t t = 0; t < mesh.Indices.size(); t += 3)
+		{
+			for(int c = 0; c < 3; ++c)
+				edges.insert({ mesh.Indices[t + c], mesh.Indices[t + (c + 1) % 3] });
+		}
+
+		std::vector<std::pair<std::uint32_t, std::uint32_t>> border;
+		for(const auto& e : edges)
+		{
+			if(edges.count({ e.second, e.first }) == 0)
+				border.push_back(e);
+		}
+		return border;
+	}
+
+	double BorderLength(const Mesh& mesh)
+	{
+		double length = 0.0;
+		for(const auto& e : BorderEdges(mesh))
+			length += Length(Position(mesh, e.second) - Position(mesh, e.first));
+		return length;
+	}
+
+	void CheckTarget(const char* name, const Mesh& mesh, std::size_t target, float maxError, bool reachable)
+	{
+		Mesh result = Simplify(mesh, target, maxError);
+		Check(result.Indices.size() <= target || !reachable, name, "at most the target index count");
+
+		// Each collapse removes at most two triangles, so it stops within one collapse.
+		Check(!reachable || result.Indices.size() + 6 > target, name, "stops at the target");
+		std::printf("  %-30s %5d -> %5d triangles (target %d)\n", name, (int)mesh.Indices.size()/3,
+			(int)result.Indices.size()/3, (int)target/3);
+	}
+
+	void TestTargets()
+	{
+		const Mesh grid = Grid(4.0f, 4.0f, 33, 33);
+		CheckTarget("flat grid, half", grid, grid.Indices.size()/2, 1.0f, true);
+		CheckTarget("flat grid, 1/8", grid, grid.Indices.size()/8, 1.0f, true);
+		CheckTarget("flat grid, 100 triangles", grid, 300, 1.0f, true);
+		CheckTarget("flat grid, 100 triangles, 0 error", grid, 300, 0.0f, true);
+
+		const Mesh sphere = Sphere(1.0f, 32, 24);
+		CheckTarget("sphere, quarter", sphere, sphere.Indices.size()/4, 1.0f, true);
+		CheckTarget("sphere, target above count", sphere, sphere.Indices.size() + 3, 0.0f, false);
+
+		// Every face of the faceted box is flat: it collapses to two triangles per face at
+		// zero error, keeping only the face corners.
+		const Mesh box = SubdividedBox(10);
+		Mesh faces = Simplify(box, 0, 0.0f);
+		Check(box.Indices.size() == 3*1200 && faces.Indices.size() == 3*12, "faceted box", "1200 triangles to 12");
+		bool corners = true;
+		for(std::uint32_t v : faces.Indices)
+		{
+			const float* p = faces.Vertex(v);
+			corners = corners && std::fabs(std::fabs(p[0]) - 1.0f) < 1e-6f &&
+				std::fabs(std::fabs(p[1]) - 1.0f) < 1e-6f && std::fabs(std::fabs(p[2]) - 1.0f) < 1e-6f;
+		}
+		Check(corners, "faceted box", "only face corners remain");
+
+		// A curved surface has no collapse of zero error.
+		Check(Simplify(sphere, 0, 0.0f).Indices == sphere.Indices, "sphere, 0 error", "unchanged");
+		Check(Simplify(Torus(0.4f, 1.0f, 24, 12), 0, 0.0f).Indices.size() == 3*24*12*2, "torus, 0 error", "unchanged");
+	}
+
+	void CheckHausdorff(const char* name, const Mesh& mesh, float maxError)
+	{
+		Mesh result = Simplify(mesh, 0, maxError);
+		double there = DirectedHausdorff(mesh, result);
+		double back = DirectedHausdorff(result, mesh);
+		Check(result.Indices.size() < mesh.Indices.size(), name, "simplifies");
+		Check(there <= HausdorffFactor*maxError && back <= HausdorffFactor*maxError, name,
+			"Hausdorff distance within the bound");
+		std::printf("  %-30s %5d -> %5d triangles, Hausdorff %.4f / %.4f (maxError %.3f)\n", name,
+			(int)mesh.Indices.size()/3, (int)result.Indices.size()/3, there, back, maxError);
+	}
+
+	// Gentle bumps that vanish on the border of the 4 x 4 grid.
+	float Bumps(float x, float z)
+	{
+		return 0.3f*std::cos(0.25f*Pi*x)*std::cos(0.25f*Pi*z) + 0.05f*std::sin(Pi*x)*std::cos(0.25f*Pi*z);
+	}
+
+	// Bumps that reach the border.
+	float Waves(float x, float z)
+	{
+		return 0.2f*std::sin(1.3f*x + 0.4f)*std::cos(0.9f*z);
+	}
+
+	void TestHausdorff()
+	{
+		const Mesh bumps = Grid(4.0f, 4.0f, 33, 33, Bumps);
+		const Mesh waves = Grid(4.0f, 4.0f, 33, 33, Waves);
+		const Mesh sphere = Sphere(1.0f, 32, 24);
+		const Mesh torus = Torus(0.4f, 1.0f, 32, 16);
+		const float errors[] = { 0.02f, 0.05f };
+		for(float maxError : errors)
+		{
+			CheckHausdorff("bumps", bumps, maxError);
+			CheckHausdorff("waves", waves, maxError);
+			CheckHausdorff("sphere", sphere, maxError);
+			CheckHausdorff("closed sphere", Closed(sphere), maxError);
+			CheckHausdorff("torus", torus, maxError);
+		}
+	}
+
+	// mesh is a Grid with columns vertices per row.
+	void CheckBorder(const char* name, const Mesh& mesh, std::uint32_t columns, float maxError, bool straight)
+	{
+		Mesh result = Simplify(mesh, 0, maxError);
+		Check(!result.Indices.empty() && result.Indices.size() < mesh.Indices.size()/2, name, "simplifies by half at least");
+
+		// Border vertices stay border vertices, and corners stay.
+		std::set<std::uint32_t> before, after;
+		for(const auto& e : BorderEdges(mesh))
+			before.insert(e.first);
+		for(const auto& e : BorderEdges(result))
+			after.insert(e.first);
+		Check(std::includes(before.begin(), before.end(), after.begin(), after.end()), name,
+			"border vertices come from the border");
+		const std::uint32_t last = (std::uint32_t)mesh.VertexCount() - 1;
+		const std::uint32_t corners[] = { 0, columns - 1, last + 1 - columns, last };
+		bool keptCorners = true;
+		for(std::uint32_t c : corners)
+			keptCorners = keptCorners && after.count(c) == 1;
+		Check(keptCorners, name, "corners kept");
+
+		// Every point of the new border lies on or near the old one.
+		const auto oldBorder = BorderEdges(mesh);
+		double worst = 0.0;
+		for(const auto& e : BorderEdges(result))
+		{
+			for(int k = 1; k < 8; ++k)
+			{
+				Vec3 p = Position(result, e.first) + (k/8.0)*(Position(result, e.second) - Position(result, e.first));
+				double nearest = 1e30;
+				for(const auto& o : oldBorder)
+					nearest = std::min(nearest, DistanceToSegment(p, Position(mesh, o.first), Position(mesh, o.second)));
+				worst = std::max(worst, nearest);
+			}
+		}
+
+		double lengthBefore = BorderLength(mesh);
+		double lengthAfter = BorderLength(result);
+		if(straight)
+		{
+			Check(worst < 1e-6, name, "border outline unchanged");
+			Check(std::fabs(lengthAfter - lengthBefore) < 1e-4, name, "border length unchanged");
+		}
+		else
+		{
+			Check(worst <= HausdorffFactor*maxError, name, "border within the bound");
+		}
+		std::printf("  %-30s border %3d -> %3d edges, length %.4f -> %.4f, off by %.2g\n", name,
+			(int)before.size(), (int)after.size(), lengthBefore, lengthAfter, worst);
+	}
+
+	void TestBorders()
+	{
+		CheckBorder("flat grid border", Grid(4.0f, 4.0f, 33, 33), 33, 1.0f, true);
+		CheckBorder("bumps border", Grid(4.0f, 4.0f, 33, 33, Bumps), 33, 0.05f, true);
+		CheckBorder("waves border", Grid(4.0f, 4.0f, 33, 33, Waves), 33, 0.05f, false);
+		CheckBorder("waves border, coarse", Grid(4.0f, 4.0f, 33, 33, Waves), 33, 0.2f, false);
+
+		// Both sides of the sphere's and torus's seams and of the box's edges must still
+		// meet: every border edge has one running the other way between the same points.
+		const Mesh meshes[] = { Sphere(1.0f, 32, 24), SubdividedBox(10), Torus(0.4f, 1.0f, 32, 16) };
+		const char* names[] = { "sphere seam", "box edges", "torus seams" };
+		for(int m = 0; m < 3; ++m)
+		{
+			Mesh result = Simplify(meshes[m], 0, 0.05f);
+			const auto edges = BorderEdges(result);
+			int open = 0;
+			for(const auto& e : edges)
+			{
+				bool matched = false;
+				for(const auto& other : edges)
+				{
+					matched = matched ||
+						(Length(Position(result, other.first) - Position(result, e.second)) < 1e-5 &&
+						Length(Position(result, other.second) - Position(result, e.first)) < 1e-5);
+				}
+				open += matched ? 0 : 1;
+			}
+			Check(open == 0, names[m], "seams stay closed");
+			std::printf("  %-30s %5d -> %5d triangles, %d seam edges, %d open\n", names[m],
+				(int)meshes[m].Indices.size()/3, (int)result.Indices.size()/3, (int)edges.size(), open);
+		}
+	}
+
+	// Edges with their triangle counts, by unordered vertex pair.
+	bool IsClosedManifold(const Mesh& mesh, int& euler)
+	{
+		std::map<std::pair<std::uint32_t, std::uint32_t>, int> directed;
+		std::set<std::uint32_t> vertices;
+		for(std::size_t t = 0; t < mesh.Indices.size(); t += 3)
+		{
+			for(int c = 0; c < 3; ++c)
+			{
+				vertices.insert(mesh.Indices[t + c]);
+				++directed[{ mesh.Indices[t + c], mesh.Indices[t + (c + 1) % 3] }];
+			}
+		}
+
+		// Each directed edge once, and its reverse once: two consistently wound triangles
+		// per edge.
+		bool manifold = true;
+		for(const auto& e : directed)
+		{
+			auto reverse = directed.find({ e.first.second, e.first.first });
+			manifold = manifold && e.second == 1 && reverse != directed.end() && reverse->second == 1;
+		}
+
+		euler = (int)vertices.size() - (int)directed.size()/2 + (int)mesh.Indices.size()/3;
+		return manifold;
+	}
+
+	void CheckTopology(const char* name, const Mesh& mesh, int expectedEuler)
+	{
+		int euler = 0;
+		Check(IsClosedManifold(mesh, euler) && euler == expectedEuler, name, "closed manifold before");
+
+		// Nothing stops these but the link condition and the flip test.
+		Mesh result = Simplify(mesh, 0, 1e3f);
+		Check(IsClosedManifold(result, euler), name, "closed manifold after");
+		Check(euler == expectedEuler, name, "same Euler characteristic");
+		std::printf("  %-30s %5d -> %5d triangles, Euler characteristic %d\n", name,
+			(int)mesh.Indices.size()/3, (int)result.Indices.size()/3, euler);
+	}
+
+	void TestTopology()
+	{
+		CheckTopology("closed sphere", Closed(Sphere(1.0f, 32, 24)), 2);
+		CheckTopology("closed torus", Closed(Torus(0.4f, 1.0f, 32, 16)), 0);
+		CheckTopology("thin closed torus", Closed(Torus(0.05f, 1.0f, 48, 8)), 0);
+		CheckTopology("closed box", Closed(SubdividedBox(6)), 2);
+	}
+
+	// Every triangle of the result faces the way the surface did there.
+	void TestFlips()
+	{
+		const float errors[] = { 0.05f, 0.2f };
+		for(float maxError : errors)
+		{
+			Mesh heights = Simplify(Grid(4.0f, 4.0f, 33, 33, Waves), 0, maxError);
+			bool up = !heights.Indices.empty();
+			for(std::size_t t = 0; t < heights.Indices.size(); t += 3)
+				up = up && TriangleNormal(heights, &heights.Indices[t]).Y > 0.0;
+			Check(up, "heightfield", "triangles face up");
+
+			Mesh sphere = Simplify(Closed(Sphere(1.0f, 32, 24)), 0, maxError);
+			bool outward = !sphere.Indices.empty();
+			for(std::size_t t = 0; t < sphere.Indices.size(); t += 3)
+			{
+				const std::uint32_t* tri = &sphere.Indices[t];
+				Vec3 centroid = (1.0/3.0)*(Position(sphere, tri[0]) + Position(sphere, tri[1]) + Position(sphere, tri[2]));
+				outward = outward && Dot(TriangleNormal(sphere, tri), centroid) > 0.0;
+			}
+			Check(outward, "closed sphere", "triangles face outward");
+			std::printf("  %-30s %d and %d triangles at maxError %.2f\n", "heightfield and sphere flips",
+				(int)heights.Indices.size()/3, (int)sphere.Indices.size()/3, maxError);
+		}
+	}
+}
+
+int main()
+{
+	TestTargets();
+	TestHausdorff();
+	TestBorders();
+	TestTopology();
+	TestFlips();
+
+	if(gFailures != 0)
+	{
+		std::printf("%d failures\n", gFailures);
+		return 1;
+	}
+	std::printf("Simplify keeps to its target, error bound, borders and topology\n");
+	return 0;
+}
@@ -0,0 +1,115 @@
+//***************************************************************************************
+// RadixSortTest.cpp
+//
+// Compares RadixSort with std::stable_sort on random 64-bit keys: full-width keys,
+// keys with few distinct values (so stability matters), keys that share their high
+// or middle bytes (so the uniform-digit passes are skipped, which can leave the
+// result in scratch before the final copy), all-equal keys, and the 0- and
+// 1-element inputs.
+//***************************************************************************************
+
+#include "RadixSort.h"
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <vector>
+
+namespace
+{
+	int gFailures = 0;
+
+	std::uint64_t gRandom = 8u;
+
+	std::uint64_t Random64()
+	{
+		// xorshift64*
+		gRandom ^= gRandom >> 12;
+		gRandom ^= gRandom << 25;
+		gRandom ^= gRandom >> 27;
+		return gRandom*2685821657736338717ull;
+	}
+
+	// Sorts count entries whose keys come from makeKey with both sorts; values are the
+	// original positions, so any difference in the order of equal keys shows up.
+	void Compare(const char* name, int count, const std::function<std::uint64_t()>& makeKey)
+	{
+		std::vector<SortEntry> entries(count);
+		for(int i = 0; i < count; ++i)
+			entries[i] = { makeKey(), (std::uint32_t)i };
+
+		std::vector<SortEntry> expected = entries;
+		std::stable_sort(expected.begin(), expected.end(), [](const SortEntry& a, const SortEntry& b)
+		{
+			return a.Key < b.Key;
+		});
+
+		// The scratch buffer starts with garbage; one past the end of both buffers
+		// must not be written.
+		const SortEntry guard = { 0x0123456789abcdefull, 0xfeedfaceu };
+		entries.push_back(guard);
+		std::vector<SortEntry> scratch(count + 1, guard);
+		for(int i = 0; i < count; ++i)
+			scratch[i] = { Random64(), 0xdeadbeefu };
+
+		RadixSort(entries.data(), scratch.data(), count);
+
+		bool same = true;
+		for(int i = 0; i < count; ++i)
+			same = same && entries[i].Key == expected[i].Key && entries[i].Value == expected[i].Value;
+		bool guarded = std::memcmp(&entries[count], &guard, sizeof(guard)) == 0 &&
+			std::memcmp(&scratch[count], &guard, sizeof(guard)) == 0;
+
+		if(!same || !guarded)
+		{
+			std::printf("FAIL %s, %d entries: %s\n", name, count, same ? "wrote past the buffers" : "differs from std::stable_sort");
+			++gFailures;
+		}
+	}
+
+	void CompareAll(int count)
+	{
+		Compare("random keys", count, []() { return Random64(); });
+
+		Compare("16 distinct keys", count, []() { return Random64() & 0xf000000000000f00ull; });
+
+		// Only the low byte varies: one pass, so the result ends up in scratch.
+		Compare("shared high bytes, one digit", count, []()
+		{
+			return 0xabcdef0123456700ull | (Random64() & 0xff);
+		});
+
+		// Two varying digits: two passes, back in entries.
+		Compare("shared high bytes, two digits", count, []()
+		{
+			return 0x1122334455660000ull | (Random64() & 0xffff);
+		});
+
+		// Varying digits separated by uniform ones, like the draw sort keys.
+		Compare("shared middle bytes", count, []()
+		{
+			std::uint64_t r = Random64();
+			return (r & 0xff000000000000ffull) | 0x0000123456780000ull | (r & 0x0000000000ff0000ull);
+		});
+
+		Compare("all keys equal", count, []() { return 0x8000000000000001ull; });
+
+		// Keys that differ only in the top bit.
+		Compare("top bit only", count, []() { return Random64() & 0x8000000000000000ull; });
+	}
+}
+
+int main()
+{
+	const int counts[] = { 0, 1, 2, 3, 7, 255, 256, 257, 1000, 65536, 100003 };
+	for(int count : counts)
+		CompareAll(count);
+
+	if(gFailures != 0)
+	{
+		std::printf("%d failures\n", gFailures);
+		return 1;
+	}
+	std::printf("RadixSort matches std::stable_sort\n");
+	return 0;
+}
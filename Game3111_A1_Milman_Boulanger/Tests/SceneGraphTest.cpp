@@ -0,0 +1,229 @@
+//***************************************************************************************
+// SceneGraphTest.cpp
+//
+// Builds a hierarchy of a few thousand nodes, wide under some parents and hundreds of
+// levels deep under others, and checks UpdateWorld against a serial recomputation
+// of world = local * parentWorld in id order.  The changes set interior nodes of
+// several separate subtrees, large enough that UpdateWorld sweeps them in parallel,
+// as well as single leaves and nested changes inside a changed subtree.  Nodes are
+// also added between updates, which reorders the slots.
+//***************************************************************************************
+
+#include "SceneGraph.h"
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+	int gFailures = 0;
+
+	void Check(bool passed, const char* step, const char* what)
+	{
+		if(!passed)
+		{
+			std::printf("FAIL %s: %s\n", step, what);
+			++gFailures;
+		}
+	}
+
+	unsigned gRandom = 10u;
+
+	unsigned RandomIndex(unsigned count)
+	{
+		gRandom = gRandom*1664525u + 1013904223u;
+		return (gRandom >> 8) % count;
+	}
+
+	float Random(float lo, float hi)
+	{
+		gRandom = gRandom*1664525u + 1013904223u;
+		return lo + (hi - lo)*((gRandom >> 8) / (float)(1u << 24));
+	}
+
+	// Close to a rigid transform, so products hundreds of levels deep stay finite.
+	Float4x4 RandomLocal()
+	{
+		Float4x4 m = Float4x4Identity();
+		for(int i = 0; i < 3; ++i)
+		{
+			for(int j = 0; j < 3; ++j)
+				m.M[i][j] += Random(-0.01f, 0.01f);
+			m.M[3][i] = Random(-2.0f, 2.0f);
+		}
+		return m;
+	}
+
+	// The expected state: parents, local transforms and world transforms by node id.
+	struct Reference
+	{
+		std::vector<SceneGraph::NodeId> Parent;
+		std::vector<Float4x4> Local;
+		std::vector<Float4x4> World;
+
+		// Parents always have lower ids than their children.
+		void Recompute()
+		{
+			World.resize(Local.size());
+			for(size_t n = 0; n < Local.size(); ++n)
+				World[n] = Parent[n] < 0 ? Local[n] : Multiply(Local[n], World[Parent[n]]);
+		}
+
+		bool IsDescendant(int node, int ancestor)const
+		{
+			for(int n = node; n >= 0; n = Parent[n])
+			{
+				if(n == ancestor)
+					return true;
+			}
+			return false;
+		}
+	};
+
+	SceneGraph::NodeId Add(SceneGraph& graph, Reference& reference, SceneGraph::NodeId parent)
+	{
+		Float4x4 local = RandomLocal();
+		reference.Parent.push_back(parent);
+		reference.Local.push_back(local);
+		return graph.AddNode(parent, local);
+	}
+
+	void Compare(const SceneGraph& graph, const Reference& reference, const char* step)
+	{
+		bool same = graph.NodeCount() == (int)reference.Local.size();
+		for(int n = 0; same && n < graph.NodeCount(); ++n)
+		{
+			same = graph.Parent(n) == reference.Parent[n] &&
+				std::memcmp(&graph.Local(n), &reference.Local[n], sizeof(Float4x4)) == 0 &&
+				std::memcmp(&graph.World(n), &reference.World[n], sizeof(Float4x4)) == 0;
+			if(!same)
+				std::printf("  node %d differs\n", n);
+		}
+		Check(same, step, "world transforms match the serial recomputation");
+	}
+
+	// Sets the local transforms of changed, updates, and checks the world transforms,
+	// the returned count and the nodes ForEachUpdated reports.  Returns the count.
+	int ChangeAndCheck(SceneGraph& graph, Reference& reference, const std::vector<int>& changed, const char* step)
+	{
+		for(int node : changed)
+		{
+			reference.Local[node] = RandomLocal();
+			graph.SetLocal(node, reference.Local[node]);
+		}
+
+		std::vector<unsigned char> expected(reference.Local.size(), 0);
+		int expectedCount = 0;
+		for(int n = 0; n < (int)expected.size(); ++n)
+		{
+			for(int c : changed)
+			{
+				if(reference.IsDescendant(n, c))
+				{
+					expected[n] = 1;
+					++expectedCount;
+					break;
+				}
+			}
+		}
+
+		int updated = graph.UpdateWorld();
+		reference.Recompute();
+		Compare(graph, reference, step);
+		Check(updated == expectedCount, step, "UpdateWorld counts the changed subtrees");
+
+		// Each updated node once, after its parent if the parent was updated too.
+		std::vector<unsigned char> seen(expected.size(), 0);
+		bool ordered = true, once = true;
+		graph.ForEachUpdated([&](SceneGraph::NodeId node)
+		{
+			once = once && expected[node] && !seen[node];
+			int parent = reference.Parent[node];
+			ordered = ordered && (parent < 0 || !expected[parent] || seen[parent]);
+			seen[node] = 1;
+		});
+		Check(once && seen == expected, step, "ForEachUpdated reports each updated node once");
+		Check(ordered, step, "ForEachUpdated reports parents first");
+
+		std::printf("  %-28s %5d of %5d nodes updated\n", step, updated, (int)expected.size());
+		return updated;
+	}
+}
+
+int main()
+{
+	TaskScheduler scheduler(3);
+	SceneGraph graph(&scheduler);
+	Reference reference;
+
+	// Three roots: a wide tree, a deep chain with side branches, and a random tree.
+	SceneGraph::NodeId wide = Add(graph, reference, SceneGraph::NoParent);
+	SceneGraph::NodeId deep = Add(graph, reference, SceneGraph::NoParent);
+	SceneGraph::NodeId bushy = Add(graph, reference, SceneGraph::NoParent);
+
+	std::vector<SceneGraph::NodeId> wideGroups;
+	for(int g = 0; g < 8; ++g)
+	{
+		SceneGraph::NodeId group = Add(graph, reference, wide);
+		wideGroups.push_back(group);
+		for(int k = 0; k < 100; ++k)
+			Add(graph, reference, group);
+	}
+
+	std::vector<SceneGraph::NodeId> chain = { deep };
+	for(int level = 0; level < 400; ++level)
+	{
+		chain.push_back(Add(graph, reference, chain.back()));
+		if(level % 10 == 0)
+			Add(graph, reference, chain.back());
+	}
+
+	// Random parents, interleaved with the other trees' ids.
+	std::vector<SceneGraph::NodeId> bushyNodes = { bushy };
+	for(int k = 0; k < 1500; ++k)
+	{
+		SceneGraph::NodeId parent = bushyNodes[RandomIndex((unsigned)bushyNodes.size())];
+		bushyNodes.push_back(Add(graph, reference, parent));
+		if(k % 100 == 0)
+			Add(graph, reference, wideGroups[k / 100 % wideGroups.size()]);
+	}
+
+	graph.UpdateWorld();
+	reference.Recompute();
+	Compare(graph, reference, "initial build");
+
+	// Separate interior subtrees of more than 256 nodes in total (ParallelMinNodes in
+	// SceneGraph.cpp): the parallel sweep.
+	int updated = ChangeAndCheck(graph, reference, { wideGroups[1], wideGroups[4], wideGroups[6], chain[150] }, "separate subtrees");
+	Check(updated >= 256, "separate subtrees", "enough nodes for the parallel sweep");
+
+	// A changed node inside another changed subtree is covered by it.
+	ChangeAndCheck(graph, reference, { chain[20], chain[300], wideGroups[2], bushyNodes[1], bushyNodes[700] }, "nested changes");
+
+	// Below the parallel threshold: one leaf and one small group.
+	ChangeAndCheck(graph, reference, { chain.back(), wideGroups[3] }, "small change");
+
+	// Everything, from the roots.
+	ChangeAndCheck(graph, reference, { wide, deep, bushy }, "all roots");
+
+	ChangeAndCheck(graph, reference, {}, "no change");
+
+	// New nodes under interior nodes reorder the slots; the next update covers them
+	// (a new node counts as changed) and the old subtrees keep working.
+	std::vector<int> added;
+	for(int k = 0; k < 300; ++k)
+		added.push_back(Add(graph, reference, k % 2 == 0 ? chain[RandomIndex(400)] : bushyNodes[RandomIndex(1500)]));
+	std::vector<int> changed = added;
+	changed.push_back(wideGroups[0]);
+	changed.push_back(wideGroups[7]);
+	ChangeAndCheck(graph, reference, changed, "after adding nodes");
+	ChangeAndCheck(graph, reference, { chain[100], bushyNodes[3], wideGroups[5] }, "after relinearizing");
+
+	if(gFailures != 0)
+	{
+		std::printf("%d failures\n", gFailures);
+		return 1;
+	}
+	std::printf("UpdateWorld matches the serial recomputation\n");
+	return 0;
+}
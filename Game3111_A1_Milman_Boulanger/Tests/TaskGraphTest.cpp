@@ -0,0 +1,199 @@
+//***************************************************************************************
+// TaskGraphTest.cpp
+//
+// Runs a TaskGraph with a diamond, a chain and independent roots, whose tasks run
+// nested ParallelFor loops, many times on schedulers of several sizes.  Every task
+// must run exactly once per Run, after all of its predecessors have finished, and
+// the nested loops must cover their ranges exactly once.  Also checks
+// TaskScheduler::Submit/Wait directly with tasks that submit more tasks, so the
+// per-thread deques and stealing carry most of the work.
+//***************************************************************************************
+
+#include "TaskGraph.h"
+#include <atomic>
+#include <cstdio>
+#include <mutex>
+#include <set>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+
+namespace
+{
+	const int RunCount = 2000;
+	const int LoopSize = 97;
+
+	int gFailures = 0;
+
+	void Check(bool passed, const char* what, unsigned workers, int run)
+	{
+		if(!passed)
+		{
+			std::printf("FAIL %s (%u workers, run %d)\n", what, workers, run);
+			++gFailures;
+		}
+	}
+
+	// Start and finish times of each task on a shared logical clock, the sum of its
+	// nested loop and the number of calls of the loop nested inside that.
+	struct Trace
+	{
+		explicit Trace(int taskCount)
+			: Start(taskCount), Finish(taskCount), Runs(taskCount), LoopSums(taskCount), InnerCalls(taskCount) {}
+
+		std::atomic<int> Clock{ 0 };
+		std::vector<std::atomic<int>> Start;
+		std::vector<std::atomic<int>> Finish;
+		std::vector<std::atomic<int>> Runs;
+		std::vector<std::atomic<int>> LoopSums;
+		std::vector<std::atomic<int>> InnerCalls;
+
+		std::mutex ThreadsMutex;
+		std::set<std::thread::id> Threads;
+
+		void Reset()
+		{
+			Clock = 0;
+			for(size_t i = 0; i < Start.size(); ++i)
+			{
+				Start[i] = -1;
+				Finish[i] = -1;
+				Runs[i] = 0;
+				LoopSums[i] = 0;
+				InnerCalls[i] = 0;
+			}
+		}
+	};
+
+	void RunGraphs(unsigned workerCount)
+	{
+		TaskScheduler scheduler(workerCount);
+
+		// Task ids are assigned in order, so the edges can be listed up front.
+		//   diamond: 0 -> 1, 0 -> 2, 1 -> 3, 2 -> 3
+		//   chain:   4 -> 5 -> 6 -> 7 -> 8
+		//   joins:   3 -> 9, 8 -> 9 (the frame's final stage waits on both)
+		//   roots:   10, 11 have no edges; 11 -> 5 makes a chain link wait on a root
+		const std::pair<int, int> edges[] =
+		{
+			{ 0, 1 }, { 0, 2 }, { 1, 3 }, { 2, 3 },
+			{ 4, 5 }, { 5, 6 }, { 6, 7 }, { 7, 8 },
+			{ 3, 9 }, { 8, 9 },
+			{ 11, 5 },
+		};
+		const int taskCount = 12;
+
+		Trace trace(taskCount);
+		TaskGraph graph;
+		for(int id = 0; id < taskCount; ++id)
+		{
+			graph.Add("task " + std::to_string(id), [&trace, &scheduler, id]()
+			{
+				trace.Start[id] = trace.Clock++;
+				++trace.Runs[id];
+
+				// A nested loop; even tasks nest another loop inside every 16th iteration.
+				scheduler.ParallelFor(0, LoopSize, [&trace, &scheduler, id](int i)
+				{
+					if(id % 2 == 0 && i % 16 == 0)
+						scheduler.ParallelFor(0, 8, [&trace, id](int) { ++trace.InnerCalls[id]; });
+					trace.LoopSums[id] += i + 1;
+				});
+
+				{
+					std::lock_guard<std::mutex> lock(trace.ThreadsMutex);
+					trace.Threads.insert(std::this_thread::get_id());
+				}
+				trace.Finish[id] = trace.Clock++;
+			});
+		}
+		for(const auto& edge : edges)
+			graph.Precede(edge.first, edge.second);
+
+		const int loopSum = LoopSize*(LoopSize + 1)/2;
+		const int innerCalls = 8*((LoopSize + 15)/16);
+		for(int run = 0; run < RunCount; ++run)
+		{
+			trace.Reset();
+			graph.Run(scheduler);
+
+			bool once = true, loops = true, finished = true;
+			for(int id = 0; id < taskCount; ++id)
+			{
+				once = once && trace.Runs[id] == 1;
+				loops = loops && trace.LoopSums[id] == loopSum && trace.InnerCalls[id] == (id % 2 == 0 ? innerCalls : 0);
+				finished = finished && trace.Finish[id] >= 0;
+			}
+			Check(once, "every task runs exactly once", workerCount, run);
+			Check(loops, "nested ParallelFor covers its range once", workerCount, run);
+			Check(finished, "Run returns after every task finished", workerCount, run);
+
+			for(const auto& edge : edges)
+			{
+				if(!(trace.Finish[edge.first] < trace.Start[edge.second]))
+				{
+					std::printf("  task %d started before task %d finished\n", edge.second, edge.first);
+					Check(false, "edge order", workerCount, run);
+				}
+			}
+
+			if(gFailures > 20)
+				return;
+		}
+
+		std::printf("graph: %u workers, %d runs, tasks ran on %d threads\n", workerCount, RunCount, (int)trace.Threads.size());
+	}
+
+	// Each task submits two children until depth reaches 0.
+	void FanOut(TaskScheduler& scheduler, std::atomic<int>& pending, std::atomic<int>& ran, int depth)
+	{
+		++ran;
+		if(depth > 0)
+		{
+			for(int c = 0; c < 2; ++c)
+			{
+				++pending;
+				scheduler.Submit([&scheduler, &pending, &ran, depth]()
+				{
+					FanOut(scheduler, pending, ran, depth - 1);
+					--pending;
+				});
+			}
+		}
+	}
+
+	void RunSubmitWait(unsigned workerCount)
+	{
+		TaskScheduler scheduler(workerCount);
+		const int depth = 10;
+		const int expected = (1 << (depth + 1)) - 1;
+
+		for(int run = 0; run < RunCount / 10; ++run)
+		{
+			std::atomic<int> pending{ 0 };
+			std::atomic<int> ran{ 0 };
+			FanOut(scheduler, pending, ran, depth);
+			scheduler.Wait(pending);
+			Check(ran == expected && pending == 0, "Submit/Wait runs every submitted task", workerCount, run);
+		}
+	}
+}
+
+int main()
+{
+	const unsigned workerCounts[] = { 1, 3, 7 };
+	for(unsigned workers : workerCounts)
+	{
+		RunGraphs(workers);
+		RunSubmitWait(workers);
+	}
+
+	if(gFailures != 0)
+	{
+		std::printf("%d failures\n", gFailures);
+		return 1;
+	}
+	std::printf("every edge held in every run\n");
+	return 0;
+}
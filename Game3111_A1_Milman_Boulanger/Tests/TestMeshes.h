@@ -0,0 +1,218 @@
+//***************************************************************************************
+// TestMeshes.h
+//
+// Meshes for the MeshOptimizer tests, in GeometryGenerator's vertex layout (position,
+// normal, tangent, texture coordinates: 11 floats) but without DirectXMath.  Like the
+// generator's shapes, the sphere and torus repeat their seam vertices with different
+// texture coordinates and the box repeats its corners per face.
+//***************************************************************************************
+
+#ifndef TESTMESHES_H
+#define TESTMESHES_H
+
+#include <cmath>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+namespace TestMeshes
+{
+	const int FloatsPerVertex = 11;
+	const float Pi = 3.1415926535f;
+
+	struct Mesh
+	{
+		std::vector<float> Vertices;
+		std::vector<std::uint32_t> Indices;
+
+		std::size_t VertexCount()const { return Vertices.size() / FloatsPerVertex; }
+		const float* Vertex(std::uint32_t v)const { return &Vertices[v*FloatsPerVertex]; }
+
+		void AddVertex(float px, float py, float pz, float nx, float ny, float nz, float u, float v)
+		{
+			const float vertex[FloatsPerVertex] = { px, py, pz, nx, ny, nz, 1.0f, 0.0f, 0.0f, u, v };
+			Vertices.insert(Vertices.end(), vertex, vertex + FloatsPerVertex);
+		}
+
+		void AddTriangle(std::uint32_t a, std::uint32_t b, std::uint32_t c)
+		{
+			Indices.push_back(a);
+			Indices.push_back(b);
+			Indices.push_back(c);
+		}
+	};
+
+	// An m x n vertex grid in the xz plane, centered on the origin, raised by height.
+	inline Mesh Grid(float width, float depth, int m, int n,
+		const std::function<float(float, float)>& height = nullptr)
+	{
+		Mesh mesh;
+		for(int i = 0; i < m; ++i)
+		{
+			float z = 0.5f*depth - i*depth/(m - 1);
+			for(int j = 0; j < n; ++j)
+			{
+				float x = -0.5f*width + j*width/(n - 1);
+				float y = height ? height(x, z) : 0.0f;
+				mesh.AddVertex(x, y, z, 0.0f, 1.0f, 0.0f, (float)j/(n - 1), (float)i/(m - 1));
+			}
+		}
+		for(int i = 0; i < m - 1; ++i)
+		{
+			for(int j = 0; j < n - 1; ++j)
+			{
+				std::uint32_t v = (std::uint32_t)(i*n + j);
+				mesh.AddTriangle(v, v + 1, v + n);
+				mesh.AddTriangle(v + n, v + 1, v + n + 1);
+			}
+		}
+		return mesh;
+	}
+
+	// Poles plus stackCount - 1 rings of sliceCount + 1 vertices, the first and last
+	// of each ring at the same position.
+	inline Mesh Sphere(float radius, int sliceCount, int stackCount)
+	{
+		Mesh mesh;
+		mesh.AddVertex(0.0f, radius, 0.0f, 0.0f, 1.0f, 0.0f, 0.0f, 0.0f);
+		for(int i = 1; i < stackCount; ++i)
+		{
+			float phi = i*Pi/stackCount;
+			for(int j = 0; j <= sliceCount; ++j)
+			{
+				float theta = j*2.0f*Pi/sliceCount;
+				float x = std::sin(phi)*std::cos(theta);
+				float y = std::cos(phi);
+				float z = std::sin(phi)*std::sin(theta);
+				mesh.AddVertex(radius*x, radius*y, radius*z, x, y, z, theta/(2.0f*Pi), phi/Pi);
+			}
+		}
+		mesh.AddVertex(0.0f, -radius, 0.0f, 0.0f, -1.0f, 0.0f, 0.0f, 1.0f);
+
+		const std::uint32_t ring = (std::uint32_t)sliceCount + 1;
+		const std::uint32_t south = (std::uint32_t)mesh.VertexCount() - 1;
+		for(std::uint32_t j = 0; j < (std::uint32_t)sliceCount; ++j)
+			mesh.AddTriangle(0, j + 2, j + 1);
+		for(std::uint32_t i = 0; i + 2 < (std::uint32_t)stackCount; ++i)
+		{
+			for(std::uint32_t j = 0; j < (std::uint32_t)sliceCount; ++j)
+			{
+				std::uint32_t a = 1 + i*ring + j;
+				mesh.AddTriangle(a, a + 1, a + ring);
+				mesh.AddTriangle(a + ring, a + 1, a + ring + 1);
+			}
+		}
+		std::uint32_t last = 1 + (std::uint32_t)(stackCount - 2)*ring;
+		for(std::uint32_t j = 0; j < (std::uint32_t)sliceCount; ++j)
+			mesh.AddTriangle(south, last + j, last + j + 1);
+		return mesh;
+	}
+
+	// A ring of sliceCount + 1 tube cross-sections of stackCount + 1 vertices each.
+	inline Mesh Torus(float tubeRadius, float ringRadius, int sliceCount, int stackCount)
+	{
+		Mesh mesh;
+		for(int i = 0; i <= sliceCount; ++i)
+		{
+			float theta = i*2.0f*Pi/sliceCount;
+			for(int j = 0; j <= stackCount; ++j)
+			{
+				float phi = j*2.0f*Pi/stackCount;
+				float nx = std::cos(phi)*std::cos(theta);
+				float ny = std::sin(phi);
+				float nz = std::cos(phi)*std::sin(theta);
+				float r = ringRadius + tubeRadius*std::cos(phi);
+				mesh.AddVertex(r*std::cos(theta), tubeRadius*ny, r*std::sin(theta), nx, ny, nz,
+					(float)i/sliceCount, (float)j/stackCount);
+			}
+		}
+
+		const std::uint32_t ring = (std::uint32_t)stackCount + 1;
+		for(std::uint32_t i = 0; i < (std::uint32_t)sliceCount; ++i)
+		{
+			for(std::uint32_t j = 0; j < (std::uint32_t)stackCount; ++j)
+			{
+				std::uint32_t a = i*ring + j;
+				mesh.AddTriangle(a, a + 1, a + ring);
+				mesh.AddTriangle(a + ring, a + 1, a + ring + 1);
+			}
+		}
+		return mesh;
+	}
+
+	// An axis-aligned cube of half-size 1 whose faces are divisions x divisions grids
+	// with their own vertices and normals, like a subdivided CreateBox.
+	inline Mesh SubdividedBox(int divisions)
+	{
+		Mesh mesh;
+		for(int axis = 0; axis < 3; ++axis)
+		{
+			for(int side = -1; side <= 1; side += 2)
+			{
+				// u and v span the face so that u x v points along the outward normal.
+				int u = (axis + 1) % 3;
+				int v = (axis + 2) % 3;
+				if(side < 0)
+				{
+					int t = u;
+					u = v;
+					v = t;
+				}
+
+				std::uint32_t first = (std::uint32_t)mesh.VertexCount();
+				for(int i = 0; i <= divisions; ++i)
+				{
+					for(int j = 0; j <= divisions; ++j)
+					{
+						float p[3], n[3] = { 0.0f, 0.0f, 0.0f };
+						p[axis] = (float)side;
+						p[u] = -1.0f + 2.0f*j/divisions;
+						p[v] = -1.0f + 2.0f*i/divisions;
+						n[axis] = (float)side;
+						mesh.AddVertex(p[0], p[1], p[2], n[0], n[1], n[2], (float)j/divisions, (float)i/divisions);
+					}
+				}
+
+				const std::uint32_t row = (std::uint32_t)divisions + 1;
+				for(std::uint32_t i = 0; i < (std::uint32_t)divisions; ++i)
+				{
+					for(std::uint32_t j = 0; j < (std::uint32_t)divisions; ++j)
+					{
+						std::uint32_t a = first + i*row + j;
+						mesh.AddTriangle(a, a + 1, a + row + 1);
+						mesh.AddTriangle(a, a + row + 1, a + row);
+					}
+				}
+			}
+		}
+		return mesh;
+	}
+
+	// Every triangle with its own three vertices, as a mesh loaded without an index
+	// buffer would arrive.
+	inline Mesh Unwelded(const Mesh& mesh)
+	{
+		Mesh soup;
+		for(std::uint32_t index : mesh.Indices)
+		{
+			const float* v = mesh.Vertex(index);
+			soup.Vertices.insert(soup.Vertices.end(), v, v + FloatsPerVertex);
+			soup.Indices.push_back((std::uint32_t)soup.Indices.size());
+		}
+		return soup;
+	}
+
+	// Keeps only the positions, so welding closes the seams.
+	inline Mesh PositionsOnly(const Mesh& mesh)
+	{
+		Mesh result = mesh;
+		for(std::size_t v = 0; v < result.VertexCount(); ++v)
+		{
+			for(int k = 3; k < FloatsPerVertex; ++k)
+				result.Vertices[v*FloatsPerVertex + k] = 0.0f;
+		}
+		return result;
+	}
+}
+
+#endif // TESTMESHES_H
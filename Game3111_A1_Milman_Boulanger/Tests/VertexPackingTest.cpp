@@ -0,0 +1,283 @@
+//***************************************************************************************
+// VertexPackingTest.cpp
+//
+// Round-trip error of the packed vertex format:
+//   - positions unpack within half a quantization step of the input,
+//   - octahedral normals within a fixed angle, over random normals (half of them in
+//     the folded z < 0 hemisphere), the axes and the fold edges,
+//   - FloatToHalf rounds to nearest even, including subnormals, overflow, infinities
+//     and NaNs, and every half survives HalfToFloat and back.
+//***************************************************************************************
+
+#include "VertexPacking.h"
+#include <algorithm>
+#include <cfloat>
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include <random>
+
+using namespace VertexPacking;
+
+namespace
+{
+	const double Pi = 3.14159265358979323846;
+
+	// 16-bit octahedral normals measure 0.004 degrees at worst.
+	const float MaxNormalDegrees = 0.01f;
+
+	int gFailures = 0;
+
+	void Check(bool passed, const char* what)
+	{
+		if(!passed)
+		{
+			std::printf("FAIL %s\n", what);
+			++gFailures;
+		}
+	}
+
+	bool IsNanHalf(std::uint16_t h)
+	{
+		return (h & 0x7c00) == 0x7c00 && (h & 0x03ff) != 0;
+	}
+
+	// The half nearest to value, ties to even, found by a binary search over the
+	// ordered non-negative halves: an independent reference for FloatToHalf.
+	std::uint16_t NearestHalf(float value)
+	{
+		std::uint16_t sign = std::signbit(value) ? 0x8000 : 0;
+		double magnitude = std::fabs((double)value);
+
+		// Halfway between the largest half and the next power of two overflows.
+		if(magnitude >= 65520.0)
+			return sign | 0x7c00;
+
+		std::uint16_t lo = 0, hi = 0x7bff;
+		while(lo < hi)
+		{
+			std::uint16_t mid = (std::uint16_t)((lo + hi + 1) / 2);
+			if(HalfToFloat(mid) <= magnitude)
+				lo = mid;
+			else
+				hi = mid - 1;
+		}
+
+		if(lo == 0x7bff)
+			return sign | lo;
+
+		double below = magnitude - HalfToFloat(lo);
+		double above = HalfToFloat((std::uint16_t)(lo + 1)) - magnitude;
+		bool up = above < below || (above == below && (lo & 1) != 0);
+		return sign | (std::uint16_t)(up ? lo + 1 : lo);
+	}
+
+	void TestHalfEdgeCases()
+	{
+		struct Case { float Value; std::uint16_t Half; const char* Name; };
+		const Case cases[] =
+		{
+			{ 0.0f, 0x0000, "+0" },
+			{ -0.0f, 0x8000, "-0" },
+			{ 1.0f, 0x3c00, "1" },
+			{ -2.0f, 0xc000, "-2" },
+			{ 65504.0f, 0x7bff, "largest half" },
+			{ 65519.99f, 0x7bff, "just below overflow" },
+			{ 65520.0f, 0x7c00, "overflow rounds to infinity" },
+			{ 1.0e10f, 0x7c00, "large value" },
+			{ -1.0e10f, 0xfc00, "large negative value" },
+			{ std::ldexp(1.0f, -14), 0x0400, "smallest normal" },
+			{ std::ldexp(1023.0f, -24), 0x03ff, "largest subnormal" },
+			{ std::ldexp(1.0f, -24), 0x0001, "smallest subnormal" },
+			{ std::ldexp(1.0f, -25), 0x0000, "half the smallest subnormal ties to zero" },
+			{ std::ldexp(1.5f, -25), 0x0001, "above the tie rounds up" },
+			{ std::ldexp(3.0f, -25), 0x0002, "subnormal tie rounds to even" },
+			{ std::ldexp(1.0f, -30), 0x0000, "underflow" },
+			{ 1.0f + std::ldexp(1.0f, -11), 0x3c00, "normal tie rounds down to even" },
+			{ 1.0f + std::ldexp(3.0f, -11), 0x3c02, "normal tie rounds up to even" },
+			{ std::ldexp(2047.0f, -25), 0x0400, "rounding carries into the exponent" },
+			{ INFINITY, 0x7c00, "+infinity" },
+			{ -INFINITY, 0xfc00, "-infinity" },
+		};
+
+		for(const Case& c : cases)
+		{
+			std::uint16_t h = FloatToHalf(c.Value);
+			if(h != c.Half)
+				std::printf("  FloatToHalf(%a) = 0x%04x, expected 0x%04x\n", c.Value, h, c.Half);
+			Check(h == c.Half, c.Name);
+		}
+
+		Check(IsNanHalf(FloatToHalf(NAN)), "NaN stays NaN");
+		Check(IsNanHalf(FloatToHalf(-NAN)), "negative NaN stays NaN");
+	}
+
+	void TestHalfRoundTrip()
+	{
+		int failures = 0;
+		for(std::uint32_t h = 0; h <= 0xffff; ++h)
+		{
+			std::uint16_t half = (std::uint16_t)h;
+			std::uint16_t back = FloatToHalf(HalfToFloat(half));
+			if(IsNanHalf(half) ? !IsNanHalf(back) : back != half)
+				++failures;
+		}
+		Check(failures == 0, "every half survives HalfToFloat and FloatToHalf");
+	}
+
+	void TestHalfRounding()
+	{
+		// Random bit patterns cover every exponent; the range of halves gets its own
+		// values so normal and subnormal rounding are hit often.
+		std::mt19937 rng(1);
+		std::uniform_real_distribution<float> inRange(-70000.0f, 70000.0f);
+		int failures = 0;
+		for(int i = 0; i < 1000000; ++i)
+		{
+			float value;
+			if(i & 1)
+			{
+				std::uint32_t bits = rng();
+				std::memcpy(&value, &bits, sizeof(value));
+				if(std::isnan(value))
+					continue;
+			}
+			else
+			{
+				value = inRange(rng)*std::ldexp(1.0f, -(int)(rng() % 30));
+			}
+
+			if(FloatToHalf(value) != NearestHalf(value))
+				++failures;
+		}
+		Check(failures == 0, "FloatToHalf rounds to the nearest half, ties to even");
+	}
+
+	double AngleDegrees(const float a[3], const float b[3])
+	{
+		double cross[3] =
+		{
+			(double)a[1]*b[2] - (double)a[2]*b[1],
+			(double)a[2]*b[0] - (double)a[0]*b[2],
+			(double)a[0]*b[1] - (double)a[1]*b[0]
+		};
+		double sinLength = std::sqrt(cross[0]*cross[0] + cross[1]*cross[1] + cross[2]*cross[2]);
+		double cosLength = (double)a[0]*b[0] + (double)a[1]*b[1] + (double)a[2]*b[2];
+		return std::atan2(sinLength, cosLength)*180.0/Pi;
+	}
+
+	// Encodes and decodes normal (normalized first); returns the angle between them.
+	double OctahedralErrorDegrees(float x, float y, float z)
+	{
+		float length = std::sqrt(x*x + y*y + z*z);
+		float normal[3] = { x / length, y / length, z / length };
+
+		std::int16_t encoded[2];
+		float decoded[3];
+		EncodeOctahedral(normal, encoded);
+		DecodeOctahedral(encoded, decoded);
+
+		float decodedLength = std::sqrt(decoded[0]*decoded[0] + decoded[1]*decoded[1] + decoded[2]*decoded[2]);
+		Check(std::fabs(decodedLength - 1.0f) < 1.0e-5f, "decoded normals are unit length");
+		return AngleDegrees(normal, decoded);
+	}
+
+	void TestOctahedral()
+	{
+		double worst = 0.0;
+
+		// Axes, and the edges and corners where the folded hemisphere meets the upper one.
+		const float special[][3] =
+		{
+			{ 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 },
+			{ 1, 1, 0 }, { -1, 1, 0 }, { 1, -1, 0 }, { -1, -1, 0 },
+			{ 1, 0, -1 }, { -1, 0, -1 }, { 0, 1, -1 }, { 0, -1, -1 },
+			{ 1, 1, -1 }, { -1, 1, -1 }, { 1, -1, -1 }, { -1, -1, -1 },
+			{ 1, 1, 1 }, { 1, 0, -1.0e-6f }, { 0, 1, -1.0e-6f },
+		};
+		for(const auto& n : special)
+			worst = (std::max)(worst, OctahedralErrorDegrees(n[0], n[1], n[2]));
+		Check(worst <= MaxNormalDegrees, "octahedral error on the axes and fold edges");
+
+		std::mt19937 rng(2);
+		std::normal_distribution<float> gaussian;
+		double worstLower = 0.0;
+		for(int i = 0; i < 1000000; ++i)
+		{
+			float x = gaussian(rng), y = gaussian(rng), z = gaussian(rng);
+			double error = OctahedralErrorDegrees(x, y, z);
+			worst = (std::max)(worst, error);
+			if(z < 0.0f)
+				worstLower = (std::max)(worstLower, error);
+		}
+		std::printf("octahedral: worst %.5f degrees, %.5f in the folded hemisphere\n", worst, worstLower);
+		Check(worst <= MaxNormalDegrees, "octahedral error on random normals");
+	}
+
+	void TestPositions()
+	{
+		std::mt19937 rng(3);
+		std::uniform_real_distribution<float> unit(0.0f, 1.0f);
+
+		// Boxes from submesh-sized to scene-sized, one of them flat on an axis.
+		const float boxes[][6] =
+		{
+			{ 0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f },
+			{ 1.0f, 2.0f, 3.0f, 500.0f, 0.0f, 2.0f },
+			{ -450.0f, 12.0f, 8.0f, 63.5f, 40.0f, 1.0e-3f },
+			{ 1000.0f, -1000.0f, 0.0f, 0.25f, 4096.0f, 10.0f },
+		};
+
+		for(const auto& box : boxes)
+		{
+			PositionQuantization q = QuantizationFromBox(&box[0], &box[3]);
+
+			PackingError error;
+			bool withinStep = true;
+			for(int i = 0; i < 100000; ++i)
+			{
+				float position[3];
+				for(int a = 0; a < 3; ++a)
+					position[a] = q.Offset[a] + q.Scale[a]*unit(rng);
+				const float normal[3] = { 0.0f, 1.0f, 0.0f };
+				const float texC[2] = { unit(rng), unit(rng) };
+
+				PackedVertex packed;
+				Pack(position, normal, texC, q, packed);
+
+				float p[3], n[3], t[2];
+				Unpack(packed, q, p, n, t);
+				for(int a = 0; a < 3; ++a)
+				{
+					// Half a step, plus the float rounding of Offset + Scale*q.
+					float step = q.Scale[a] / 65535.0f;
+					float slack = 4.0f*FLT_EPSILON*((std::fabs)(q.Offset[a]) + q.Scale[a]);
+					if(std::fabs(p[a] - position[a]) > 0.5f*step + slack)
+						withinStep = false;
+				}
+
+				AccumulateError(position, normal, texC, packed, q, error);
+			}
+
+			Check(withinStep, "positions unpack within half a quantization step");
+			Check(error.TexC <= 1.0f/4096.0f, "texture coordinates in [0, 1] are within half a half-float ulp");
+		}
+	}
+}
+
+int main()
+{
+	TestHalfEdgeCases();
+	TestHalfRoundTrip();
+	TestHalfRounding();
+	TestOctahedral();
+	TestPositions();
+
+	if(gFailures != 0)
+	{
+		std::printf("%d failures\n", gFailures);
+		return 1;
+	}
+	std::printf("vertex packing round trips within bounds\n");
+	return 0;
+}
@@ -0,0 +1,174 @@
+//***************************************************************************************
+// WaveKernelsTest.cpp
+//
+// Checks that the SIMD row kernels give bit-identical results to the scalar ones, for
+// the height stencil and the normal pass, at every column count up to a few vector
+// widths so the scalar tails are covered.  Also runs whole Waves simulations with each
+// kernel set on grids whose widths are not a multiple of the vector width.
+//***************************************************************************************
+
+#include "WaveKernels.h"
+#include "Waves.h"
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+	int gFailures = 0;
+
+	void Fail(const char* kernel, const char* pass, int count, int cell)
+	{
+		std::printf("FAIL %s %s: count %d differs from scalar at cell %d\n", kernel, pass, count, cell);
+		++gFailures;
+	}
+
+	unsigned gRandom = 1u;
+
+	// Uniform in [-1, 1).
+	float Random()
+	{
+		gRandom = gRandom*1664525u + 1013904223u;
+		return (float)(gRandom >> 8) / (float)(1u << 23) - 1.0f;
+	}
+
+	void Set(float& dst, float value) { dst = value; }
+	void Set(WaveKernels::Half& dst, float value) { dst = WaveKernels::FloatToHalf(value); }
+
+	// One row and its neighbors, with the extra cell on each side of curr that the
+	// kernels read.
+	template<typename T>
+	struct Rows
+	{
+		explicit Rows(int count)
+			: Prev(count), Curr(count + 2), Up(count), Down(count), ColumnX(count), TexU(count)
+		{
+			for(int j = 0; j < count; ++j)
+			{
+				Set(Prev[j], Random());
+				Set(Up[j], Random());
+				Set(Down[j], Random());
+				ColumnX[j] = 10.0f*Random();
+				TexU[j] = Random();
+			}
+			for(T& h : Curr)
+				Set(h, Random());
+		}
+
+		std::vector<T> Prev;
+		std::vector<T> Curr;
+		std::vector<T> Up;
+		std::vector<T> Down;
+		std::vector<float> ColumnX;
+		std::vector<float> TexU;
+	};
+
+	template<typename T>
+	void CompareKernels(const WaveKernels::KernelSetT<T>& reference, const WaveKernels::KernelSetT<T>* tested)
+	{
+		if(tested == nullptr)
+			return;
+
+		std::printf("%s vs %s\n", tested->Name, reference.Name);
+
+		const float k1 = -0.9990f, k2 = 0.0640f, k3 = 0.4670f;
+		const int maxCount = 4*tested->Width + 3;
+		for(int count = 1; count <= maxCount; ++count)
+		{
+			Rows<T> rows(count);
+
+			std::vector<T> expected = rows.Prev;
+			std::vector<T> actual = rows.Prev;
+			reference.StencilRow(expected.data(), &rows.Curr[1], rows.Up.data(), rows.Down.data(), count, k1, k2, k3);
+			tested->StencilRow(actual.data(), &rows.Curr[1], rows.Up.data(), rows.Down.data(), count, k1, k2, k3);
+			for(int j = 0; j < count; ++j)
+			{
+				if(std::memcmp(&expected[j], &actual[j], sizeof(T)) != 0)
+				{
+					Fail(tested->Name, "stencil", count, j);
+					break;
+				}
+			}
+
+			std::vector<Waves::Vertex> expectedVertices(count);
+			std::vector<Waves::Vertex> actualVertices(count);
+			reference.VertexRow(expectedVertices.data(), &rows.Curr[1], rows.Up.data(), rows.Down.data(),
+				rows.ColumnX.data(), rows.TexU.data(), 3.0f, 0.25f, count, 2.0f);
+			tested->VertexRow(actualVertices.data(), &rows.Curr[1], rows.Up.data(), rows.Down.data(),
+				rows.ColumnX.data(), rows.TexU.data(), 3.0f, 0.25f, count, 2.0f);
+			for(int j = 0; j < count; ++j)
+			{
+				if(std::memcmp(&expectedVertices[j], &actualVertices[j], sizeof(Waves::Vertex)) != 0)
+				{
+					Fail(tested->Name, "vertices", count, j);
+					break;
+				}
+			}
+		}
+	}
+
+	// Steps an m x n grid with the scalar and the tested kernels from the same
+	// disturbances and compares the emitted vertices.
+	void CompareSimulations(const WaveKernels::KernelSet* tested, int m, int n)
+	{
+		if(tested == nullptr)
+			return;
+
+		WaveSolverDesc desc;
+		desc.RestEpsilon = 0.0f;
+		Waves reference(m, n, 0.7f, 0.02f, 4.0f, 0.15f, nullptr, desc);
+		Waves waves(m, n, 0.7f, 0.02f, 4.0f, 0.15f, nullptr, desc);
+		reference.SetKernels(WaveKernels::Scalar());
+		waves.SetKernels(*tested);
+
+		for(int s = 0; s < 300; ++s)
+		{
+			if(s % 7 == 0)
+			{
+				int i = 2 + (int)((Random() + 1.0f)*0.5f*(m - 4));
+				int j = 2 + (int)((Random() + 1.0f)*0.5f*(n - 4));
+				float magnitude = 0.3f*Random();
+				reference.Disturb(i, j, magnitude);
+				waves.Disturb(i, j, magnitude);
+			}
+			reference.Step(1);
+			waves.Step(1);
+		}
+
+		std::vector<Waves::Vertex> expected(reference.VertexCount());
+		std::vector<Waves::Vertex> actual(waves.VertexCount());
+		reference.WriteVertices(expected.data());
+		waves.WriteVertices(actual.data());
+		for(int i = 0; i < reference.VertexCount(); ++i)
+		{
+			if(std::memcmp(&expected[i], &actual[i], sizeof(Waves::Vertex)) != 0)
+			{
+				std::printf("FAIL %s simulation %dx%d: vertex %d differs from scalar\n", tested->Name, m, n, i);
+				++gFailures;
+				return;
+			}
+		}
+	}
+}
+
+int main()
+{
+	CompareKernels(WaveKernels::Scalar(), WaveKernels::Sse());
+	CompareKernels(WaveKernels::Scalar(), WaveKernels::Avx());
+	CompareKernels(WaveKernels::ScalarHalf(), WaveKernels::F16c());
+
+	const int sizes[][2] = { { 37, 42 }, { 131, 137 } };
+	for(const auto& size : sizes)
+	{
+		CompareSimulations(WaveKernels::Sse(), size[0], size[1]);
+		CompareSimulations(WaveKernels::Avx(), size[0], size[1]);
+	}
+
+	if(gFailures != 0)
+	{
+		std::printf("%d failures\n", gFailures);
+		return 1;
+	}
+	std::printf("all kernels match\n");
+	return 0;
+}
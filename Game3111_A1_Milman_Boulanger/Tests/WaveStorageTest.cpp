@@ -0,0 +1,88 @@
+//***************************************************************************************
+// WaveStorageTest.cpp
+//
+// Runs the same disturbances through a Half, a Single and a Double surface for 1M
+// steps and bounds how far the Half and Single heights drift from the Double ones,
+// as relative RMS error.
+//***************************************************************************************
+
+#include "Waves.h"
+#include <cmath>
+#include <cstdio>
+#include <memory>
+
+namespace
+{
+	const int GridSize = 48;
+	const int StepCount = 1000000;
+	const int StepsPerDisturbance = 1000;
+
+	// Measured drift is 4.3e-4 for Single and 5.1e-2 for Half; the bounds leave room
+	// for other compilers' rounding of the constants.
+	const float MaxSingleDrift = 2.0e-3f;
+	const float MaxHalfDrift = 0.15f;
+
+	std::unique_ptr<Waves> MakeSurface(WaveStorage storage)
+	{
+		WaveSolverDesc desc;
+		desc.Storage = storage;
+		desc.RestEpsilon = 0.0f;
+		return std::unique_ptr<Waves>(new Waves(GridSize, GridSize, 1.0f, 0.02f, 4.0f, 0.15f, nullptr, desc));
+	}
+
+	double RelativeRmsDrift(const Waves& waves, const Waves& reference)
+	{
+		double error = 0.0;
+		double energy = 0.0;
+		for(int i = 0; i < reference.VertexCount(); ++i)
+		{
+			double expected = reference.Height(i);
+			double difference = waves.Height(i) - expected;
+			error += difference*difference;
+			energy += expected*expected;
+		}
+		return std::sqrt(error / energy);
+	}
+}
+
+int main()
+{
+	std::unique_ptr<Waves> half = MakeSurface(WaveStorage::Half);
+	std::unique_ptr<Waves> single = MakeSurface(WaveStorage::Single);
+	std::unique_ptr<Waves> reference = MakeSurface(WaveStorage::Double);
+	Waves* surfaces[] = { half.get(), single.get(), reference.get() };
+
+	unsigned state = 9u;
+	for(int s = 0; s < StepCount; s += StepsPerDisturbance)
+	{
+		state = state*1664525u + 1013904223u;
+		int i = (int)(state >> 8) % GridSize;
+		int j = (int)(state >> 16) % GridSize;
+		float magnitude = 0.2f + (float)((state >> 24) % 100) / 500.0f;
+
+		for(Waves* waves : surfaces)
+		{
+			waves->Disturb(i, j, magnitude);
+			waves->Step(StepsPerDisturbance);
+		}
+	}
+
+	double singleDrift = RelativeRmsDrift(*single, *reference);
+	double halfDrift = RelativeRmsDrift(*half, *reference);
+	std::printf("relative RMS drift from double after %d steps: single %.3e, half %.3e\n",
+		StepCount, singleDrift, halfDrift);
+
+	// NaN fails both tests.
+	int failures = 0;
+	if(!(singleDrift <= MaxSingleDrift))
+	{
+		std::printf("FAIL single drift exceeds %.1e\n", MaxSingleDrift);
+		++failures;
+	}
+	if(!(halfDrift <= MaxHalfDrift))
+	{
+		std::printf("FAIL half drift exceeds %.1e\n", MaxHalfDrift);
+		++failures;
+	}
+	return failures == 0 ? 0 : 1;
+}
@@ -55,6 +55,14 @@ public:
         memcpy(&mMappedData[elementIndex*mElementByteSize], &data, sizeof(T));
     }
 
+    // Mapped memory for clients that fill the whole buffer themselves.  Only valid for
+    // non-constant buffers, whose elements are tightly packed.
+    T* MappedData()
+    {
+        assert(!mIsConstantBuffer);
+        return reinterpret_cast<T*>(mMappedData);
+    }
+
 private:
     Microsoft::WRL::ComPtr<ID3D12Resource> mUploadBuffer;
     BYTE* mMappedData = nullptr;
@@ -0,0 +1,195 @@
+//***************************************************************************************
+// VertexPacking.cpp
+//***************************************************************************************
+
+#include "VertexPacking.h"
+#include <cmath>
+#include <cstring>
+
+namespace
+{
+	std::uint32_t FloatBits(float value)
+	{
+		std::uint32_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		return bits;
+	}
+
+	float BitsFloat(std::uint32_t bits)
+	{
+		float value;
+		std::memcpy(&value, &bits, sizeof(value));
+		return value;
+	}
+
+	std::int16_t QuantizeSnorm16(float value)
+	{
+		value = value < -1.0f ? -1.0f : (value > 1.0f ? 1.0f : value);
+		return (std::int16_t)std::lround(value*32767.0f);
+	}
+
+	float DequantizeSnorm16(std::int16_t value)
+	{
+		// As the input assembler does: -32768 and -32767 both decode to -1.
+		float v = value/32767.0f;
+		return v < -1.0f ? -1.0f : v;
+	}
+
+	// -1 for negative values, +1 otherwise, as the decoder's n.xy >= 0 test assumes.
+	float SignNotZero(float value)
+	{
+		return value < 0.0f ? -1.0f : 1.0f;
+	}
+}
+
+namespace VertexPacking
+{
+	PositionQuantization QuantizationFromBox(const float center[3], const float extents[3])
+	{
+		PositionQuantization q;
+		for(int a = 0; a < 3; ++a)
+		{
+			q.Offset[a] = center[a] - extents[a];
+			q.Scale[a] = 2.0f*extents[a];
+		}
+		return q;
+	}
+
+	std::uint16_t FloatToHalf(float value)
+	{
+		std::uint32_t bits = FloatBits(value);
+		std::uint32_t sign = (bits >> 16) & 0x8000;
+		bits &= 0x7fffffff;
+
+		std::uint32_t half;
+		if(bits >= 0x47800000)
+		{
+			// At least 65536, infinity or NaN; NaNs stay quiet NaNs.
+			half = bits > 0x7f800000 ? 0x7e00 : 0x7c00;
+		}
+		else if(bits < 0x38800000)
+		{
+			// Below the smallest normal half.  Adding 0.5 lines the half's mantissa up
+			// with the bottom of the float's, and the addition rounds it to nearest even.
+			const float magic = 0.5f;
+			half = FloatBits(BitsFloat(bits) + magic) - FloatBits(magic);
+		}
+		else
+		{
+			// Rebias the exponent and round the 13 dropped bits to nearest even.  A
+			// carry out of the mantissa correctly bumps the exponent, up to infinity.
+			std::uint32_t mantissaOdd = (bits >> 13) & 1;
+			bits += ((std::uint32_t)(15 - 127) << 23) + 0xfff + mantissaOdd;
+			half = bits >> 13;
+		}
+		return (std::uint16_t)(half | sign);
+	}
+
+	float HalfToFloat(std::uint16_t value)
+	{
+		std::uint32_t sign = (std::uint32_t)(value & 0x8000) << 16;
+		std::uint32_t exponent = (value >> 10) & 0x1f;
+		std::uint32_t mantissa = value & 0x3ff;
+
+		float result;
+		if(exponent == 0)
+			result = std::ldexp((float)mantissa, -24);
+		else if(exponent == 31)
+			result = BitsFloat(0x7f800000 | (mantissa << 13));
+		else
+			result = BitsFloat(((exponent + 127 - 15) << 23) | (mantissa << 13));
+
+		return BitsFloat(FloatBits(result) | sign);
+	}
+
+	void EncodeOctahedral(const float normal[3], std::int16_t encoded[2])
+	{
+		// Project onto the octahedron |x| + |y| + |z| = 1, then fold the lower half
+		// over the upper one.
+		float l1 = std::fabs(normal[0]) + std::fabs(normal[1]) + std::fabs(normal[2]);
+		float x = normal[0] / l1;
+		float y = normal[1] / l1;
+		if(normal[2] < 0.0f)
+		{
+			float foldedX = (1.0f - std::fabs(y))*SignNotZero(x);
+			float foldedY = (1.0f - std::fabs(x))*SignNotZero(y);
+			x = foldedX;
+			y = foldedY;
+		}
+
+		encoded[0] = QuantizeSnorm16(x);
+		encoded[1] = QuantizeSnorm16(y);
+	}
+
+	void DecodeOctahedral(const std::int16_t encoded[2], float normal[3])
+	{
+		// Same steps as DecodeOctahedral in color.hlsl.
+		float x = DequantizeSnorm16(encoded[0]);
+		float y = DequantizeSnorm16(encoded[1]);
+		float z = 1.0f - std::fabs(x) - std::fabs(y);
+		float t = z < 0.0f ? -z : 0.0f;
+		x += x >= 0.0f ? -t : t;
+		y += y >= 0.0f ? -t : t;
+
+		float length = std::sqrt(x*x + y*y + z*z);
+		normal[0] = x / length;
+		normal[1] = y / length;
+		normal[2] = z / length;
+	}
+
+	void Pack(const float position[3], const float normal[3], const float texC[2],
+		const PositionQuantization& quantization, PackedVertex& packed)
+	{
+		for(int a = 0; a < 3; ++a)
+		{
+			// A flat axis has nothing to quantize; it decodes to Offset.
+			float q = 0.0f;
+			if(quantization.Scale[a] > 0.0f)
+				q = (position[a] - quantization.Offset[a]) / quantization.Scale[a];
+			q = q < 0.0f ? 0.0f : (q > 1.0f ? 1.0f : q);
+			packed.Position[a] = (std::uint16_t)std::lround(q*65535.0f);
+		}
+		packed.Position[3] = 0;
+
+		EncodeOctahedral(normal, packed.Normal);
+
+		packed.TexC[0] = FloatToHalf(texC[0]);
+		packed.TexC[1] = FloatToHalf(texC[1]);
+	}
+
+	void Unpack(const PackedVertex& packed, const PositionQuantization& quantization,
+		float position[3], float normal[3], float texC[2])
+	{
+		for(int a = 0; a < 3; ++a)
+			position[a] = quantization.Offset[a] + quantization.Scale[a]*(packed.Position[a]/65535.0f);
+
+		DecodeOctahedral(packed.Normal, normal);
+
+		texC[0] = HalfToFloat(packed.TexC[0]);
+		texC[1] = HalfToFloat(packed.TexC[1]);
+	}
+
+	void AccumulateError(const float position[3], const float normal[3], const float texC[2],
+		const PackedVertex& packed, const PositionQuantization& quantization, PackingError& error)
+	{
+		float p[3], n[3], t[2];
+		Unpack(packed, quantization, p, n, t);
+
+		for(int a = 0; a < 3; ++a)
+			error.Position = std::fmax(error.Position, std::fabs(p[a] - position[a]));
+
+		// atan2 of |cross| and dot stays accurate for the tiny angles expected here.
+		float cross[3] =
+		{
+			n[1]*normal[2] - n[2]*normal[1],
+			n[2]*normal[0] - n[0]*normal[2],
+			n[0]*normal[1] - n[1]*normal[0]
+		};
+		float sinLength = std::sqrt(cross[0]*cross[0] + cross[1]*cross[1] + cross[2]*cross[2]);
+		float cosLength = n[0]*normal[0] + n[1]*normal[1] + n[2]*normal[2];
+		error.NormalRadians = std::fmax(error.NormalRadians, std::atan2(sinLength, cosLength));
+
+		for(int a = 0; a < 2; ++a)
+			error.TexC = std::fmax(error.TexC, std::fabs(t[a] - texC[a]));
+	}
+}
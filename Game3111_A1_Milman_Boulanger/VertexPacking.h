@@ -0,0 +1,66 @@
+//***************************************************************************************
+// VertexPacking.h
+//
+// 16-byte vertex format for static meshes, half the size of the float Vertex layout:
+// - position quantized to 16 bits per axis within a box, normally the bounds of the
+//   submesh, which the vertex shader gets to undo the quantization;
+// - normal octahedral-encoded into two snorm16 values;
+// - texture coordinates as half floats.
+// color.hlsl decodes it when compiled with PACKED_VERTICES.  The conversions are plain
+// C++ so vertex_packing_test can check the round-trip error on the CPU.
+//***************************************************************************************
+
+#ifndef VERTEXPACKING_H
+#define VERTEXPACKING_H
+
+#include <cstdint>
+
+namespace VertexPacking
+{
+	// Matches the PACKED_VERTICES input layout: R16G16B16A16_UNORM position (w is
+	// unused), R16G16_SNORM normal and R16G16_FLOAT texture coordinates.
+	struct PackedVertex
+	{
+		std::uint16_t Position[4];
+		std::int16_t Normal[2];
+		std::uint16_t TexC[2];
+	};
+
+	// Position = Offset + Scale*q with q in [0, 1] per axis.  These are the values the
+	// vertex shader gets.
+	struct PositionQuantization
+	{
+		float Offset[3];
+		float Scale[3];
+	};
+
+	// Quantization covering the box center +- extents.
+	PositionQuantization QuantizationFromBox(const float center[3], const float extents[3]);
+
+	// Round to nearest even, with overflow to infinity and gradual underflow.
+	std::uint16_t FloatToHalf(float value);
+	float HalfToFloat(std::uint16_t value);
+
+	// normal need not be unit length but must not be zero.  Decoding returns a unit vector.
+	void EncodeOctahedral(const float normal[3], std::int16_t encoded[2]);
+	void DecodeOctahedral(const std::int16_t encoded[2], float normal[3]);
+
+	void Pack(const float position[3], const float normal[3], const float texC[2],
+		const PositionQuantization& quantization, PackedVertex& packed);
+	void Unpack(const PackedVertex& packed, const PositionQuantization& quantization,
+		float position[3], float normal[3], float texC[2]);
+
+	// Largest differences seen between vertices and their unpacked versions.
+	struct PackingError
+	{
+		float Position = 0.0f;
+		float NormalRadians = 0.0f;
+		float TexC = 0.0f;
+	};
+
+	// Unpacks packed and folds its differences from the original attributes into error.
+	void AccumulateError(const float position[3], const float normal[3], const float texC[2],
+		const PackedVertex& packed, const PositionQuantization& quantization, PackingError& error);
+}
+
+#endif // VERTEXPACKING_H
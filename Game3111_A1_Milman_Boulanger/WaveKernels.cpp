@@ -0,0 +1,330 @@
+//***************************************************************************************
+// WaveKernels.cpp
+//***************************************************************************************
+
+#include "WaveKernels.h"
+#include "CpuFeatures.h"
+#include <cmath>
+
+namespace
+{
+	using WaveKernels::Half;
+	using WaveKernels::Load;
+	using WaveKernels::Store;
+
+	template<typename T>
+	void StencilRowScalar(T* prev, const T* curr, const T* up, const T* down, int count,
+		typename WaveKernels::Compute<T>::Type k1, typename WaveKernels::Compute<T>::Type k2,
+		typename WaveKernels::Compute<T>::Type k3)
+	{
+		for(int j = 0; j < count; ++j)
+		{
+			Store(prev[j], k1*Load(prev[j]) + k2*Load(curr[j]) +
+				k3*(Load(down[j]) + Load(up[j]) + Load(curr[j+1]) + Load(curr[j-1])));
+		}
+	}
+
+	template<typename T>
+	void VertexRowScalar(Waves::Vertex* dst, const T* curr, const T* up, const T* down,
+		const float* columnX, const float* texU, float rowZ, float texV, int count, float twoDx)
+	{
+		for(int j = 0; j < count; ++j)
+		{
+			float l = (float)Load(curr[j-1]);
+			float r = (float)Load(curr[j+1]);
+			float t = (float)Load(up[j]);
+			float b = (float)Load(down[j]);
+
+			float nx = l - r;
+			float ny = twoDx;
+			float nz = b - t;
+			float invLength = 1.0f / std::sqrt(nx*nx + ny*ny + nz*nz);
+
+			Waves::Vertex& v = dst[j];
+			v.Pos = { columnX[j], (float)Load(curr[j]), rowZ };
+			v.Normal = { nx*invLength, ny*invLength, nz*invLength };
+			v.TexU = texU[j];
+			v.TexV = texV;
+		}
+	}
+
+	// Writes lane k of the SoA normal vectors into vertex k.
+	void ScatterVertices(Waves::Vertex* dst, const float* curr, const float* nx, const float* ny, const float* nz,
+		const float* columnX, const float* texU, float rowZ, float texV, int count)
+	{
+		for(int k = 0; k < count; ++k)
+		{
+			Waves::Vertex& v = dst[k];
+			v.Pos = { columnX[k], curr[k], rowZ };
+			v.Normal = { nx[k], ny[k], nz[k] };
+			v.TexU = texU[k];
+			v.TexV = texV;
+		}
+	}
+
+#if CPU_X86
+	void StencilRowSse(float* prev, const float* curr, const float* up, const float* down,
+		int count, float k1, float k2, float k3)
+	{
+		const __m128 vk1 = _mm_set1_ps(k1);
+		const __m128 vk2 = _mm_set1_ps(k2);
+		const __m128 vk3 = _mm_set1_ps(k3);
+
+		int j = 0;
+		for(; j + 4 <= count; j += 4)
+		{
+			__m128 neighbors = _mm_add_ps(
+				_mm_add_ps(_mm_add_ps(_mm_loadu_ps(down + j), _mm_loadu_ps(up + j)), _mm_loadu_ps(curr + j + 1)),
+				_mm_loadu_ps(curr + j - 1));
+
+			__m128 h = _mm_add_ps(
+				_mm_add_ps(_mm_mul_ps(vk1, _mm_loadu_ps(prev + j)), _mm_mul_ps(vk2, _mm_loadu_ps(curr + j))),
+				_mm_mul_ps(vk3, neighbors));
+
+			_mm_storeu_ps(prev + j, h);
+		}
+
+		StencilRowScalar(prev + j, curr + j, up + j, down + j, count - j, k1, k2, k3);
+	}
+
+	void VertexRowSse(Waves::Vertex* dst, const float* curr, const float* up, const float* down,
+		const float* columnX, const float* texU, float rowZ, float texV, int count, float twoDx)
+	{
+		const __m128 one = _mm_set1_ps(1.0f);
+		const __m128 vTwoDx = _mm_set1_ps(twoDx);
+
+		float x[4], y[4], z[4];
+
+		int j = 0;
+		for(; j + 4 <= count; j += 4)
+		{
+			__m128 l = _mm_loadu_ps(curr + j - 1);
+			__m128 r = _mm_loadu_ps(curr + j + 1);
+			__m128 t = _mm_loadu_ps(up + j);
+			__m128 b = _mm_loadu_ps(down + j);
+
+			__m128 nx = _mm_sub_ps(l, r);
+			__m128 ny = vTwoDx;
+			__m128 nz = _mm_sub_ps(b, t);
+			__m128 lengthSq = _mm_add_ps(_mm_add_ps(_mm_mul_ps(nx, nx), _mm_mul_ps(ny, ny)), _mm_mul_ps(nz, nz));
+			__m128 invLength = _mm_div_ps(one, _mm_sqrt_ps(lengthSq));
+			_mm_storeu_ps(x, _mm_mul_ps(nx, invLength));
+			_mm_storeu_ps(y, _mm_mul_ps(ny, invLength));
+			_mm_storeu_ps(z, _mm_mul_ps(nz, invLength));
+			ScatterVertices(dst + j, curr + j, x, y, z, columnX + j, texU + j, rowZ, texV, 4);
+		}
+
+		VertexRowScalar(dst + j, curr + j, up + j, down + j, columnX + j, texU + j, rowZ, texV, count - j, twoDx);
+	}
+
+	CPU_TARGET_AVX
+	void StencilRowAvx(float* prev, const float* curr, const float* up, const float* down,
+		int count, float k1, float k2, float k3)
+	{
+		const __m256 vk1 = _mm256_set1_ps(k1);
+		const __m256 vk2 = _mm256_set1_ps(k2);
+		const __m256 vk3 = _mm256_set1_ps(k3);
+
+		int j = 0;
+		for(; j + 8 <= count; j += 8)
+		{
+			__m256 neighbors = _mm256_add_ps(
+				_mm256_add_ps(_mm256_add_ps(_mm256_loadu_ps(down + j), _mm256_loadu_ps(up + j)), _mm256_loadu_ps(curr + j + 1)),
+				_mm256_loadu_ps(curr + j - 1));
+
+			__m256 h = _mm256_add_ps(
+				_mm256_add_ps(_mm256_mul_ps(vk1, _mm256_loadu_ps(prev + j)), _mm256_mul_ps(vk2, _mm256_loadu_ps(curr + j))),
+				_mm256_mul_ps(vk3, neighbors));
+
+			_mm256_storeu_ps(prev + j, h);
+		}
+
+		// The tail stays in this function so it is VEX encoded; calling the SSE-encoded
+		// scalar kernel with dirty upper YMM state costs a transition penalty per row.
+		for(; j < count; ++j)
+		{
+			prev[j] = k1*prev[j] + k2*curr[j] + k3*(down[j] + up[j] + curr[j+1] + curr[j-1]);
+		}
+
+		_mm256_zeroupper();
+	}
+
+	CPU_TARGET_AVX
+	void VertexRowAvx(Waves::Vertex* dst, const float* curr, const float* up, const float* down,
+		const float* columnX, const float* texU, float rowZ, float texV, int count, float twoDx)
+	{
+		const __m256 one = _mm256_set1_ps(1.0f);
+		const __m256 vTwoDx = _mm256_set1_ps(twoDx);
+
+		float x[8], y[8], z[8];
+
+		int j = 0;
+		for(; j + 8 <= count; j += 8)
+		{
+			__m256 l = _mm256_loadu_ps(curr + j - 1);
+			__m256 r = _mm256_loadu_ps(curr + j + 1);
+			__m256 t = _mm256_loadu_ps(up + j);
+			__m256 b = _mm256_loadu_ps(down + j);
+
+			__m256 nx = _mm256_sub_ps(l, r);
+			__m256 ny = vTwoDx;
+			__m256 nz = _mm256_sub_ps(b, t);
+			__m256 lengthSq = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, nx), _mm256_mul_ps(ny, ny)), _mm256_mul_ps(nz, nz));
+			__m256 invLength = _mm256_div_ps(one, _mm256_sqrt_ps(lengthSq));
+			_mm256_storeu_ps(x, _mm256_mul_ps(nx, invLength));
+			_mm256_storeu_ps(y, _mm256_mul_ps(ny, invLength));
+			_mm256_storeu_ps(z, _mm256_mul_ps(nz, invLength));
+			ScatterVertices(dst + j, curr + j, x, y, z, columnX + j, texU + j, rowZ, texV, 8);
+		}
+
+		_mm256_zeroupper();
+		VertexRowScalar(dst + j, curr + j, up + j, down + j, columnX + j, texU + j, rowZ, texV, count - j, twoDx);
+	}
+
+	CPU_TARGET_F16C
+	inline __m256 LoadHalf8(const Half* src)
+	{
+		return _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(src)));
+	}
+
+	CPU_TARGET_F16C
+	void StencilRowF16c(Half* prev, const Half* curr, const Half* up, const Half* down,
+		int count, float k1, float k2, float k3)
+	{
+		const __m256 vk1 = _mm256_set1_ps(k1);
+		const __m256 vk2 = _mm256_set1_ps(k2);
+		const __m256 vk3 = _mm256_set1_ps(k3);
+
+		int j = 0;
+		for(; j + 8 <= count; j += 8)
+		{
+			__m256 neighbors = _mm256_add_ps(
+				_mm256_add_ps(_mm256_add_ps(LoadHalf8(down + j), LoadHalf8(up + j)), LoadHalf8(curr + j + 1)),
+				LoadHalf8(curr + j - 1));
+
+			__m256 h = _mm256_add_ps(
+				_mm256_add_ps(_mm256_mul_ps(vk1, LoadHalf8(prev + j)), _mm256_mul_ps(vk2, LoadHalf8(curr + j))),
+				_mm256_mul_ps(vk3, neighbors));
+
+			// Round to nearest even, like FloatToHalf.
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(prev + j), _mm256_cvtps_ph(h, 0));
+		}
+
+		_mm256_zeroupper();
+		StencilRowScalar(prev + j, curr + j, up + j, down + j, count - j, k1, k2, k3);
+	}
+
+	CPU_TARGET_F16C
+	void VertexRowF16c(Waves::Vertex* dst, const Half* curr, const Half* up, const Half* down,
+		const float* columnX, const float* texU, float rowZ, float texV, int count, float twoDx)
+	{
+		const __m256 one = _mm256_set1_ps(1.0f);
+		const __m256 vTwoDx = _mm256_set1_ps(twoDx);
+
+		float h[8], x[8], y[8], z[8];
+
+		int j = 0;
+		for(; j + 8 <= count; j += 8)
+		{
+			__m256 l = LoadHalf8(curr + j - 1);
+			__m256 r = LoadHalf8(curr + j + 1);
+			__m256 t = LoadHalf8(up + j);
+			__m256 b = LoadHalf8(down + j);
+
+			__m256 nx = _mm256_sub_ps(l, r);
+			__m256 ny = vTwoDx;
+			__m256 nz = _mm256_sub_ps(b, t);
+			__m256 lengthSq = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(nx, nx), _mm256_mul_ps(ny, ny)), _mm256_mul_ps(nz, nz));
+			__m256 invLength = _mm256_div_ps(one, _mm256_sqrt_ps(lengthSq));
+			_mm256_storeu_ps(h, LoadHalf8(curr + j));
+			_mm256_storeu_ps(x, _mm256_mul_ps(nx, invLength));
+			_mm256_storeu_ps(y, _mm256_mul_ps(ny, invLength));
+			_mm256_storeu_ps(z, _mm256_mul_ps(nz, invLength));
+			ScatterVertices(dst + j, h, x, y, z, columnX + j, texU + j, rowZ, texV, 8);
+		}
+
+		_mm256_zeroupper();
+		VertexRowScalar(dst + j, curr + j, up + j, down + j, columnX + j, texU + j, rowZ, texV, count - j, twoDx);
+	}
+#endif
+}
+
+namespace WaveKernels
+{
+	const KernelSet& Scalar()
+	{
+		static const KernelSet kernels = { "scalar", 1, StencilRowScalar<float>, VertexRowScalar<float> };
+		return kernels;
+	}
+
+	const KernelSet* Sse()
+	{
+#if CPU_X86
+		static const KernelSet kernels = { "sse", 4, StencilRowSse, VertexRowSse };
+		return CpuFeatures::HasSse2() ? &kernels : nullptr;
+#else
+		return nullptr;
+#endif
+	}
+
+	const KernelSet* Avx()
+	{
+#if CPU_X86
+		static const KernelSet kernels = { "avx", 8, StencilRowAvx, VertexRowAvx };
+		return CpuFeatures::HasAvx() ? &kernels : nullptr;
+#else
+		return nullptr;
+#endif
+	}
+
+	const KernelSet& Best()
+	{
+		if(const KernelSet* avx = Avx())
+			return *avx;
+		if(const KernelSet* sse = Sse())
+			return *sse;
+		return Scalar();
+	}
+
+	const KernelSetT<Half>& ScalarHalf()
+	{
+		static const KernelSetT<Half> kernels = { "scalar-half", 1, StencilRowScalar<Half>, VertexRowScalar<Half> };
+		return kernels;
+	}
+
+	const KernelSetT<Half>* F16c()
+	{
+#if CPU_X86
+		static const KernelSetT<Half> kernels = { "f16c", 8, StencilRowF16c, VertexRowF16c };
+		return CpuFeatures::HasF16c() ? &kernels : nullptr;
+#else
+		return nullptr;
+#endif
+	}
+
+	const KernelSetT<double>& ScalarDouble()
+	{
+		static const KernelSetT<double> kernels = { "scalar-double", 1, StencilRowScalar<double>, VertexRowScalar<double> };
+		return kernels;
+	}
+
+	template<>
+	const KernelSetT<float>& BestFor<float>()
+	{
+		return Best();
+	}
+
+	template<>
+	const KernelSetT<Half>& BestFor<Half>()
+	{
+		if(const KernelSetT<Half>* f16c = F16c())
+			return *f16c;
+		return ScalarHalf();
+	}
+
+	template<>
+	const KernelSetT<double>& BestFor<double>()
+	{
+		return ScalarDouble();
+	}
+}
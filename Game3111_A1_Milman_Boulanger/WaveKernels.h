@@ -0,0 +1,163 @@
+//***************************************************************************************
+// WaveKernels.h
+//
+// Row kernels used by Waves::Update and Waves::WriteVertices.  Each kernel has a scalar version and SSE/AVX
+// versions; Best() picks the widest one the CPU supports at runtime.  The SIMD
+// versions perform exactly the same IEEE operations in the same order as the scalar
+// code (no FMA contraction), so all variants produce bit-identical results.
+//
+// The kernels are written for each height storage type (see WaveStorage): float has
+// SSE/AVX versions, half has an F16C version and double only a scalar one.
+//***************************************************************************************
+
+#ifndef WAVEKERNELS_H
+#define WAVEKERNELS_H
+
+#include "Waves.h"
+#include <cstdint>
+#include <cstring>
+
+namespace WaveKernels
+{
+	// IEEE 754 binary16 storage.  Values are widened to float for arithmetic and
+	// rounded to nearest even when stored.
+	struct Half
+	{
+		std::uint16_t Bits;
+	};
+
+	inline float HalfToFloat(Half h)
+	{
+		const std::uint32_t shiftedExp = 0x7c00u << 13;
+
+		std::uint32_t bits = (std::uint32_t)(h.Bits & 0x7fff) << 13;
+		std::uint32_t exp = bits & shiftedExp;
+		bits += (127 - 15) << 23;
+
+		float f;
+		if(exp == shiftedExp)
+		{
+			// Inf/NaN
+			bits += (128 - 16) << 23;
+			std::memcpy(&f, &bits, sizeof(f));
+		}
+		else if(exp == 0)
+		{
+			// Zero/denormal: renormalize through the FPU.
+			const std::uint32_t magicBits = 113u << 23;
+			float magic;
+			std::memcpy(&magic, &magicBits, sizeof(magic));
+			bits += 1u << 23;
+			std::memcpy(&f, &bits, sizeof(f));
+			f -= magic;
+		}
+		else
+		{
+			std::memcpy(&f, &bits, sizeof(f));
+		}
+
+		std::uint32_t sign = (std::uint32_t)(h.Bits & 0x8000) << 16;
+		std::memcpy(&bits, &f, sizeof(bits));
+		bits |= sign;
+		std::memcpy(&f, &bits, sizeof(f));
+		return f;
+	}
+
+	inline Half FloatToHalf(float value)
+	{
+		std::uint32_t bits;
+		std::memcpy(&bits, &value, sizeof(bits));
+		std::uint32_t sign = bits & 0x80000000u;
+		bits ^= sign;
+
+		Half h;
+		if(bits >= 0x47800000u)
+		{
+			// Too large for a half: Inf, or NaN if it already was one.
+			h.Bits = bits > 0x7f800000u ? 0x7e00 : 0x7c00;
+		}
+		else if(bits < 0x38800000u)
+		{
+			// Result is a denormal or zero; adding 0.5 lets the FPU do the rounding.
+			const std::uint32_t magicBits = 126u << 23;
+			float f, magic;
+			std::memcpy(&f, &bits, sizeof(f));
+			std::memcpy(&magic, &magicBits, sizeof(magic));
+			f += magic;
+			std::memcpy(&bits, &f, sizeof(bits));
+			h.Bits = (std::uint16_t)(bits - magicBits);
+		}
+		else
+		{
+			// Rebias the exponent and round the mantissa to nearest even.
+			std::uint32_t mantissaOdd = (bits >> 13) & 1;
+			bits += ((std::uint32_t)(15 - 127) << 23) + 0xfff;
+			bits += mantissaOdd;
+			h.Bits = (std::uint16_t)(bits >> 13);
+		}
+
+		h.Bits |= (std::uint16_t)(sign >> 16);
+		return h;
+	}
+
+	// Arithmetic type for a storage type.
+	template<typename T> struct Compute { typedef float Type; };
+	template<> struct Compute<double> { typedef double Type; };
+
+	inline float Load(float x) { return x; }
+	inline double Load(double x) { return x; }
+	inline float Load(Half x) { return HalfToFloat(x); }
+
+	inline void Store(float& dst, float x) { dst = x; }
+	inline void Store(double& dst, double x) { dst = x; }
+	inline void Store(Half& dst, float x) { dst = FloatToHalf(x); }
+
+	// Updates count cells in place:
+	//   prev[j] = k1*prev[j] + k2*curr[j] + k3*(down[j] + up[j] + curr[j+1] + curr[j-1])
+	// curr[-1] and curr[count] must be readable.
+	template<typename T>
+	using StencilRowFnT = void (*)(T* prev, const T* curr, const T* up, const T* down, int count,
+		typename Compute<T>::Type k1, typename Compute<T>::Type k2, typename Compute<T>::Type k3);
+
+	// Emits count vertices: position (columnX[j], curr[j], rowZ), the unit finite-difference
+	// normal and texcoords (texU[j], texV).  curr[-1] and curr[count] must be readable.
+	template<typename T>
+	using VertexRowFnT = void (*)(Waves::Vertex* dst, const T* curr, const T* up, const T* down,
+		const float* columnX, const float* texU, float rowZ, float texV, int count, float twoDx);
+
+	template<typename T>
+	struct KernelSetT
+	{
+		const char* Name;
+		int Width; // cells per instruction
+		StencilRowFnT<T> StencilRow;
+		VertexRowFnT<T> VertexRow;
+	};
+
+	typedef StencilRowFnT<float> StencilRowFn;
+	typedef VertexRowFnT<float> VertexRowFn;
+	typedef KernelSetT<float> KernelSet;
+
+	const KernelSet& Scalar();
+
+	// Returns nullptr when the CPU (or target) does not support the instruction set.
+	const KernelSet* Sse();
+	const KernelSet* Avx();
+
+	// Widest supported kernel set.
+	const KernelSet& Best();
+
+	const KernelSetT<Half>& ScalarHalf();
+	// AVX + F16C conversions; nullptr when unsupported.
+	const KernelSetT<Half>* F16c();
+
+	const KernelSetT<double>& ScalarDouble();
+
+	// Widest supported kernel set for storage type T.
+	template<typename T> const KernelSetT<T>& BestFor();
+	template<> const KernelSetT<float>& BestFor<float>();
+	template<> const KernelSetT<Half>& BestFor<Half>();
+	template<> const KernelSetT<double>& BestFor<double>();
+}
+
+#endif // WAVEKERNELS_H
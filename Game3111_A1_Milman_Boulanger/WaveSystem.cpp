@@ -0,0 +1,65 @@
+//***************************************************************************************
+// WaveSystem.cpp
+//***************************************************************************************
+
+#include "WaveSystem.h"
+#include "TaskScheduler.h"
+#include <atomic>
+#include <cassert>
+
+WaveSystem::WaveSystem(TaskScheduler* scheduler)
+{
+	mScheduler = scheduler != nullptr ? scheduler : &TaskScheduler::Default();
+}
+
+WaveSystem::~WaveSystem()
+{
+}
+
+int WaveSystem::AddSurface(int m, int n, float dx, float dt, float speed, float damping,
+	const WaveSolverDesc& solver)
+{
+	mSurfaces.push_back(std::make_unique<Waves>(m, n, dx, dt, speed, damping, mScheduler, solver));
+	return (int)mSurfaces.size() - 1;
+}
+
+int WaveSystem::SurfaceCount()const
+{
+	return (int)mSurfaces.size();
+}
+
+Waves& WaveSystem::Surface(int index)
+{
+	assert(index >= 0 && index < (int)mSurfaces.size());
+	return *mSurfaces[index];
+}
+
+const Waves& WaveSystem::Surface(int index)const
+{
+	assert(index >= 0 && index < (int)mSurfaces.size());
+	return *mSurfaces[index];
+}
+
+void WaveSystem::SetOutputBufferCount(int count)
+{
+	for(auto& surface : mSurfaces)
+		surface->SetOutputBufferCount(count);
+}
+
+int WaveSystem::Update(float dt)
+{
+	std::atomic<int> steps(0);
+	mScheduler->ParallelFor(0, (int)mSurfaces.size(), [this, dt, &steps](int k)
+	{
+		steps.fetch_add(mSurfaces[k]->Update(dt));
+	});
+	return steps.load();
+}
+
+void WaveSystem::WriteVertices(Waves::Vertex* const* dst)
+{
+	mScheduler->ParallelFor(0, (int)mSurfaces.size(), [this, dst](int k)
+	{
+		mSurfaces[k]->WriteVertices(dst[k]);
+	});
+}
@@ -0,0 +1,49 @@
+//***************************************************************************************
+// WaveSystem.h
+//
+// Owns several independent wave simulations (e.g. one per body of water) and advances
+// them together.  Each frame the surfaces are stepped in one TaskScheduler job whose
+// bodies run the surfaces' own parallel sweeps; nested ParallelFor calls share the
+// same workers, so small surfaces fill in around large ones instead of each paying for
+// a separate fork/join.
+//***************************************************************************************
+
+#ifndef WAVESYSTEM_H
+#define WAVESYSTEM_H
+
+#include "Waves.h"
+#include <memory>
+#include <vector>
+
+class WaveSystem
+{
+public:
+	// All surfaces share scheduler; nullptr uses TaskScheduler::Default().
+	explicit WaveSystem(TaskScheduler* scheduler = nullptr);
+	WaveSystem(const WaveSystem& rhs) = delete;
+	WaveSystem& operator=(const WaveSystem& rhs) = delete;
+	~WaveSystem();
+
+	// Creates a surface and returns its index.  Parameters are those of Waves::Waves.
+	int AddSurface(int m, int n, float dx, float dt, float speed, float damping,
+		const WaveSolverDesc& solver = WaveSolverDesc());
+
+	int SurfaceCount()const;
+	Waves& Surface(int index);
+	const Waves& Surface(int index)const;
+
+	// Waves::SetOutputBufferCount for every surface.
+	void SetOutputBufferCount(int count);
+
+	// Runs Waves::Update(dt) on every surface; returns the total number of steps run.
+	int Update(float dt);
+
+	// Runs Waves::WriteVertices on every surface; dst[k] receives surface k.
+	void WriteVertices(Waves::Vertex* const* dst);
+
+private:
+	TaskScheduler* mScheduler = nullptr;
+	std::vector<std::unique_ptr<Waves>> mSurfaces;
+};
+
+#endif // WAVESYSTEM_H
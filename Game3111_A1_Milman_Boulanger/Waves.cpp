@@ -3,14 +3,51 @@
 //***************************************************************************************
 
 #include "Waves.h"
-#include <ppl.h>
+#include "TaskScheduler.h"
+#include "WaveKernels.h"
 #include <algorithm>
 #include <vector>
-#include <cassert>
+#include <cmath>
 
-using namespace DirectX;
+using WaveKernels::Half;
 
-Waves::Waves(int m, int n, float dx, float dt, float speed, float damping)
+namespace
+{
+	// Views a height plane as elements of its storage type.
+	template<typename T>
+	T* PlaneData(std::vector<unsigned char>& plane)
+	{
+		return reinterpret_cast<T*>(plane.data());
+	}
+
+	template<typename T>
+	const T* PlaneData(const std::vector<unsigned char>& plane)
+	{
+		return reinterpret_cast<const T*>(plane.data());
+	}
+
+	// Float and half storage step with the float constants, double with the double ones.
+	template<typename Real> Real Coefficient(float k, double kDouble);
+	template<> float Coefficient<float>(float k, double) { return k; }
+	template<> double Coefficient<double>(float, double kDouble) { return kDouble; }
+
+	size_t StorageSize(WaveStorage storage)
+	{
+		switch(storage)
+		{
+		case WaveStorage::Half:   return sizeof(Half);
+		case WaveStorage::Double: return sizeof(double);
+		default:                  return sizeof(float);
+		}
+	}
+}
+
+template<> const WaveKernels::KernelSetT<float>& Waves::Kernels<float>()const { return *mKernels; }
+template<> const WaveKernels::KernelSetT<Half>& Waves::Kernels<Half>()const { return *mHalfKernels; }
+template<> const WaveKernels::KernelSetT<double>& Waves::Kernels<double>()const { return *mDoubleKernels; }
+
+Waves::Waves(int m, int n, float dx, float dt, float speed, float damping,
+    TaskScheduler* scheduler, const WaveSolverDesc& solver)
 {
     mNumRows = m;
     mNumCols = n;
@@ -21,33 +58,67 @@ Waves::Waves(int m, int n, float dx, float dt, float speed, float damping)
     mTimeStep = dt;
     mSpatialStep = dx;
 
+    mScheduler = scheduler != nullptr ? scheduler : &TaskScheduler::Default();
+    mKernels = &WaveKernels::BestFor<float>();
+    mHalfKernels = &WaveKernels::BestFor<Half>();
+    mDoubleKernels = &WaveKernels::BestFor<double>();
+
+    mSolver = solver;
+    mSolver.TileSize = std::max(mSolver.TileSize, 1);
+    mSolver.StepsPerTile = std::max(mSolver.StepsPerTile, 1);
+    mSolver.ActivityTileSize = std::max(mSolver.ActivityTileSize, 1);
+    mSolver.RestEpsilon = std::max(mSolver.RestEpsilon, 0.0f);
+
     float d = damping*dt + 2.0f;
     float e = (speed*speed)*(dt*dt) / (dx*dx);
     mK1 = (damping*dt - 2.0f) / d;
     mK2 = (4.0f - 8.0f*e) / d;
     mK3 = (2.0f*e) / d;
 
-    mPrevSolution.resize(m*n);
-    mCurrSolution.resize(m*n);
-    mNormals.resize(m*n);
-    mTangentX.resize(m*n);
+    double dd = (double)damping*dt + 2.0;
+    double ed = ((double)speed*speed)*((double)dt*dt) / ((double)dx*dx);
+    mK1Double = ((double)damping*dt - 2.0) / dd;
+    mK2Double = (4.0 - 8.0*ed) / dd;
+    mK3Double = (2.0*ed) / dd;
+
+    // All-zero bytes are +0 in every storage type.
+    size_t planeBytes = (size_t)m*n*StorageSize(mSolver.Storage);
+    mPrevHeight.assign(planeBytes, 0);
+    mCurrHeight.assign(planeBytes, 0);
+    if(mSolver.Mode == WaveSolverMode::Tiled)
+    {
+        mNextPrevHeight.assign(planeBytes, 0);
+        mNextCurrHeight.assign(planeBytes, 0);
+
+        int solverTiles = ((m + mSolver.TileSize - 1) / mSolver.TileSize)*((n + mSolver.TileSize - 1) / mSolver.TileSize);
+        mSolverTileSkipped.assign(solverTiles, 1);
+    }
+
+    // The water starts at rest, but nothing has been written to the vertex buffer yet.
+    mTileRows = (m + mSolver.ActivityTileSize - 1) / mSolver.ActivityTileSize;
+    mTileCols = (n + mSolver.ActivityTileSize - 1) / mSolver.ActivityTileSize;
+    mTileActive.assign(mTileRows*mTileCols, 0);
+    mTileUpdate.assign(mTileRows*mTileCols, 0);
+    mTileFramesDirty.assign(mTileRows*mTileCols, mOutputBufferCount);
+
+    // Grid x/z coordinates are implied by (i, j); see Position().
+    mHalfWidth = (n - 1)*dx*0.5f;
+    mHalfDepth = (m - 1)*dx*0.5f;
 
-    // Generate grid vertices in system memory.
+    mColumnX.resize(n);
+    mColumnTexU.resize(n);
+    for(int j = 0; j < n; ++j)
+    {
+        mColumnX[j] = -mHalfWidth + j*dx;
+        mColumnTexU[j] = 0.5f + mColumnX[j] / Width();
+    }
 
-    float halfWidth = (n - 1)*dx*0.5f;
-    float halfDepth = (m - 1)*dx*0.5f;
+    mRowZ.resize(m);
+    mRowTexV.resize(m);
     for(int i = 0; i < m; ++i)
     {
-        float z = halfDepth - i*dx;
-        for(int j = 0; j < n; ++j)
-        {
-            float x = -halfWidth + j*dx;
-
-            mPrevSolution[i*n + j] = XMFLOAT3(x, 0.0f, z);
-            mCurrSolution[i*n + j] = XMFLOAT3(x, 0.0f, z);
-            mNormals[i*n + j] = XMFLOAT3(0.0f, 1.0f, 0.0f);
-            mTangentX[i*n + j] = XMFLOAT3(1.0f, 0.0f, 0.0f);
-        }
+        mRowZ[i] = mHalfDepth - i*dx;
+        mRowTexV[i] = 0.5f - mRowZ[i] / Depth();
     }
 }
 
@@ -85,88 +156,652 @@ float Waves::Depth()const
 	return mNumRows*mSpatialStep;
 }
 
-void Waves::Update(float dt)
+WaveStorage Waves::Storage()const
+{
+	return mSolver.Storage;
+}
+
+void Waves::SetKernels(const WaveKernels::KernelSet& kernels)
+{
+	mKernels = &kernels;
+}
+
+void Waves::SetKernels(const WaveKernels::KernelSetT<Half>& kernels)
+{
+	mHalfKernels = &kernels;
+}
+
+void Waves::SetKernels(const WaveKernels::KernelSetT<double>& kernels)
+{
+	mDoubleKernels = &kernels;
+}
+
+const char* Waves::KernelName()const
+{
+	switch(mSolver.Storage)
+	{
+	case WaveStorage::Half:   return mHalfKernels->Name;
+	case WaveStorage::Double: return mDoubleKernels->Name;
+	default:                  return mKernels->Name;
+	}
+}
+
+float Waves::Height(int i)const
+{
+	switch(mSolver.Storage)
+	{
+	case WaveStorage::Half:   return WaveKernels::Load(PlaneData<Half>(mCurrHeight)[i]);
+	case WaveStorage::Double: return (float)PlaneData<double>(mCurrHeight)[i];
+	default:                  return PlaneData<float>(mCurrHeight)[i];
+	}
+}
+
+void Waves::SetOutputBufferCount(int count)
+{
+	mOutputBufferCount = std::max(count, 1);
+	std::fill(mTileFramesDirty.begin(), mTileFramesDirty.end(), mOutputBufferCount);
+}
+
+WaveActivityStats Waves::ActivityStats()const
+{
+	WaveActivityStats stats;
+	stats.TileCount = (int)mTileActive.size();
+	stats.ActiveTiles = (int)std::count(mTileActive.begin(), mTileActive.end(), 1);
+	stats.UpdatedTiles = mLastUpdatedTiles;
+	stats.EmittedTiles = mLastEmittedTiles;
+	return stats;
+}
+
+float Waves::ActiveTileRatio()const
+{
+	WaveActivityStats stats = ActivityStats();
+	return (float)stats.ActiveTiles / (float)stats.TileCount;
+}
+
+float Waves::MaxAbsHeight()const
+{
+	switch(mSolver.Storage)
+	{
+	case WaveStorage::Half:   return MaxAbsHeightAs<Half>();
+	case WaveStorage::Double: return MaxAbsHeightAs<double>();
+	default:                  return MaxAbsHeightAs<float>();
+	}
+}
+
+template<typename T>
+float Waves::MaxAbsHeightAs()const
 {
-	static float t = 0;
+	const int tileSize = mSolver.ActivityTileSize;
+	const T* currPlane = PlaneData<T>(mCurrHeight);
+
+	// One maximum per row of tiles, combined afterwards.
+	std::vector<float> tileRowMax(mTileRows, 0.0f);
+	mScheduler->ParallelFor(0, mTileRows, [&](int tr)
+	{
+		int i0 = tr*tileSize;
+		int i1 = std::min(i0 + tileSize, mNumRows);
+
+		float maxHeight = 0.0f;
+		for(int tc = 0; tc < mTileCols; ++tc)
+		{
+			if(!mTileActive[tr*mTileCols + tc])
+				continue;
+
+			int j0 = tc*tileSize;
+			int j1 = std::min(j0 + tileSize, mNumCols);
+			for(int i = i0; i < i1; ++i)
+			{
+				const T* curr = &currPlane[i*mNumCols];
+				for(int j = j0; j < j1; ++j)
+					maxHeight = std::max(maxHeight, (float)std::fabs(WaveKernels::Load(curr[j])));
+			}
+		}
+		tileRowMax[tr] = maxHeight;
+	});
+
+	float maxHeight = 0.0f;
+	for(float rowMax : tileRowMax)
+		maxHeight = std::max(maxHeight, rowMax);
+	return maxHeight;
+}
+
+void Waves::SetMaxStepsPerUpdate(int maxSteps)
+{
+	mMaxStepsPerUpdate = std::max(maxSteps, 1);
+}
 
+int Waves::MaxStepsPerUpdate()const
+{
+	return mMaxStepsPerUpdate;
+}
+
+const WaveStepStats& Waves::StepStats()const
+{
+	return mStepStats;
+}
+
+int Waves::Update(float dt)
+{
 	// Accumulate time.
-	t += dt;
+	mTimeAccumulator += dt;
+
+	// Run every step that is due, keeping the remainder for the next frame so the
+	// simulation speed does not depend on the frame rate.
+	float due = std::floor(mTimeAccumulator / mTimeStep);
+	mTimeAccumulator = std::max(mTimeAccumulator - due*mTimeStep, 0.0f);
+
+	int steps = (int)std::min(due, (float)mMaxStepsPerUpdate);
+	int dropped = (int)std::min(due - (float)steps, 1.0e9f);
+
+	mStepStats.LastSteps = steps;
+	mStepStats.LastDropped = dropped;
+	mStepStats.TotalSteps += steps;
+	mStepStats.TotalDropped += dropped;
+
+	if(steps > 0)
+		Step(steps);
+
+	return steps;
+}
+
+void Waves::Step(int stepCount)
+{
+	if(stepCount <= 0)
+		return;
+
+	switch(mSolver.Storage)
+	{
+	case WaveStorage::Half:   StepAs<Half>(stepCount); break;
+	case WaveStorage::Double: StepAs<double>(stepCount); break;
+	default:                  StepAs<float>(stepCount); break;
+	}
+}
+
+template<typename T>
+void Waves::StepAs(int stepCount)
+{
+	ApplyDisturbances<T>();
+
+	if(mSolver.Mode == WaveSolverMode::Tiled)
+	{
+		while(stepCount > 0)
+		{
+			int blockSteps = std::min(stepCount, mSolver.StepsPerTile);
+			BuildUpdateSet(blockSteps);
+			SweepTiles<T>(blockSteps);
+			RefreshActivity<T>();
+			stepCount -= blockSteps;
+		}
+	}
+	else
+	{
+		for(int k = 0; k < stepCount; ++k)
+		{
+			BuildUpdateSet(1);
+			SweepRows<T>();
+			RefreshActivity<T>();
+		}
+	}
+}
+
+void Waves::BuildUpdateSet(int reachCells)
+{
+	// A disturbance travels one cell per step, so after reachCells steps only tiles
+	// within that distance of an active tile can have left rest.
+	const int reach = (reachCells + mSolver.ActivityTileSize - 1) / mSolver.ActivityTileSize;
+
+	std::fill(mTileUpdate.begin(), mTileUpdate.end(), 0);
+	mUpdateList.clear();
+
+	for(int tr = 0; tr < mTileRows; ++tr)
+	{
+		for(int tc = 0; tc < mTileCols; ++tc)
+		{
+			if(!mTileActive[tr*mTileCols + tc])
+				continue;
+
+			for(int r = std::max(tr - reach, 0); r <= std::min(tr + reach, mTileRows - 1); ++r)
+			{
+				for(int c = std::max(tc - reach, 0); c <= std::min(tc + reach, mTileCols - 1); ++c)
+				{
+					unsigned char& update = mTileUpdate[r*mTileCols + c];
+					if(!update)
+					{
+						update = 1;
+						mUpdateList.push_back(r*mTileCols + c);
+					}
+				}
+			}
+		}
+	}
+
+	mLastUpdatedTiles = (int)mUpdateList.size();
+}
+
+template<typename T>
+void Waves::RefreshActivity()
+{
+	const int tileSize = mSolver.ActivityTileSize;
+	const float restEpsilon = mSolver.RestEpsilon;
+	T* prevPlane = PlaneData<T>(mPrevHeight);
+	T* currPlane = PlaneData<T>(mCurrHeight);
 
-	// Only update the simulation at the specified time step.
-	if( t >= mTimeStep )
+	// Tiles outside the update set are at rest and their neighbors are at rest, so
+	// the stencil leaves them exactly zero.  Re-check the rest.
+	mScheduler->ParallelFor(0, (int)mUpdateList.size(), [=](int k)
 	{
-		// Only update interior points; we use zero boundary conditions.
-		concurrency::parallel_for(1, mNumRows - 1, [this](int i)
-		//for(int i = 1; i < mNumRows-1; ++i)
+		int tile = mUpdateList[k];
+		int i0 = (tile / mTileCols)*tileSize;
+		int j0 = (tile % mTileCols)*tileSize;
+		int i1 = std::min(i0 + tileSize, mNumRows);
+		int j1 = std::min(j0 + tileSize, mNumCols);
+
+		// Moving tiles usually fail the test on their first cell.
+		bool active = false;
+		for(int i = i0; i < i1 && !active; ++i)
+		{
+			const T* prev = &prevPlane[i*mNumCols];
+			const T* curr = &currPlane[i*mNumCols];
+			for(int j = j0; j < j1; ++j)
+			{
+				if(std::fabs(WaveKernels::Load(prev[j])) > restEpsilon || std::fabs(WaveKernels::Load(curr[j])) > restEpsilon)
+				{
+					active = true;
+					break;
+				}
+			}
+		}
+
+		if(!active)
 		{
-			for(int j = 1; j < mNumCols-1; ++j)
+			// Snap to rest so the tile can be skipped exactly from now on.
+			for(int i = i0; i < i1; ++i)
 			{
-				// After this update we will be discarding the old previous
-				// buffer, so overwrite that buffer with the new update.
-				// Note how we can do this inplace (read/write to same element) 
-				// because we won't need prev_ij again and the assignment happens last.
-
-				// Note j indexes x and i indexes z: h(x_j, z_i, t_k)
-				// Moreover, our +z axis goes "down"; this is just to 
-				// keep consistent with our row indices going down.
-
-				mPrevSolution[i*mNumCols+j].y = 
-					mK1*mPrevSolution[i*mNumCols+j].y +
-					mK2*mCurrSolution[i*mNumCols+j].y +
-					mK3*(mCurrSolution[(i+1)*mNumCols+j].y + 
-					     mCurrSolution[(i-1)*mNumCols+j].y + 
-					     mCurrSolution[i*mNumCols+j+1].y + 
-						 mCurrSolution[i*mNumCols+j-1].y);
+				std::fill(&prevPlane[i*mNumCols + j0], &prevPlane[i*mNumCols + j1], T());
+				std::fill(&currPlane[i*mNumCols + j0], &currPlane[i*mNumCols + j1], T());
 			}
-		});
+		}
+
+		// Remember whether the tile moved during this pass in mTileUpdate; a tile
+		// that was and still is at rest has not changed.
+		mTileUpdate[tile] = (mTileActive[tile] || active) ? 1 : 0;
+		mTileActive[tile] = active ? 1 : 0;
+	});
+
+	for(int tile : mUpdateList)
+	{
+		if(mTileUpdate[tile])
+			MarkTileDirty(tile / mTileCols, tile % mTileCols);
+	}
+}
+
+void Waves::MarkTileDirty(int tileRow, int tileCol)
+{
+	// Normals on a tile's edge read the neighboring tiles' heights.
+	mTileFramesDirty[tileRow*mTileCols + tileCol] = mOutputBufferCount;
+	if(tileRow > 0)
+		mTileFramesDirty[(tileRow - 1)*mTileCols + tileCol] = mOutputBufferCount;
+	if(tileRow < mTileRows - 1)
+		mTileFramesDirty[(tileRow + 1)*mTileCols + tileCol] = mOutputBufferCount;
+	if(tileCol > 0)
+		mTileFramesDirty[tileRow*mTileCols + tileCol - 1] = mOutputBufferCount;
+	if(tileCol < mTileCols - 1)
+		mTileFramesDirty[tileRow*mTileCols + tileCol + 1] = mOutputBufferCount;
+}
+
+template<typename T>
+void Waves::SweepRows()
+{
+	if(mUpdateList.empty())
+		return;
+
+	const int tileSize = mSolver.ActivityTileSize;
+	const WaveKernels::KernelSetT<T>& kernels = Kernels<T>();
+	T* prevPlane = PlaneData<T>(mPrevHeight);
+	const T* currPlane = PlaneData<T>(mCurrHeight);
+
+	typedef typename WaveKernels::Compute<T>::Type Real;
+	const Real k1 = Coefficient<Real>(mK1, mK1Double);
+	const Real k2 = Coefficient<Real>(mK2, mK2Double);
+	const Real k3 = Coefficient<Real>(mK3, mK3Double);
+
+	// Only update interior points; we use zero boundary conditions.
+	mScheduler->ParallelFor(1, mNumRows - 1, [&](int i)
+	//for(int i = 1; i < mNumRows-1; ++i)
+	{
+		// After this update we will be discarding the old previous
+		// buffer, so overwrite that buffer with the new update.
+		// Note how we can do this inplace (read/write to same element) 
+		// because we won't need prev_ij again and the assignment happens last.
+
+		// Note j indexes x and i indexes z: h(x_j, z_i, t_k)
+		// Moreover, our +z axis goes "down"; this is just to 
+		// keep consistent with our row indices going down.
+		// Runs of consecutive tiles in the update set are swept as one span.
+		const unsigned char* update = &mTileUpdate[(i / tileSize)*mTileCols];
+		for(int tc = 0; tc < mTileCols; )
+		{
+			if(!update[tc])
+			{
+				++tc;
+				continue;
+			}
+
+			int tcEnd = tc + 1;
+			while(tcEnd < mTileCols && update[tcEnd])
+				++tcEnd;
+
+			int j0 = std::max(tc*tileSize, 1);
+			int j1 = std::min(tcEnd*tileSize, mNumCols - 1);
+			if(j1 > j0)
+			{
+				int row = i*mNumCols + j0;
+				kernels.StencilRow(&prevPlane[row], &currPlane[row],
+					&currPlane[row - mNumCols], &currPlane[row + mNumCols],
+					j1 - j0, k1, k2, k3);
+			}
+
+			tc = tcEnd;
+		}
+	});
+
+	// We just overwrote the previous buffer with the new data, so
+	// this data needs to become the current solution and the old
+	// current solution becomes the new previous solution.
+	std::swap(mPrevHeight, mCurrHeight);
+}
+
+template<typename T>
+void Waves::SweepTiles(int stepCount)
+{
+	const int tileSize = mSolver.TileSize;
+	const int tileRows = (mNumRows + tileSize - 1) / tileSize;
+	const int tileCols = (mNumCols + tileSize - 1) / tileSize;
+	const WaveKernels::KernelSetT<T>& kernels = Kernels<T>();
+	const T* prevPlane = PlaneData<T>(mPrevHeight);
+	const T* currPlane = PlaneData<T>(mCurrHeight);
+	T* nextPrevPlane = PlaneData<T>(mNextPrevHeight);
+	T* nextCurrPlane = PlaneData<T>(mNextCurrHeight);
+
+	typedef typename WaveKernels::Compute<T>::Type Real;
+	const Real k1 = Coefficient<Real>(mK1, mK1Double);
+	const Real k2 = Coefficient<Real>(mK2, mK2Double);
+	const Real k3 = Coefficient<Real>(mK3, mK3Double);
+
+	mScheduler->ParallelFor(0, tileRows*tileCols, [&](int tile)
+	{
+		// Tile [i0,i1)x[j0,j1) plus a halo of stepCount cells, clipped to the grid.
+		int i0 = (tile / tileCols)*tileSize;
+		int j0 = (tile % tileCols)*tileSize;
+		int i1 = std::min(i0 + tileSize, mNumRows);
+		int j1 = std::min(j0 + tileSize, mNumCols);
+
+		// Nothing within reach of this tile is moving, so it ends the pass at rest.
+		// The output planes only need clearing the first time it is skipped.
+		const int activityTile = mSolver.ActivityTileSize;
+		bool needed = false;
+		for(int r = i0 / activityTile; r <= (i1 - 1) / activityTile && !needed; ++r)
+		{
+			for(int c = j0 / activityTile; c <= (j1 - 1) / activityTile && !needed; ++c)
+				needed = mTileUpdate[r*mTileCols + c] != 0;
+		}
+
+		if(!needed)
+		{
+			if(!mSolverTileSkipped[tile])
+			{
+				for(int i = i0; i < i1; ++i)
+				{
+					std::fill(&nextPrevPlane[i*mNumCols + j0], &nextPrevPlane[i*mNumCols + j1], T());
+					std::fill(&nextCurrPlane[i*mNumCols + j0], &nextCurrPlane[i*mNumCols + j1], T());
+				}
+				mSolverTileSkipped[tile] = 1;
+			}
+			return;
+		}
+		mSolverTileSkipped[tile] = 0;
+
+		int blockI0 = std::max(i0 - stepCount, 0);
+		int blockJ0 = std::max(j0 - stepCount, 0);
+		int blockI1 = std::min(i1 + stepCount, mNumRows);
+		int blockJ1 = std::min(j1 + stepCount, mNumCols);
+		int pitch = blockJ1 - blockJ0;
+		int blockRows = blockI1 - blockI0;
+
+		static thread_local std::vector<T> prevBlock;
+		static thread_local std::vector<T> currBlock;
+		prevBlock.resize(blockRows*pitch);
+		currBlock.resize(blockRows*pitch);
+
+		for(int i = blockI0; i < blockI1; ++i)
+		{
+			std::copy_n(&prevPlane[i*mNumCols + blockJ0], pitch, &prevBlock[(i - blockI0)*pitch]);
+			std::copy_n(&currPlane[i*mNumCols + blockJ0], pitch, &currBlock[(i - blockI0)*pitch]);
+		}
+
+		T* prev = prevBlock.data();
+		T* curr = currBlock.data();
+		for(int s = 1; s <= stepCount; ++s)
+		{
+			// Cells within s of a halo edge depend on data outside the block, so the valid
+			// region shrinks by one each step.  Grid edges are fixed and never shrink.
+			int lo = blockI0 == 0 ? 1 : blockI0 + s;
+			int hi = blockI1 == mNumRows ? mNumRows - 1 : blockI1 - s;
+			int left = blockJ0 == 0 ? 1 : blockJ0 + s;
+			int right = blockJ1 == mNumCols ? mNumCols - 1 : blockJ1 - s;
+
+			for(int i = lo; i < hi; ++i)
+			{
+				int k = (i - blockI0)*pitch + (left - blockJ0);
+				kernels.StencilRow(&prev[k], &curr[k], &curr[k - pitch], &curr[k + pitch],
+					right - left, k1, k2, k3);
+			}
+
+			std::swap(prev, curr);
+		}
+
+		for(int i = i0; i < i1; ++i)
+		{
+			int k = (i - blockI0)*pitch + (j0 - blockJ0);
+			std::copy_n(&prev[k], j1 - j0, &nextPrevPlane[i*mNumCols + j0]);
+			std::copy_n(&curr[k], j1 - j0, &nextCurrPlane[i*mNumCols + j0]);
+		}
+	});
+
+	std::swap(mPrevHeight, mNextPrevHeight);
+	std::swap(mCurrHeight, mNextCurrHeight);
+}
+
+Waves::Float3 Waves::Normal(int i)const
+{
+	int row = i / mNumCols;
+	int col = i - row*mNumCols;
+	if(row == 0 || row == mNumRows - 1 || col == 0 || col == mNumCols - 1)
+		return { 0.0f, 1.0f, 0.0f };
+
+	float l = Height(i-1);
+	float r = Height(i+1);
+	float t = Height(i-mNumCols);
+	float b = Height(i+mNumCols);
+
+	Float3 n = { l - r, 2.0f*mSpatialStep, b - t };
+	float invLength = 1.0f / std::sqrt(n.x*n.x + n.y*n.y + n.z*n.z);
+	return { n.x*invLength, n.y*invLength, n.z*invLength };
+}
 
-		// We just overwrote the previous buffer with the new data, so
-		// this data needs to become the current solution and the old
-		// current solution becomes the new previous solution.
-		std::swap(mPrevSolution, mCurrSolution);
+Waves::Float3 Waves::TangentX(int i)const
+{
+	int row = i / mNumCols;
+	int col = i - row*mNumCols;
+	if(row == 0 || row == mNumRows - 1 || col == 0 || col == mNumCols - 1)
+		return { 1.0f, 0.0f, 0.0f };
 
-		t = 0.0f; // reset time
+	Float3 t = { 2.0f*mSpatialStep, Height(i+1) - Height(i-1), 0.0f };
+	float invLength = 1.0f / std::sqrt(t.x*t.x + t.y*t.y + t.z*t.z);
+	return { t.x*invLength, t.y*invLength, t.z*invLength };
+}
 
-		//
-		// Compute normals using finite difference scheme.
-		//
-		concurrency::parallel_for(1, mNumRows - 1, [this](int i)
-		//for(int i = 1; i < mNumRows - 1; ++i)
+template<typename T>
+void Waves::WriteFlatVertex(Vertex* dst, int i, int j)const
+{
+	Vertex& v = dst[i*mNumCols + j];
+	v.Pos = { mColumnX[j], (float)WaveKernels::Load(PlaneData<T>(mCurrHeight)[i*mNumCols + j]), mRowZ[i] };
+	v.Normal = { 0.0f, 1.0f, 0.0f };
+	v.TexU = mColumnTexU[j];
+	v.TexV = mRowTexV[i];
+}
+
+template<typename T>
+void Waves::WriteVertexRun(Vertex* dst, int i, int j0, int j1)const
+{
+	// Boundary vertices never move, so they keep the flat normal; interior
+	// normals come from the finite difference scheme in the row kernel.
+	if(i == 0 || i == mNumRows - 1)
+	{
+		for(int j = j0; j < j1; ++j)
+			WriteFlatVertex<T>(dst, i, j);
+		return;
+	}
+
+	if(j0 == 0)
+		WriteFlatVertex<T>(dst, i, j0++);
+
+	int interiorEnd = std::min(j1, mNumCols - 1);
+	if(interiorEnd > j0)
+	{
+		const T* curr = PlaneData<T>(mCurrHeight);
+		int row = i*mNumCols + j0;
+		Kernels<T>().VertexRow(&dst[row], &curr[row],
+			&curr[row - mNumCols], &curr[row + mNumCols],
+			&mColumnX[j0], &mColumnTexU[j0], mRowZ[i], mRowTexV[i],
+			interiorEnd - j0, 2.0f*mSpatialStep);
+	}
+
+	if(j1 == mNumCols)
+		WriteFlatVertex<T>(dst, i, mNumCols - 1);
+}
+
+void Waves::WriteVertices(Vertex* dst)
+{
+	switch(mSolver.Storage)
+	{
+	case WaveStorage::Half:   WriteVerticesAs<Half>(dst); break;
+	case WaveStorage::Double: WriteVerticesAs<double>(dst); break;
+	default:                  WriteVerticesAs<float>(dst); break;
+	}
+}
+
+template<typename T>
+void Waves::WriteVerticesAs(Vertex* dst)
+{
+	const int tileSize = mSolver.ActivityTileSize;
+
+	mScheduler->ParallelFor(0, mNumRows, [this, dst, tileSize](int i)
+	{
+		const int* framesDirty = &mTileFramesDirty[(i / tileSize)*mTileCols];
+		for(int tc = 0; tc < mTileCols; )
 		{
-			for(int j = 1; j < mNumCols-1; ++j)
+			if(framesDirty[tc] == 0)
 			{
-				float l = mCurrSolution[i*mNumCols+j-1].y;
-				float r = mCurrSolution[i*mNumCols+j+1].y;
-				float t = mCurrSolution[(i-1)*mNumCols+j].y;
-				float b = mCurrSolution[(i+1)*mNumCols+j].y;
-				mNormals[i*mNumCols+j].x = -r+l;
-				mNormals[i*mNumCols+j].y = 2.0f*mSpatialStep;
-				mNormals[i*mNumCols+j].z = b-t;
-
-				XMVECTOR n = XMVector3Normalize(XMLoadFloat3(&mNormals[i*mNumCols+j]));
-				XMStoreFloat3(&mNormals[i*mNumCols+j], n);
-
-				mTangentX[i*mNumCols+j] = XMFLOAT3(2.0f*mSpatialStep, r-l, 0.0f);
-				XMVECTOR T = XMVector3Normalize(XMLoadFloat3(&mTangentX[i*mNumCols+j]));
-				XMStoreFloat3(&mTangentX[i*mNumCols+j], T);
+				++tc;
+				continue;
 			}
-		});
+
+			int tcEnd = tc + 1;
+			while(tcEnd < mTileCols && framesDirty[tcEnd] != 0)
+				++tcEnd;
+
+			WriteVertexRun<T>(dst, i, tc*tileSize, std::min(tcEnd*tileSize, mNumCols));
+			tc = tcEnd;
+		}
+	});
+
+	mLastEmittedTiles = 0;
+	for(int& framesDirty : mTileFramesDirty)
+	{
+		if(framesDirty > 0)
+		{
+			--framesDirty;
+			++mLastEmittedTiles;
+		}
 	}
 }
 
 void Waves::Disturb(int i, int j, float magnitude)
 {
 	// Don't disturb boundaries.
-	assert(i > 1 && i < mNumRows-2);
-	assert(j > 1 && j < mNumCols-2);
+	if(mNumRows < 5 || mNumCols < 5)
+		return;
+
+	i = std::min(std::max(i, 2), mNumRows - 3);
+	j = std::min(std::max(j, 2), mNumCols - 3);
+	switch(mSolver.Storage)
+	{
+	case WaveStorage::Half:   AddDisturbance<Half>(i, j, magnitude); break;
+	case WaveStorage::Double: AddDisturbance<double>(i, j, magnitude); break;
+	default:                  AddDisturbance<float>(i, j, magnitude); break;
+	}
+}
+
+void Waves::QueueDisturbances(const WaveDisturbance* disturbances, size_t count)
+{
+	mPendingDisturbances.insert(mPendingDisturbances.end(), disturbances, disturbances + count);
+}
+
+void Waves::QueueDisturbance(int i, int j, float magnitude)
+{
+	WaveDisturbance disturbance;
+	disturbance.Row = i;
+	disturbance.Col = j;
+	disturbance.Magnitude = magnitude;
+	mPendingDisturbances.push_back(disturbance);
+}
+
+int Waves::PendingDisturbanceCount()const
+{
+	return (int)mPendingDisturbances.size();
+}
+
+template<typename T>
+void Waves::ApplyDisturbances()
+{
+	// Impulses may overlap, so they are applied serially; each one is a handful of
+	// adds, which is cheap next to a solver pass even for thousands of them.
+	if(mNumRows >= 5 && mNumCols >= 5)
+	{
+		const int maxRow = mNumRows - 3;
+		const int maxCol = mNumCols - 3;
+		for(const WaveDisturbance& d : mPendingDisturbances)
+		{
+			AddDisturbance<T>(std::min(std::max(d.Row, 2), maxRow), std::min(std::max(d.Col, 2), maxCol), d.Magnitude);
+		}
+	}
 
+	mPendingDisturbances.clear();
+}
+
+template<typename T>
+void Waves::AddDisturbance(int i, int j, float magnitude)
+{
 	float halfMag = 0.5f*magnitude;
 
 	// Disturb the ijth vertex height and its neighbors.
-	mCurrSolution[i*mNumCols+j].y     += magnitude;
-	mCurrSolution[i*mNumCols+j+1].y   += halfMag;
-	mCurrSolution[i*mNumCols+j-1].y   += halfMag;
-	mCurrSolution[(i+1)*mNumCols+j].y += halfMag;
-	mCurrSolution[(i-1)*mNumCols+j].y += halfMag;
+	T* curr = PlaneData<T>(mCurrHeight);
+	auto add = [](T& h, float delta) { WaveKernels::Store(h, WaveKernels::Load(h) + delta); };
+	add(curr[i*mNumCols+j], magnitude);
+	add(curr[i*mNumCols+j+1], halfMag);
+	add(curr[i*mNumCols+j-1], halfMag);
+	add(curr[(i+1)*mNumCols+j], halfMag);
+	add(curr[(i-1)*mNumCols+j], halfMag);
+
+	// The touched cells span at most 2x2 activity tiles.
+	const int tileSize = mSolver.ActivityTileSize;
+	for(int tr = (i - 1) / tileSize; tr <= (i + 1) / tileSize; ++tr)
+	{
+		for(int tc = (j - 1) / tileSize; tc <= (j + 1) / tileSize; ++tc)
+		{
+			mTileActive[tr*mTileCols + tc] = 1;
+			MarkTileDirty(tr, tc);
+		}
+	}
 }
-	
@@ -2,20 +2,120 @@
 // Waves.h by Frank Luna (C) 2011 All Rights Reserved.
 //
 // Performs the calculations for the wave simulation.  After the simulation has been
-// updated, the client must copy the current solution into vertex buffers for rendering.
-// This class only does the calculations, it does not do any drawing.
+// updated, the client calls WriteVertices to emit the current solution straight into
+// a (mapped) vertex buffer.  This class only does the calculations, it does not do
+// any drawing.
+//
+// The solver has no Windows or DirectXMath dependency; row updates are spread over a
+// TaskScheduler, which defaults to TaskScheduler::Default() when none is given.
 //***************************************************************************************
 
 #ifndef WAVES_H
 #define WAVES_H
 
+#include <cstddef>
 #include <vector>
-#include <DirectXMath.h>
+
+class TaskScheduler;
+namespace WaveKernels
+{
+    struct Half;
+    template<typename T> struct KernelSetT;
+    typedef KernelSetT<float> KernelSet;
+}
+
+// Scalar type of the height planes.  Half halves the memory traffic of Single for
+// large decorative surfaces (arithmetic is still done in float); Double is for long
+// runs where drift matters more than speed.
+enum class WaveStorage
+{
+    Half,
+    Single,
+    Double
+};
+
+enum class WaveSolverMode
+{
+    // One parallel sweep over the rows per time step.
+    RowSweep,
+    // Temporally blocked: each tile (plus a halo of StepsPerTile cells) is copied to
+    // a thread-local block and advanced StepsPerTile steps while it sits in cache.
+    // Results are bit-identical to RowSweep when RestEpsilon is 0.
+    // Only worth it once the height planes overflow the last-level cache, around
+    // 4096 columns; at 2048x2048 it is slower than RowSweep (see the "tiled"
+    // section of wave_bench).
+    Tiled
+};
+
+struct WaveSolverDesc
+{
+    // Leave at RowSweep below about 4096 columns, where Tiled is slower.
+    WaveSolverMode Mode = WaveSolverMode::RowSweep;
+    WaveStorage Storage = WaveStorage::Single;
+    int TileSize = 256;
+    int StepsPerTile = 8;
+
+    // Activity tracking: the grid is split into ActivityTileSize^2 tiles and only tiles
+    // within reach of a moving tile are stepped or re-emitted.  A tile whose heights all
+    // stay within RestEpsilon of zero is snapped to rest.  0 keeps the results exact.
+    int ActivityTileSize = 16;
+    float RestEpsilon = 1.0e-4f;
+};
+
+// An impulse added to the height at grid point (Row, Col); half of it also goes to
+// the four neighbors.
+struct WaveDisturbance
+{
+    int Row = 0;
+    int Col = 0;
+    float Magnitude = 0.0f;
+};
+
+struct WaveActivityStats
+{
+    int TileCount = 0;
+    // Tiles currently holding a non-resting height.
+    int ActiveTiles = 0;
+    // Tiles stepped by the most recent solver pass.
+    int UpdatedTiles = 0;
+    // Tiles written by the most recent WriteVertices call.
+    int EmittedTiles = 0;
+};
+
+// Bookkeeping for the fixed-timestep accumulator in Waves::Update.
+struct WaveStepStats
+{
+    // Steps run / dropped by the most recent Update call.
+    int LastSteps = 0;
+    int LastDropped = 0;
+
+    // Totals since construction.
+    long long TotalSteps = 0;
+    long long TotalDropped = 0;
+};
 
 class Waves
 {
 public:
-    Waves(int m, int n, float dx, float dt, float speed, float damping);
+    // Layout-compatible with DirectX::XMFLOAT3.
+    struct Float3
+    {
+        float x;
+        float y;
+        float z;
+    };
+
+    // Layout-compatible with the app's Vertex (position, normal, texcoord).
+    struct Vertex
+    {
+        Float3 Pos;
+        Float3 Normal;
+        float TexU;
+        float TexV;
+    };
+
+    Waves(int m, int n, float dx, float dt, float speed, float damping,
+        TaskScheduler* scheduler = nullptr, const WaveSolverDesc& solver = WaveSolverDesc());
     Waves(const Waves& rhs) = delete;
     Waves& operator=(const Waves& rhs) = delete;
     ~Waves();
@@ -27,19 +127,97 @@ public:
 	float Width()const;
 	float Depth()const;
 
-	// Returns the solution at the ith grid point.
-    const DirectX::XMFLOAT3& Position(int i)const { return mCurrSolution[i]; }
+	// Returns the solution at the ith grid point.  Only heights are stored; x and z
+	// are derived from the grid.
+    Float3 Position(int i)const
+    {
+        int row = i / mNumCols;
+        int col = i - row*mNumCols;
+        return { mColumnX[col], Height(i), mRowZ[row] };
+    }
+
+	// Returns the solution height at the ith grid point.
+    float Height(int i)const;
 
 	// Returns the solution normal at the ith grid point.
-    const DirectX::XMFLOAT3& Normal(int i)const { return mNormals[i]; }
+    Float3 Normal(int i)const;
 
 	// Returns the unit tangent vector at the ith grid point in the local x-axis direction.
-    const DirectX::XMFLOAT3& TangentX(int i)const { return mTangentX[i]; }
+    Float3 TangentX(int i)const;
+
+	WaveStorage Storage()const;
+
+	// Overrides the row kernels picked at construction (WaveKernels::BestFor<T>()),
+	// e.g. to compare a SIMD path against WaveKernels::Scalar().  Only the set matching
+	// Storage() is used.
+	void SetKernels(const WaveKernels::KernelSet& kernels);
+	void SetKernels(const WaveKernels::KernelSetT<WaveKernels::Half>& kernels);
+	void SetKernels(const WaveKernels::KernelSetT<double>& kernels);
+	const char* KernelName()const;
+
+	// Accumulates dt and runs as many fixed time steps as are due, up to
+	// MaxStepsPerUpdate().  Time beyond that budget is discarded (and counted in
+	// StepStats()) so a long frame cannot make the next one even longer.  Returns the
+	// number of steps run.
+	int Update(float dt);
+
+	void SetMaxStepsPerUpdate(int maxSteps);
+	int MaxStepsPerUpdate()const;
+	const WaveStepStats& StepStats()const;
 
-	void Update(float dt);
+	// Advances the simulation exactly stepCount time steps, ignoring the clock.
+	void Step(int stepCount);
+
+	// Writes vertices (position, finite-difference normal and texcoords mapping
+	// [-w/2,w/2] --> [0,1]) into dst in a single parallel pass over the grid.  Only
+	// tiles that changed since dst was last written are emitted, see SetOutputBufferCount.
+	void WriteVertices(Vertex* dst);
+
+	// Applies an impulse immediately.  Points closer than two cells to the boundary
+	// are clamped inward.
 	void Disturb(int i, int j, float magnitude);
 
+	// Queues impulses (from gameplay, rain, projectiles...); they are applied together,
+	// clamped like Disturb, at the start of the next step.  Not safe to call while the
+	// simulation is stepping.
+	void QueueDisturbances(const WaveDisturbance* disturbances, size_t count);
+	void QueueDisturbance(int i, int j, float magnitude);
+	int PendingDisturbanceCount()const;
+
+	// Number of vertex buffers WriteVertices cycles through (e.g. one per frame
+	// resource).  A changed tile is re-emitted that many times so every buffer sees it.
+	// Marks the whole grid dirty.
+	void SetOutputBufferCount(int count);
+
+	WaveActivityStats ActivityStats()const;
+	float ActiveTileRatio()const;
+
+	// Largest |height| on the grid right now, e.g. to bound the surface for culling.
+	// Crests from repeated impulses stack well above any single impulse, so there is
+	// no useful bound to derive from the parameters.  Only tiles not at rest are read;
+	// resting tiles are exactly zero.
+	float MaxAbsHeight()const;
+
 private:
+    // The solver is written once for each storage type T; the public entry points
+    // switch on mSolver.Storage.
+    template<typename T> const WaveKernels::KernelSetT<T>& Kernels()const;
+    template<typename T> void StepAs(int stepCount);
+    template<typename T> void SweepRows();
+    template<typename T> void SweepTiles(int stepCount);
+
+    template<typename T> void ApplyDisturbances();
+    template<typename T> void AddDisturbance(int i, int j, float magnitude);
+
+    // Activity tracking.
+    void BuildUpdateSet(int reachCells);
+    template<typename T> void RefreshActivity();
+    void MarkTileDirty(int tileRow, int tileCol);
+    template<typename T> void WriteVerticesAs(Vertex* dst);
+    template<typename T> void WriteVertexRun(Vertex* dst, int i, int j0, int j1)const;
+    template<typename T> void WriteFlatVertex(Vertex* dst, int i, int j)const;
+    template<typename T> float MaxAbsHeightAs()const;
+
     int mNumRows = 0;
     int mNumCols = 0;
 
@@ -51,13 +229,61 @@ private:
     float mK2 = 0.0f;
     float mK3 = 0.0f;
 
+    // The same constants for double storage.
+    double mK1Double = 0.0;
+    double mK2Double = 0.0;
+    double mK3Double = 0.0;
+
     float mTimeStep = 0.0f;
     float mSpatialStep = 0.0f;
 
-    std::vector<DirectX::XMFLOAT3> mPrevSolution;
-    std::vector<DirectX::XMFLOAT3> mCurrSolution;
-    std::vector<DirectX::XMFLOAT3> mNormals;
-    std::vector<DirectX::XMFLOAT3> mTangentX;
+    // Simulation time not yet consumed by a step.
+    float mTimeAccumulator = 0.0f;
+    int mMaxStepsPerUpdate = 4;
+    WaveStepStats mStepStats;
+
+    float mHalfWidth = 0.0f;
+    float mHalfDepth = 0.0f;
+
+    TaskScheduler* mScheduler = nullptr;
+    const WaveKernels::KernelSet* mKernels = nullptr;
+    const WaveKernels::KernelSetT<WaveKernels::Half>* mHalfKernels = nullptr;
+    const WaveKernels::KernelSetT<double>* mDoubleKernels = nullptr;
+    WaveSolverDesc mSolver;
+
+    // Height planes (structure-of-arrays); the stencil only ever touches y.  Each
+    // holds m*n elements of the mSolver.Storage type.
+    std::vector<unsigned char> mPrevHeight;
+    std::vector<unsigned char> mCurrHeight;
+
+    // Output planes for the tiled solver; tiles read the current planes while other
+    // tiles are still writing, so results cannot be written in place.
+    std::vector<unsigned char> mNextPrevHeight;
+    std::vector<unsigned char> mNextCurrHeight;
+
+    std::vector<WaveDisturbance> mPendingDisturbances;
+
+    // Per activity tile: holds a non-resting height / is stepped this pass / number
+    // of WriteVertices calls that still have to emit it.
+    int mTileRows = 0;
+    int mTileCols = 0;
+    std::vector<unsigned char> mTileActive;
+    std::vector<unsigned char> mTileUpdate;
+    std::vector<int> mUpdateList;
+    std::vector<int> mTileFramesDirty;
+    int mOutputBufferCount = 1;
+    int mLastUpdatedTiles = 0;
+    int mLastEmittedTiles = 0;
+
+    // Per tiled-solver tile: skipped by the last pass, so its region is zero in both
+    // plane pairs and needs no writes while it stays idle.
+    std::vector<unsigned char> mSolverTileSkipped;
+
+    // Per-column x/u and per-row z/v, so emission needs no divisions.
+    std::vector<float> mColumnX;
+    std::vector<float> mColumnTexU;
+    std::vector<float> mRowZ;
+    std::vector<float> mRowTexV;
 };
 
 #endif // WAVES_H
\ No newline at end of file
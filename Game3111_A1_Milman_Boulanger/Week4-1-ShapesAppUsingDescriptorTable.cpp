@@ -11,7 +11,14 @@
 #include "UploadBuffer.h"
 #include "GeometryGenerator.h"
 #include "FrameResource.h"
-#include "Waves.h"
+#include "WaveSystem.h"
+#include "SpatialGrid.h"
+#include "CullKernels.h"
+#include "TaskGraph.h"
+#include "SceneGraph.h"
+#include "RadixSort.h"
+#include "VertexPacking.h"
+#include "MeshBatchBuilder.h"
 #include "Camera.h"
 using Microsoft::WRL::ComPtr;
 using namespace DirectX;
@@ -32,6 +39,71 @@ enum class RenderLayer : int
 	AlphaTestedTreeSprites,
 	Count
 };
+
+// Vertex buffer layouts drawn with color.hlsl.  Packed is VertexPacking::PackedVertex.
+enum class VertexFormat : int
+{
+	Float = 0,
+	Packed,
+	Count
+};
+
+// Independent wave simulations; the order matches WaveSystem::AddSurface.
+enum class WaveSurface : int
+{
+	Moat = 0,
+	Maze,
+	Count
+};
+
+// A surface whose crests outgrow its bounds gets bounds this many times the crest
+// height, so the bounds (and the cull boxes) change on a handful of frames, not every
+// frame.
+static const float WaveBoundSlack = 1.5f;
+
+static Aabb ToAabb(const BoundingBox& box)
+{
+	return AabbFromCenterExtents(&box.Center.x, &box.Extents.x);
+}
+
+static_assert(sizeof(Float4x4) == sizeof(XMFLOAT4X4), "Float4x4 must match XMFLOAT4X4");
+
+static Float4x4 ToFloat4x4(const XMFLOAT4X4& m)
+{
+	Float4x4 r;
+	std::memcpy(r.M, m.m, sizeof(r.M));
+	return r;
+}
+
+static XMFLOAT4X4 ToXMFloat4x4(const Float4x4& m)
+{
+	XMFLOAT4X4 r;
+	std::memcpy(r.m, m.M, sizeof(r.m));
+	return r;
+}
+
+// Packs the vertices of every submesh of geo with positions quantized to the submesh's
+// Bounds.  Vertices no submesh references are left zeroed.  The round-trip error is
+// covered by vertex_packing_test.
+static void PackSubmeshVertices(const MeshGeometry& geo, const std::vector<Vertex>& vertices,
+	const std::uint16_t* indices, std::vector<VertexPacking::PackedVertex>& packed)
+{
+	packed.assign(vertices.size(), VertexPacking::PackedVertex());
+	for(const auto& arg : geo.DrawArgs)
+	{
+		const SubmeshGeometry& submesh = arg.second;
+		VertexPacking::PositionQuantization q = VertexPacking::QuantizationFromBox(
+			&submesh.Bounds.Center.x, &submesh.Bounds.Extents.x);
+
+		for(UINT i = 0; i < submesh.IndexCount; ++i)
+		{
+			UINT index = submesh.BaseVertexLocation + indices[submesh.StartIndexLocation + i];
+			const Vertex& v = vertices[index];
+			VertexPacking::Pack(&v.Pos.x, &v.Normal.x, &v.TexC.x, q, packed[index]);
+		}
+	}
+}
+
 typedef struct DIMOUSESTATE {
 	LONG lX;
 	LONG lY;
@@ -59,6 +131,7 @@ struct RenderItem
     // and scale of the object in the world.
     XMFLOAT4X4 World = MathHelper::Identity4x4();
 
+    // Cached inverse transpose of World, used to transform normals.
     XMFLOAT4X4 TWorld = MathHelper::Identity4x4();
 
     XMFLOAT4X4 TexTransform = MathHelper::Identity4x4();
@@ -83,8 +156,205 @@ struct RenderItem
     UINT StartIndexLocation = 0;
     int BaseVertexLocation = 0;
 	BoundingBox bounds;
+
+	// Bounds of the drawn submesh in object space and world space.  WorldBounds
+	// follows World (see UpdateWorldBounds) and is what mCullBoxes holds.
+	BoundingBox LocalBounds;
+	BoundingBox WorldBounds;
+
+	// Set each frame by CullRenderItems.
+	bool Visible = true;
+
+	// Index in mAllRitems and mCullBoxes.
+	int SceneId = -1;
+
+	// True while the item is on ShapesApp::mDirtyRitems.
+	bool QueuedDirty = false;
+
+	// Scene graph node whose world transform drives World, or -1 if World is set
+	// directly.
+	SceneGraph::NodeId Node = -1;
+
+	// World, TWorld and TexTransform transposed for upload; refreshed with TWorld.
+	ObjectConstants Constants;
+
+	// Layout of Geo's vertex buffer.  Packed positions are quantized to the bounds of
+	// the submesh, LocalBounds or the drawn level's.
+	VertexFormat Format = VertexFormat::Float;
+
+	// Submeshes of the shape from finest to coarsest, the first being the one above, or
+	// nullptr if it has a single level.  Lod is the level drawn this frame.
+	const std::vector<SubmeshGeometry>* Lods = nullptr;
+	UINT Lod = 0;
+};
+
+static void UpdateWorldBounds(RenderItem& ritem)
+{
+	ritem.LocalBounds.Transform(ritem.WorldBounds, XMLoadFloat4x4(&ritem.World));
+}
+
+// World-space planes of the camera's view frustum, normals pointing inward.
+static FrustumPlanes CameraFrustum(const Camera& cam)
+{
+	XMVECTOR pos = cam.GetPosition();
+	XMVECTOR right = cam.GetRight();
+	XMVECTOR up = cam.GetUp();
+	XMVECTOR look = cam.GetLook();
+
+	float tanY = tanf(0.5f*cam.GetFovY());
+	float tanX = tanY*cam.GetAspect();
+
+	// In view space a point (x, y, z) is inside when |x| <= z*tanX, |y| <= z*tanY
+	// and near <= z <= far.
+	XMVECTOR normals[6] =
+	{
+		look,
+		-look,
+		right + tanX*look,
+		-right + tanX*look,
+		up + tanY*look,
+		-up + tanY*look
+	};
+	float offsets[6] =
+	{
+		-cam.GetNearZ(),
+		cam.GetFarZ(),
+		0.0f, 0.0f, 0.0f, 0.0f
+	};
+
+	FrustumPlanes frustum;
+	for(int p = 0; p < 6; ++p)
+	{
+		XMFLOAT3 n;
+		XMStoreFloat3(&n, normals[p]);
+		frustum.Planes[p][0] = n.x;
+		frustum.Planes[p][1] = n.y;
+		frustum.Planes[p][2] = n.z;
+		frustum.Planes[p][3] = offsets[p] - XMVectorGetX(XMVector3Dot(normals[p], pos));
+	}
+	return frustum;
+}
+
+// Per-frame frustum culling counters.
+struct CullStats
+{
+	UINT Tested = 0;
+	UINT Culled = 0;
+};
+
+struct DrawStats
+{
+	UINT Draws = 0;
+	UINT Triangles = 0;
+
+	// Pipeline, buffer, topology, texture and constant buffer bindings made, and
+	// those skipped because the previous draw had already bound the same thing.
+	UINT StateChanges = 0;
+	UINT StateChangesAvoided = 0;
 };
 
+// Layers drawn with color.hlsl, whose vertex shader reads per-instance data.
+static bool IsInstancedLayer(RenderLayer layer)
+{
+	return layer != RenderLayer::AlphaTestedTreeSprites;
+}
+
+// True if a and b can be drawn by the same instanced draw.
+static bool SharesDrawArgs(const RenderItem& a, const RenderItem& b)
+{
+	return a.Geo == b.Geo && a.Format == b.Format && a.Mat == b.Mat && a.PrimitiveType == b.PrimitiveType &&
+		a.IndexCount == b.IndexCount && a.StartIndexLocation == b.StartIndexLocation &&
+		a.BaseVertexLocation == b.BaseVertexLocation;
+}
+
+// Items of one layer with the same geometry, submesh and material.  Items of layers
+// that are not instanced get a group each.
+struct InstanceGroup
+{
+	std::vector<RenderItem*> Items;
+
+	// Small integer naming Items' MeshGeometry, for the draw sort key.
+	UINT GeoId = 0;
+};
+
+// One DrawIndexedInstanced of a level of detail of Proto's submesh, with Proto's
+// material.  Instanced layers read InstanceCount entries of the frame's instance
+// buffer from InstanceBase; other layers draw Proto alone with its object constant
+// buffer.
+struct DrawBatch
+{
+	RenderItem* Proto = nullptr;
+	RenderLayer Layer = RenderLayer::Opaque;
+	UINT InstanceBase = 0;
+	UINT InstanceCount = 0;
+
+	UINT IndexCount = 0;
+	UINT StartIndexLocation = 0;
+	int BaseVertexLocation = 0;
+
+	// Quantization box of the submesh when Proto's vertices are packed.
+	const BoundingBox* VertexBounds = nullptr;
+};
+
+// Levels of detail built for the shapes that have them.
+static const UINT LodLevelCount = 3;
+
+// Fraction of the viewport height an item's bounding sphere has to cover to be drawn
+// at each level but the last; smaller items drop to the next coarser level.
+static const float LodScreenHeights[LodLevelCount - 1] = { 0.1f, 0.03f };
+
+// Picks the level of detail of ri from the size of its world bounds on screen.
+static UINT SelectLod(const RenderItem& ri, FXMVECTOR eye, float tanHalfFovY)
+{
+	if(ri.Lods == nullptr)
+		return 0;
+
+	XMVECTOR center = XMLoadFloat3(&ri.WorldBounds.Center);
+	float radius = XMVectorGetX(XMVector3Length(XMLoadFloat3(&ri.WorldBounds.Extents)));
+	float distance = XMVectorGetX(XMVector3Length(center - eye));
+	if(distance <= radius)
+		return 0;
+
+	float screenHeight = radius / (distance*tanHalfFovY);
+	UINT lod = 0;
+	UINT coarsest = (std::min)((UINT)ri.Lods->size(), LodLevelCount) - 1;
+	while(lod < coarsest && screenHeight < LodScreenHeights[lod])
+		++lod;
+	return lod;
+}
+
+// Position of each RenderLayer in the frame, indexed by layer.  The layer and the
+// vertex format select the PSO, so they make up the PSO field of the sort key.
+static const int LayerDrawRank[(int)RenderLayer::Count] =
+{
+	0, // Opaque
+	3, // Transparent
+	1, // AlphaTested
+	2, // AlphaTestedTreeSprites
+};
+
+// 64-bit draw sort key, most significant field first:
+//   [63:60] layer rank (PSO)
+//   opaque layers:   [59] vertex format (PSO), [58:49] geometry, [48:39] material,
+//                    [38:15] depth, near first
+//   transparent:     [59:36] depth, far first, [35:26] geometry, [25:16] material
+// so the state-heavy fields are adjacent in the sorted order except where blending
+// needs back-to-front order.  depth01 is the view depth scaled to [0, 1].
+static std::uint64_t DrawSortKey(RenderLayer layer, VertexFormat format, UINT geoId, UINT matId, float depth01)
+{
+	const std::uint64_t depthMax = (1u << 24) - 1;
+	std::uint64_t depth = (std::uint64_t)(MathHelper::Clamp(depth01, 0.0f, 1.0f) * depthMax);
+	std::uint64_t geo = geoId & 0x3ff;
+	std::uint64_t mat = matId & 0x3ff;
+
+	std::uint64_t key = (std::uint64_t)LayerDrawRank[(int)layer] << 60;
+	if(layer == RenderLayer::Transparent)
+		key |= ((depthMax - depth) << 36) | (geo << 26) | (mat << 16);
+	else
+		key |= ((std::uint64_t)format << 59) | (geo << 49) | (mat << 39) | (depth << 15);
+	return key;
+}
+
 class ShapesApp : public D3DApp
 {
 public:
@@ -126,7 +396,9 @@ private:
     void UpdateMaterialCBs(const GameTimer& gt);
 	void UpdateMainPassCB(const GameTimer& gt);
 	void UpdateWaves(const GameTimer& gt);
+	void UpdateWaveBounds();
 	void CameraCollisionCheck(const XMVECTOR np);
+	CullStats CullRenderItems();
 
     void LoadTextures();
     void BuildRootSignature();
@@ -141,8 +413,17 @@ private:
     void BuildMaterials();
     void SetRenderItemInfo(RenderItem &Ritem, std::string itemType, XMMATRIX transform, std::string material, RenderLayer layer);
     void BuildRenderItems();
+	void BuildCollisionGrid();
+	void BuildCullBoxes();
+	void BuildFrameGraph();
+	void BuildInstanceGroups();
+	void BuildDrawBatches();
+	void MarkRitemDirty(RenderItem& ritem);
+	void AttachRitem(RenderItem& ritem, SceneGraph::NodeId parent);
+	void UpdateSceneGraph();
 	void buildWaterwall(float xLen, float zLen, float xPos, float zPos, float halfWidth, float halfHeight);
-    void DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems);
+	void DrawBatches(ID3D12GraphicsCommandList* cmdList, DrawStats& stats);
+	void UpdateStatsCaption(const CullStats& cullStats, const DrawStats& drawStats);
  
     std::array<const CD3DX12_STATIC_SAMPLER_DESC, 6> GetStaticSamplers();
 
@@ -166,24 +447,65 @@ private:
 	ComPtr<ID3D12DescriptorHeap> mSrvDescriptorHeap = nullptr;
 
 	std::unordered_map<std::string, std::unique_ptr<MeshGeometry>> mGeometries;
+
+	// Levels of detail of the shapeGeo submeshes that have them, keyed like DrawArgs.
+	std::unordered_map<std::string, std::vector<SubmeshGeometry>> mLodChains;
 	std::unordered_map<std::string, std::unique_ptr<Material>> mMaterials;
 	std::unordered_map<std::string, std::unique_ptr<Texture>> mTextures;
 	std::unordered_map<std::string, ComPtr<ID3DBlob>> mShaders;
     std::unordered_map<std::string, ComPtr<ID3D12PipelineState>> mPSOs;
 
 	std::vector<D3D12_INPUT_ELEMENT_DESC> mStdInputLayout;
+	std::vector<D3D12_INPUT_ELEMENT_DESC> mPackedInputLayout;
 	std::vector<D3D12_INPUT_ELEMENT_DESC> mTreeSpriteInputLayout;
 
-	RenderItem* mWavesRitem = nullptr;
+	// Geometry drawn with each wave surface's dynamic vertex buffer.
+	MeshGeometry* mWavesGeo[(int)WaveSurface::Count] = {};
 	
 	// List of all the render items.
 	std::vector<std::unique_ptr<RenderItem>> mAllRitems;
 
-	std::unique_ptr<Waves> mWaves;
+	// Items whose object constants still need uploading to some frame resource.
+	std::vector<RenderItem*> mDirtyRitems;
+
+	// Parent-relative transforms of hierarchical items (the towers).  mNodeRitems[n]
+	// is the item driven by node n, or nullptr for grouping nodes.
+	SceneGraph mSceneGraph;
+	std::vector<RenderItem*> mNodeRitems;
+
+	std::unique_ptr<WaveSystem> mWaves;
+
+	// Per-frame CPU update stages and their dependencies, run by Update.
+	TaskGraph mFrameGraph;
+
+	// Broad phase over mAllRitems[i]->bounds (id i), built once after BuildRenderItems.
+	SpatialGrid mCollisionGrid;
+
+	// mAllRitems[i]->WorldBounds (id i) packed for the SIMD frustum test, and its
+	// per-frame result.  UpdateObjectCBs moves a box when its World matrix changes.
+	CullKernels::BoxSoA mCullBoxes;
+	std::vector<std::uint32_t> mVisibleMask;
 	
 	// Render items divided by PSO.
 	std::vector<RenderItem*> mRitemLayer[(int)RenderLayer::Count];
 
+	// mRitemLayer grouped by draw arguments, and this frame's draws of their visible
+	// items with the order to issue them in (SortEntry::Value indexes mDrawBatches).
+	std::vector<InstanceGroup> mInstanceGroups[(int)RenderLayer::Count];
+	std::vector<DrawBatch> mDrawBatches;
+	std::vector<SortEntry> mDrawOrder;
+	std::vector<SortEntry> mDrawOrderScratch;
+	ID3D12PipelineState* mLayerPSOs[(int)VertexFormat::Count][(int)RenderLayer::Count] = {};
+
+	// Layout of shapeGeo's vertex buffer.  Packed halves its size; Float keeps the
+	// 32-byte Vertex.
+	VertexFormat mShapeVertexFormat = VertexFormat::Packed;
+
+	// Stats shown in the caption.
+	CullStats mCullStats;
+	DrawStats mDrawStats;
+	std::wstring mBaseCaption;
+
 
     PassConstants mMainPassCB;
 
@@ -252,12 +574,20 @@ bool ShapesApp::Initialize()
     ThrowIfFailed(mCommandList->Reset(mDirectCmdListAlloc.Get(), nullptr));
 
     mCbvSrvDescriptorSize = md3dDevice->GetDescriptorHandleIncrementSize(D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+	mBaseCaption = mMainWndCaption;
 	FpsCam.LookAt(
 		XMFLOAT3(15.0f, 7.0f, -430.0f),
 		XMFLOAT3(0.0f, 0.0f, 0.0f),
 		XMFLOAT3(0.0f, 1.0f, 0.0f));
 	XMStoreFloat3(&FpsCam.bounds.Center, FpsCam.GetPosition());
-	mWaves = std::make_unique<Waves>(128, 128, 1.0f, 0.02f, 4.0f, 0.15f);
+	// The moats keep the original grid; the maze water walls get their own coarser grid
+	// covering the same extent (127 units across: 63 cells of 127/63), so both use the
+	// same render item transforms.
+	mWaves = std::make_unique<WaveSystem>();
+	mWaves->AddSurface(128, 128, 1.0f, 0.02f, 4.0f, 0.15f);
+	mWaves->AddSurface(64, 64, 127.0f/63.0f, 0.02f, 4.0f, 0.15f);
+	// Each frame resource has its own waves vertex buffers.
+	mWaves->SetOutputBufferCount(gNumFrameResources);
 	
     LoadTextures();
 	loadMazeWalls();
@@ -268,6 +598,13 @@ bool ShapesApp::Initialize()
 	BuildWavesGeometry();
     BuildMaterials();
     BuildRenderItems();
+	// Resolve the towers' parent-relative transforms before anything reads World;
+	// the cull boxes are built from the world bounds.
+	UpdateSceneGraph();
+	BuildCollisionGrid();
+	BuildCullBoxes();
+	BuildInstanceGroups();
+	BuildFrameGraph();
     BuildFrameResources();
     BuildDescriptorHeaps();
     BuildPSOs();
@@ -313,11 +650,8 @@ void ShapesApp::Update(const GameTimer& gt)
         CloseHandle(eventHandle);
     }
 
-    AnimateMaterials(gt);
-	UpdateObjectCBs(gt);
-    UpdateMaterialCBs(gt);
-	UpdateMainPassCB(gt);
-	UpdateWaves(gt);
+	// Run the per-frame update stages, overlapping the independent ones.
+	mFrameGraph.Run(TaskScheduler::Default());
 
 }
 
@@ -355,19 +689,17 @@ void ShapesApp::Draw(const GameTimer& gt)
     auto passCB = mCurrFrameResource->PassCB->Resource();
     mCommandList->SetGraphicsRootConstantBufferView(2, passCB->GetGPUVirtualAddress());
 
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Opaque]);
-
-	mCommandList->SetPipelineState(mPSOs["alphaTested"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::AlphaTested]);
+	CullStats cullStats = CullRenderItems();
+	BuildDrawBatches();
 
-	mCommandList->SetPipelineState(mPSOs["treeSprites"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::AlphaTestedTreeSprites]);
+	auto instanceBuffer = mCurrFrameResource->InstanceBuffer->Resource();
+	mCommandList->SetGraphicsRootShaderResourceView(4, instanceBuffer->GetGPUVirtualAddress());
 
-	/*mCommandList->SetPipelineState(mPSOs["CoralSprite"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::AlphaTestedTreeSprites]);*/
+	// Every layer in one sorted list; DrawBatches switches PSOs as the layer changes.
+	DrawStats drawStats;
+	DrawBatches(mCommandList.Get(), drawStats);
 
-	mCommandList->SetPipelineState(mPSOs["transparent"].Get());
-	DrawRenderItems(mCommandList.Get(), mRitemLayer[(int)RenderLayer::Transparent]);
+	UpdateStatsCaption(cullStats, drawStats);
 
     // Indicate a state transition on the resource usage.
     mCommandList->ResourceBarrier(1, &CD3DX12_RESOURCE_BARRIER::Transition(CurrentBackBuffer(),
@@ -470,7 +802,8 @@ void ShapesApp::OnKeyboardInput(const GameTimer& gt)
 	if (GetAsyncKeyState('E') & 0x8000)
 		newPos += FpsCam.GetNewPosDifference(cSpeed, pedestal);
 	
-	//if no input skip  the collision check
+	//if no input skip  the collision check; all keys are combined into one move so
+	//there is a single collision query per frame
 	if(!XMVector3Equal(newPos, FpsCam.GetPosition()) )
 	{
 		CameraCollisionCheck(newPos);
@@ -515,32 +848,39 @@ void ShapesApp::UpdateObjectCBs(const GameTimer& gt)
 {	
 	auto currObjectCB = mCurrFrameResource->ObjectCB.get();
 
-	XMMATRIX view = FpsCam.GetView();
-	XMMATRIX invView = XMMatrixInverse(&XMMatrixDeterminant(view), view);
-
-	auto currInstanceBuffer = mCurrFrameResource->ObjectCB.get();
-	for(auto& e : mAllRitems)
+	// Only items whose constants changed in the last gNumFrameResources frames are
+	// on the list, so a static scene costs nothing here.
+	size_t kept = 0;
+	for(RenderItem* e : mDirtyRitems)
 	{
-		// Only update the cbuffer data if the constants have changed.  
-		// This needs to be tracked per frame resource.
-		if(e->NumFramesDirty > 0)
+		// The first frame to see a change updates the cached inverse transpose and
+		// constants, and moves the item's bounds.
+		if(e->NumFramesDirty == gNumFrameResources)
 		{
 			XMMATRIX world = XMLoadFloat4x4(&e->World);
-            XMMATRIX tWorld = XMLoadFloat4x4(&e->TWorld);
-            XMMATRIX texTransform = XMLoadFloat4x4(&e->TexTransform);
+			XMMATRIX tWorld = MathHelper::InverseTranspose(world);
+			XMMATRIX texTransform = XMLoadFloat4x4(&e->TexTransform);
+			XMStoreFloat4x4(&e->TWorld, tWorld);
 
-			ObjectConstants objConstants;
-			XMStoreFloat4x4(&objConstants.World, XMMatrixTranspose(world));
-            XMStoreFloat4x4(&objConstants.TWorld, XMMatrixTranspose(MathHelper::InverseTranspose(world)));
-            XMStoreFloat4x4(&objConstants.TexTransform, XMMatrixTranspose(texTransform));
+			XMStoreFloat4x4(&e->Constants.World, XMMatrixTranspose(world));
+			XMStoreFloat4x4(&e->Constants.TWorld, XMMatrixTranspose(tWorld));
+			XMStoreFloat4x4(&e->Constants.TexTransform, XMMatrixTranspose(texTransform));
 
-			
-			currObjectCB->CopyData(e->ObjCBIndex, objConstants);
-		
-			// Next FrameResource need to be updated too.
-			e->NumFramesDirty--;
+			UpdateWorldBounds(*e);
+
+			const BoundingBox& bounds = e->WorldBounds;
+			mCullBoxes.Set(e->SceneId, &bounds.Center.x, &bounds.Extents.x);
 		}
+
+		currObjectCB->CopyData(e->ObjCBIndex, e->Constants);
+
+		// Next FrameResource need to be updated too.
+		if(--e->NumFramesDirty > 0)
+			mDirtyRitems[kept++] = e;
+		else
+			e->QueuedDirty = false;
 	}
+	mDirtyRitems.resize(kept);
 }
 
 void ShapesApp::UpdateMaterialCBs(const GameTimer& gt)
@@ -641,66 +981,229 @@ void ShapesApp::UpdateMainPassCB(const GameTimer& gt)
 
 void ShapesApp::UpdateWaves(const GameTimer& gt)
 {
-	// Every quarter second, generate a random wave.
+	// Every quarter second, generate a random wave on each surface.
 	static float t_base = 0.0f;
 	if((mTimer.TotalTime() - t_base) >= 0.25f)
 	{
 		t_base += 0.25f;
 
-		int i = MathHelper::Rand(4, mWaves->RowCount() - 5);
-		int j = MathHelper::Rand(4, mWaves->ColumnCount() - 5);
+		for(int k = 0; k < mWaves->SurfaceCount(); ++k)
+		{
+			Waves& waves = mWaves->Surface(k);
+
+			int i = MathHelper::Rand(4, waves.RowCount() - 5);
+			int j = MathHelper::Rand(4, waves.ColumnCount() - 5);
 
-		float r = MathHelper::RandF(0.1f, 0.3f);
+			float r = MathHelper::RandF(0.1f, 0.3f);
 
-		mWaves->Disturb(i, j, r);
+			// Applied at the start of the next wave step.
+			waves.QueueDisturbance(i, j, r);
+		}
 	}
 
-	// Update the wave simulation.
+	// Update all wave simulations.
 	mWaves->Update(gt.DeltaTime());
 
-	// Update the wave vertex buffer with the new solution.
-	auto currWavesVB = mCurrFrameResource->WavesVB.get();
-	for(int i = 0; i < mWaves->VertexCount(); ++i)
+	// Write the new solutions straight into the mapped wave vertex buffers.
+	static_assert(sizeof(Vertex) == sizeof(Waves::Vertex), "Waves::Vertex must match the Vertex layout");
+	Waves::Vertex* dst[(int)WaveSurface::Count];
+	for(int k = 0; k < (int)WaveSurface::Count; ++k)
+		dst[k] = reinterpret_cast<Waves::Vertex*>(mCurrFrameResource->WavesVB[k]->MappedData());
+	mWaves->WriteVertices(dst);
+
+	// Set the dynamic VBs of the wave geometry to the current frame VBs.
+	for(int k = 0; k < (int)WaveSurface::Count; ++k)
+		mWavesGeo[k]->VertexBufferGPU = mCurrFrameResource->WavesVB[k]->Resource();
+}
+
+// Grows the bounds of the water items whose surface's crests have left them, so
+// culling never drops water that is in view.  Runs after UpdateWaves.
+void ShapesApp::UpdateWaveBounds()
+{
+	for(int k = 0; k < (int)WaveSurface::Count; ++k)
 	{
-		Vertex v;
+		float height = mWaves->Surface(k).MaxAbsHeight();
+		BoundingBox& bounds = mWavesGeo[k]->DrawArgs["grid"].Bounds;
+		if(height <= bounds.Extents.y)
+			continue;
 
-		v.Pos = mWaves->Position(i);
-		v.Normal = mWaves->Normal(i);
-		
-		// Derive tex-coords from position by 
-		// mapping [-w/2,w/2] --> [0,1]
-		v.TexC.x = 0.5f + v.Pos.x / mWaves->Width();
-		v.TexC.y = 0.5f - v.Pos.z / mWaves->Depth();
+		bounds.Extents.y = WaveBoundSlack*height;
 
-		currWavesVB->CopyData(i, v);
+		// UpdateObjectCBs moves the items' world bounds and cull boxes.
+		for(auto& e : mAllRitems)
+		{
+			if(e->Geo == mWavesGeo[k])
+			{
+				e->LocalBounds = bounds;
+				MarkRitemDirty(*e);
+			}
+		}
 	}
-
-	// Set the dynamic VB of the wave renderitem to the current frame VB.
-	mWavesRitem->Geo->VertexBufferGPU = currWavesVB->Resource();
 }
 
 void ShapesApp::CameraCollisionCheck(const XMVECTOR np)
 {
-	BoundingBox newBounds;
-	XMStoreFloat3(&newBounds.Center, np);
-	newBounds.Extents = {2.5f, 2.5f, 2.5f};
+	XMVECTOR pos = FpsCam.GetPosition();
 
-	//check collision, leave if it happens
-    for(auto& e : mAllRitems)
-    {
-		if(e->bounds.Contains(newBounds) != DISJOINT)
-		{
-			return;
-		}
-    }
+	BoundingBox currBounds;
+	XMStoreFloat3(&currBounds.Center, pos);
+	currBounds.Extents = {2.5f, 2.5f, 2.5f};
+
+	//sweep the camera box along this frame's move; it stops at the first wall
+	//it reaches and slides along it instead of rejecting the whole move
+	XMFLOAT3 delta;
+	XMStoreFloat3(&delta, np - pos);
+	XMFLOAT3 moved;
+	mCollisionGrid.SlideMove(ToAabb(currBounds), &delta.x, &moved.x);
 
 	//move camera
 	XMFLOAT3 storeNewPos;
-	XMStoreFloat3(&storeNewPos, np);
+	XMStoreFloat3(&storeNewPos, pos + XMLoadFloat3(&moved));
 	FpsCam.SetPosition(storeNewPos);
 
 }
 
+CullStats ShapesApp::CullRenderItems()
+{
+	// A flat SIMD pass over every box; at this scene size it is cheaper than a
+	// hierarchy walk.
+	static const CullKernels::KernelSet& kernels = CullKernels::Best();
+	kernels.Frustum(CameraFrustum(FpsCam), mCullBoxes, mVisibleMask.data());
+
+	for(size_t i = 0; i < mAllRitems.size(); ++i)
+		mAllRitems[i]->Visible = CullKernels::IsVisible(mVisibleMask.data(), (int)i);
+
+	CullStats stats;
+	for(int layer = 0; layer < (int)RenderLayer::Count; ++layer)
+	{
+		for(RenderItem* ri : mRitemLayer[layer])
+		{
+			if(!ri->Visible)
+				++stats.Culled;
+		}
+		stats.Tested += (UINT)mRitemLayer[layer].size();
+	}
+	return stats;
+}
+
+// Reports the draw calls and state changes saved next to the frame stats.
+void ShapesApp::UpdateStatsCaption(const CullStats& cullStats, const DrawStats& drawStats)
+{
+	if(cullStats.Tested == mCullStats.Tested && cullStats.Culled == mCullStats.Culled &&
+		drawStats.Draws == mDrawStats.Draws && drawStats.Triangles == mDrawStats.Triangles &&
+		drawStats.StateChanges == mDrawStats.StateChanges &&
+		drawStats.StateChangesAvoided == mDrawStats.StateChangesAvoided)
+		return;
+
+	mMainWndCaption = mBaseCaption +
+		L"    drawn: " + std::to_wstring(cullStats.Tested - cullStats.Culled) +
+		L" in " + std::to_wstring(drawStats.Draws) + L" draws" +
+		L" (" + std::to_wstring(drawStats.Triangles) + L" triangles)" +
+		L", state changes: " + std::to_wstring(drawStats.StateChanges) +
+		L" (" + std::to_wstring(drawStats.StateChangesAvoided) + L" avoided)" +
+		L"   culled: " + std::to_wstring(cullStats.Culled) + L"/" + std::to_wstring(cullStats.Tested);
+
+	mCullStats = cullStats;
+	mDrawStats = drawStats;
+}
+
+// Picks the level of detail of every visible item, packs the constants of the visible
+// items of every instance group into this frame's instance buffer, one contiguous run
+// per group and level, records a draw for each run and sorts the draws by
+// DrawSortKey.
+void ShapesApp::BuildDrawBatches()
+{
+	auto instanceBuffer = mCurrFrameResource->InstanceBuffer.get();
+
+	const float tanHalfFovY = tanf(0.5f*FpsCam.GetFovY());
+	XMVECTOR eye = FpsCam.GetPosition();
+	XMVECTOR look = FpsCam.GetLook();
+	const float nearZ = FpsCam.GetNearZ();
+	const float depthScale = 1.0f / (FpsCam.GetFarZ() - nearZ);
+	auto depth01 = [&](const RenderItem& ri)
+	{
+		XMVECTOR center = XMLoadFloat3(&ri.WorldBounds.Center);
+		return (XMVectorGetX(XMVector3Dot(center - eye, look)) - nearZ) * depthScale;
+	};
+
+	mDrawBatches.clear();
+	mDrawOrder.clear();
+	UINT instanceCount = 0;
+	for(int layer = 0; layer < (int)RenderLayer::Count; ++layer)
+	{
+		const bool instanced = IsInstancedLayer((RenderLayer)layer);
+		const bool backToFront = (RenderLayer)layer == RenderLayer::Transparent;
+
+		for(const InstanceGroup& group : mInstanceGroups[layer])
+		{
+			// The items of a group share their draw arguments and so their levels.
+			RenderItem* proto = group.Items.front();
+			UINT levelCount = proto->Lods != nullptr ? (UINT)proto->Lods->size() : 1;
+
+			UINT levelUsed = 0;
+			for(RenderItem* ri : group.Items)
+			{
+				if(ri->Visible)
+				{
+					ri->Lod = SelectLod(*ri, eye, tanHalfFovY);
+					levelUsed |= 1u << ri->Lod;
+				}
+			}
+
+			for(UINT level = 0; level < levelCount; ++level)
+			{
+				if((levelUsed & (1u << level)) == 0)
+					continue;
+
+				// Non-instanced groups hold a single item, so this is one batch either way.
+				DrawBatch batch;
+				batch.Proto = proto;
+				batch.Layer = (RenderLayer)layer;
+				batch.InstanceBase = instanceCount;
+				if(proto->Lods != nullptr)
+				{
+					const SubmeshGeometry& submesh = (*proto->Lods)[level];
+					batch.IndexCount = submesh.IndexCount;
+					batch.StartIndexLocation = submesh.StartIndexLocation;
+					batch.BaseVertexLocation = submesh.BaseVertexLocation;
+					batch.VertexBounds = &submesh.Bounds;
+				}
+				else
+				{
+					batch.IndexCount = proto->IndexCount;
+					batch.StartIndexLocation = proto->StartIndexLocation;
+					batch.BaseVertexLocation = proto->BaseVertexLocation;
+					batch.VertexBounds = &proto->LocalBounds;
+				}
+
+				// A batch sorts by its nearest instance, or its farthest when blended.
+				float depth = backToFront ? -MathHelper::Infinity : MathHelper::Infinity;
+				for(RenderItem* ri : group.Items)
+				{
+					if(!ri->Visible || ri->Lod != level)
+						continue;
+
+					if(instanced)
+						instanceBuffer->CopyData(instanceCount++, ri->Constants);
+					++batch.InstanceCount;
+
+					float d = depth01(*ri);
+					depth = backToFront ? std::fmax(depth, d) : std::fmin(depth, d);
+				}
+
+				SortEntry entry;
+				entry.Key = DrawSortKey(batch.Layer, proto->Format, group.GeoId, batch.Proto->Mat->MatCBIndex, depth);
+				entry.Value = (std::uint32_t)mDrawBatches.size();
+				mDrawOrder.push_back(entry);
+				mDrawBatches.push_back(batch);
+			}
+		}
+	}
+
+	mDrawOrderScratch.resize(mDrawOrder.size());
+	RadixSort(mDrawOrder.data(), mDrawOrderScratch.data(), (int)mDrawOrder.size());
+}
+
 void ShapesApp::LoadTextures()
 {
 	auto bricksTex = std::make_unique<Texture>();
@@ -912,18 +1415,20 @@ void ShapesApp::BuildRootSignature()
 		0); // register t0
 
 	// Root parameter can be a table, root descriptor or root constants.
-	CD3DX12_ROOT_PARAMETER slotRootParameter[4];
+	CD3DX12_ROOT_PARAMETER slotRootParameter[6];
 
 	// Performance TIP: Order from most frequent to least frequent.
 	slotRootParameter[0].InitAsDescriptorTable(1, &texTable, D3D12_SHADER_VISIBILITY_PIXEL);
     slotRootParameter[1].InitAsConstantBufferView(0); // register b0
 	slotRootParameter[2].InitAsConstantBufferView(1); // register b1
 	slotRootParameter[3].InitAsConstantBufferView(2); // register b2
+	slotRootParameter[4].InitAsShaderResourceView(0, 1, D3D12_SHADER_VISIBILITY_VERTEX); // register t0, space1
+	slotRootParameter[5].InitAsConstants(7, 3, 0, D3D12_SHADER_VISIBILITY_VERTEX); // register b3
 
 	auto staticSamplers = GetStaticSamplers();
 
 	// A root signature is an array of root parameters.
-	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(4, slotRootParameter,
+	CD3DX12_ROOT_SIGNATURE_DESC rootSigDesc(6, slotRootParameter,
 		(UINT)staticSamplers.size(), staticSamplers.data(),
 		D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT);
 
@@ -960,7 +1465,13 @@ void ShapesApp::BuildShadersAndInputLayout()
 		"ALPHA_TEST", "1",
 		NULL, NULL
 	};
+	const D3D_SHADER_MACRO packedDefines[] =
+	{
+		"PACKED_VERTICES", "1",
+		NULL, NULL
+	};
 	mShaders["standardVS"] = d3dUtil::CompileShader(L"Shaders\\color.hlsl", nullptr, "VS", "vs_5_1");
+	mShaders["packedVS"] = d3dUtil::CompileShader(L"Shaders\\color.hlsl", packedDefines, "VS", "vs_5_1");
 	mShaders["opaquePS"] = d3dUtil::CompileShader(L"Shaders\\color.hlsl", defines, "PS", "ps_5_1");
 	mShaders["alphaTestedPS"] = d3dUtil::CompileShader(L"Shaders\\color.hlsl", alphaTestDefines, "PS", "ps_5_1");
 
@@ -975,6 +1486,14 @@ void ShapesApp::BuildShadersAndInputLayout()
 		{ "TEXCOORD", 0, DXGI_FORMAT_R32G32_FLOAT, 0, 24, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
 	};
 
+	static_assert(sizeof(VertexPacking::PackedVertex) == 16, "PackedVertex must match mPackedInputLayout");
+	mPackedInputLayout =
+	{
+		{ "POSITION", 0, DXGI_FORMAT_R16G16B16A16_UNORM, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "NORMAL", 0, DXGI_FORMAT_R16G16_SNORM, 0, 8, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+		{ "TEXCOORD", 0, DXGI_FORMAT_R16G16_FLOAT, 0, 12, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
+	};
+
 	mTreeSpriteInputLayout =
 	{
 		{ "POSITION", 0, DXGI_FORMAT_R32G32B32_FLOAT, 0, 0, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0 },
@@ -990,344 +1509,218 @@ void ShapesApp::BuildShapeGeometry()
 	GeometryGenerator::MeshData grid = geoGen.CreateGrid(width, depth , 60 , 40);
 	GeometryGenerator::MeshData waterGrid = geoGen.CreateGrid(width * 2, depth * 2, 60* 2 , 40);
     GeometryGenerator::MeshData sandDunes = geoGen.CreateGrid(width * 20, depth *20, 60 , 40);
-	GeometryGenerator::MeshData sphere = geoGen.CreateSphere(0.5f, 20, 20);
-	GeometryGenerator::MeshData cylinder = geoGen.CreateCylinder(0.5f, 0.5f, 2.0f, 20, 20);
-	GeometryGenerator::MeshData cone = geoGen.CreateCone(0.5f, 1.0f, 20, 1);
+
+	// Shapes drawn at several levels of detail get a chain, whose first level is the
+	// mesh drawn up close; see SelectLod.
+	GeometryGenerator::LodChain sphereLods = geoGen.CreateSphereLods(0.5f, 20, 20, LodLevelCount);
+	GeometryGenerator::LodChain cylinderLods = geoGen.CreateCylinderLods(0.5f, 0.5f, 2.0f, 20, 20, LodLevelCount);
+	GeometryGenerator::LodChain coneLods = geoGen.CreateConeLods(0.5f, 1.0f, 20, 1, LodLevelCount);
+	GeometryGenerator::LodChain torusLods = geoGen.CreateTorusLods(0.3f, 2.0f, 30, 30, LodLevelCount);
+	GeometryGenerator::LodChain torus2Lods = geoGen.CreateTorusLods(0.3f, 2.0f, 20, 20, LodLevelCount);
+	GeometryGenerator::LodChain cylinder2Lods = geoGen.CreateCylinderLods(1.0f, 0.5f, 2.0f, 20, 20, LodLevelCount);
+
+	GeometryGenerator::MeshData& sphere = sphereLods[0];
+	GeometryGenerator::MeshData& cylinder = cylinderLods[0];
+	GeometryGenerator::MeshData& cone = coneLods[0];
     GeometryGenerator::MeshData triPrism = geoGen.CreateTriangularPrism(10, 1, 1);
     GeometryGenerator::MeshData diamond = geoGen.CreateDiamond(1, 0.7f, 0.3, 1, 6, 1);
     GeometryGenerator::MeshData pyramid = geoGen.CreatePyramid(1, 1, 1 );
-    GeometryGenerator::MeshData torus = geoGen.CreateTorus(0.3f, 2.0f, 30, 30);
+    GeometryGenerator::MeshData& torus = torusLods[0];
     GeometryGenerator::MeshData wedge = geoGen.CreateWedge(1.0f, 1.0f, 2.0f);
-    GeometryGenerator::MeshData torus2 = geoGen.CreateTorus(0.3f, 2.0f, 20, 20);
-    GeometryGenerator::MeshData cylinder2 = geoGen.CreateCylinder(1.0f, 0.5f, 2.0f, 20, 20);
-
-	//
-	// We are concatenating all the geometry into one big vertex/index buffer.  So
-	// define the regions in the buffer each submesh covers.
-	//
-
-	// Cache the vertex offsets to each object in the concatenated vertex buffer.
-	UINT boxVertexOffset = 0;
-	UINT gridVertexOffset = (UINT)box.Vertices.size();
-    UINT sandDunesVertexOffset = gridVertexOffset + (UINT)grid.Vertices.size();
-    UINT sphereVertexOffset = sandDunesVertexOffset + (UINT)sandDunes.Vertices.size();
-	UINT cylinderVertexOffset = sphereVertexOffset + (UINT)sphere.Vertices.size();
-    UINT coneVertexOffset = cylinderVertexOffset + (UINT)cylinder.Vertices.size();
-    UINT triPrismVertexOffset = coneVertexOffset + (UINT)cone.Vertices.size();
-    UINT diamondVertexOffset = triPrismVertexOffset + (UINT)triPrism.Vertices.size();
-    UINT pyramidVertexOffset = diamondVertexOffset + (UINT)diamond.Vertices.size();
-    UINT torusVertexOffset = pyramidVertexOffset + (UINT)pyramid.Vertices.size();
-    UINT wedgeVertexOffset = torusVertexOffset + (UINT)torus.Vertices.size();
-    UINT torus2VertexOffset = wedgeVertexOffset + (UINT)wedge.Vertices.size();
-    UINT cylinder2VertexOffset = torus2VertexOffset + (UINT)torus2.Vertices.size();
-    
-	// Cache the starting index for each object in the concatenated index buffer.
-	UINT boxIndexOffset = 0;
-	UINT gridIndexOffset = (UINT)box.Indices32.size();
-	UINT sandDunesIndexOffset = gridIndexOffset + (UINT)grid.Indices32.size();
-    UINT sphereIndexOffset = sandDunesIndexOffset + (UINT)sandDunes.Indices32.size();
-	UINT cylinderIndexOffset = sphereIndexOffset + (UINT)sphere.Indices32.size();
-    UINT coneIndexOffset = cylinderIndexOffset + (UINT)cylinder.Indices32.size();
-    UINT triPrismIndexOffset = coneIndexOffset + (UINT)cone.Indices32.size();
-    UINT diamondIndexOffset = triPrismIndexOffset + (UINT)triPrism.Indices32.size();
-    UINT pyramidIndexOffset = diamondIndexOffset + (UINT)diamond.Indices32.size();
-    UINT torusIndexOffset = pyramidIndexOffset + (UINT)pyramid.Indices32.size();
-    UINT wedgeIndexOffset = torusIndexOffset + (UINT)torus.Indices32.size(); 
-    UINT torus2IndexOffset = wedgeIndexOffset + (UINT)wedge.Indices32.size(); 
-    UINT cylinder2IndexOffset = torus2IndexOffset + (UINT)torus2.Indices32.size();
-
-    // Define the SubmeshGeometry that cover different 
-    // regions of the vertex/index buffers.
-
-	SubmeshGeometry boxSubmesh;
-	boxSubmesh.IndexCount = (UINT)box.Indices32.size();
-	boxSubmesh.StartIndexLocation = boxIndexOffset;
-	boxSubmesh.BaseVertexLocation = boxVertexOffset;
-
-    SubmeshGeometry wedgeSubmesh;
-    wedgeSubmesh.IndexCount = (UINT)wedge.Indices32.size();
-    wedgeSubmesh.StartIndexLocation = wedgeIndexOffset;
-    wedgeSubmesh.BaseVertexLocation = wedgeVertexOffset;
-
-	SubmeshGeometry gridSubmesh;
-	gridSubmesh.IndexCount = (UINT)grid.Indices32.size();
-	gridSubmesh.StartIndexLocation = gridIndexOffset;
-	gridSubmesh.BaseVertexLocation = gridVertexOffset;
-
-    SubmeshGeometry sandDunesSubmesh;
-    sandDunesSubmesh.IndexCount = (UINT)sandDunes.Indices32.size();
-    sandDunesSubmesh.StartIndexLocation = sandDunesIndexOffset;
-    sandDunesSubmesh.BaseVertexLocation = sandDunesVertexOffset;
-
-	SubmeshGeometry sphereSubmesh;
-	sphereSubmesh.IndexCount = (UINT)sphere.Indices32.size();
-	sphereSubmesh.StartIndexLocation = sphereIndexOffset;
-	sphereSubmesh.BaseVertexLocation = sphereVertexOffset;
-
-	SubmeshGeometry cylinderSubmesh;
-	cylinderSubmesh.IndexCount = (UINT)cylinder.Indices32.size();
-	cylinderSubmesh.StartIndexLocation = cylinderIndexOffset;
-	cylinderSubmesh.BaseVertexLocation = cylinderVertexOffset;
-
-    SubmeshGeometry coneSubmesh;
-    coneSubmesh.IndexCount = (UINT)cone.Indices32.size();
-    coneSubmesh.StartIndexLocation = coneIndexOffset;
-    coneSubmesh.BaseVertexLocation = coneVertexOffset;
-
-    SubmeshGeometry triPrismSubmesh;
-    triPrismSubmesh.IndexCount = (UINT)triPrism.Indices32.size();
-    triPrismSubmesh.StartIndexLocation = triPrismIndexOffset;
-    triPrismSubmesh.BaseVertexLocation = triPrismVertexOffset;
-
-    SubmeshGeometry diamondSubmesh;
-    diamondSubmesh.IndexCount = (UINT)diamond.Indices32.size();
-    diamondSubmesh.StartIndexLocation = diamondIndexOffset;
-    diamondSubmesh.BaseVertexLocation = diamondVertexOffset;
-
-    SubmeshGeometry pyramidSubmesh;
-    pyramidSubmesh.IndexCount = (UINT)pyramid.Indices32.size();
-    pyramidSubmesh.StartIndexLocation = pyramidIndexOffset;
-    pyramidSubmesh.BaseVertexLocation = pyramidVertexOffset;  
-
-    SubmeshGeometry torusSubmesh;
-    torusSubmesh.IndexCount = (UINT)torus.Indices32.size();
-    torusSubmesh.StartIndexLocation = torusIndexOffset;
-    torusSubmesh.BaseVertexLocation = torusVertexOffset;
-
-    SubmeshGeometry torus2Submesh;
-    torus2Submesh.IndexCount = (UINT)torus2.Indices32.size();
-    torus2Submesh.StartIndexLocation = torus2IndexOffset;
-    torus2Submesh.BaseVertexLocation = torus2VertexOffset;
-    
-    SubmeshGeometry cylinder2Submesh;
-    cylinder2Submesh.IndexCount = (UINT)cylinder2.Indices32.size();
-    cylinder2Submesh.StartIndexLocation = cylinder2IndexOffset;
-    cylinder2Submesh.BaseVertexLocation = cylinder2VertexOffset;
-
-	//
-	// Extract the vertex elements we are interested in and pack the
-	// vertices of all the meshes into one vertex buffer.
-	//
+    GeometryGenerator::MeshData& torus2 = torus2Lods[0];
+    GeometryGenerator::MeshData& cylinder2 = cylinder2Lods[0];
 
-    auto totalVertexCount =
-        box.Vertices.size() +
-        grid.Vertices.size() +
-        sandDunes.Vertices.size() +
-        sphere.Vertices.size() +
-        cylinder.Vertices.size() +
-        cone.Vertices.size() +
-        triPrism.Vertices.size() +
-        diamond.Vertices.size() +
-        pyramid.Vertices.size() +
-        torus.Vertices.size() +
-        wedge.Vertices.size() +
-        torus2.Vertices.size() +
-        cylinder2.Vertices.size();
-
-
-	std::vector<Vertex> vertices(totalVertexCount);
-
-	UINT k = 0;
-	for(size_t i = 0; i < box.Vertices.size(); ++i, ++k)
+	// Weld and reorder every mesh for the vertex caches before packing them, and report
+	// the effect in the debugger output.
+	struct NamedMesh { const char* Name; GeometryGenerator::MeshData* Mesh; };
+	const NamedMesh meshes[] =
 	{
-		vertices[k].Pos = box.Vertices[i].Position;
-        vertices[k].Normal = box.Vertices[i].Normal;
-        vertices[k].TexC = box.Vertices[i].TexC;
+		{ "box", &box }, { "grid", &grid }, { "sandDunes", &sandDunes }, { "sphere", &sphere },
+		{ "cylinder", &cylinder }, { "cone", &cone }, { "prism", &triPrism }, { "diamond", &diamond },
+		{ "pyramid", &pyramid }, { "torus", &torus }, { "wedge", &wedge }, { "torus2", &torus2 },
+		{ "cylinder2", &cylinder2 },
+	};
+	for(const NamedMesh& m : meshes)
+	{
+		GeometryGenerator::OptimizeStats stats;
+		geoGen.Optimize(*m.Mesh, 1e-5f, &stats);
+
+		char line[160];
+		snprintf(line, sizeof(line), "%-10s vertices %5u -> %5u   ACMR %.3f -> %.3f   ATVR %.3f -> %.3f\n",
+			m.Name, stats.VerticesBefore, stats.VerticesAfter,
+			stats.CacheBefore.Acmr, stats.CacheAfter.Acmr, stats.CacheBefore.Atvr, stats.CacheAfter.Atvr);
+		::OutputDebugStringA(line);
 	}
 
-	for(size_t i = 0; i < grid.Vertices.size(); ++i, ++k)
+	// The subdivided box has no parameters to coarsen, so its chain is simplified.
+	// Its faces are flat, so the tolerance only absorbs rounding.
+	GeometryGenerator::LodChain boxLods = geoGen.SimplifyLods(box, LodLevelCount, 1e-4f);
+
+	struct NamedLods { const char* Name; GeometryGenerator::LodChain* Chain; };
+	const NamedLods lodChains[] =
+	{
+		{ "box", &boxLods }, { "sphere", &sphereLods }, { "cylinder", &cylinderLods }, { "cone", &coneLods },
+		{ "torus", &torusLods }, { "torus2", &torus2Lods }, { "cylinder2", &cylinder2Lods },
+	};
+	for(const NamedLods& lods : lodChains)
 	{
-		vertices[k].Pos = grid.Vertices[i].Position;
-		vertices[k].Normal = grid.Vertices[i].Normal;
-		vertices[k].TexC = grid.Vertices[i].TexC;
+		for(size_t level = 1; level < lods.Chain->size(); ++level)
+		{
+			GeometryGenerator::MeshData& mesh = (*lods.Chain)[level];
+			geoGen.Optimize(mesh);
+
+			char line[160];
+			snprintf(line, sizeof(line), "%-10s level %u: %5u triangles, %5u vertices\n",
+				lods.Name, (unsigned)level, (unsigned)mesh.Indices32.size()/3, (unsigned)mesh.Vertices.size());
+			::OutputDebugStringA(line);
+		}
 	}
-    for (size_t i = 0; i < sandDunes.Vertices.size(); ++i, ++k)
-    {
-		auto& p = sandDunes.Vertices[i].Position;
-		vertices[k].Pos = p;
-		vertices[k].Pos.y = GetHillsHeight(p.x, p.z);
-		vertices[k].Normal = GetHillsNormal(p.x, p.z);
-		vertices[k].TexC = sandDunes.Vertices[i].TexC;
-    }
 
-	for(size_t i = 0; i < sphere.Vertices.size(); ++i, ++k)
+	// The dunes take their shape from the hills function.
+	for(GeometryGenerator::Vertex& v : sandDunes.Vertices)
 	{
-		vertices[k].Pos = sphere.Vertices[i].Position;
-		vertices[k].Normal = sphere.Vertices[i].Normal;
-		vertices[k].TexC = sphere.Vertices[i].TexC;
+		v.Position.y = GetHillsHeight(v.Position.x, v.Position.z);
+		v.Normal = GetHillsNormal(v.Position.x, v.Position.z);
 	}
 
-	for(size_t i = 0; i < cylinder.Vertices.size(); ++i, ++k)
+	//
+	// We are concatenating all the geometry into one big vertex/index buffer, each
+	// mesh being a submesh named as in meshes, and the coarser levels of detail
+	// "<shape>_lod<level>".
+	//
+
+	MeshBatchBuilder batchBuilder;
+	for(const NamedMesh& m : meshes)
+		batchBuilder.Add(m.Name, *m.Mesh);
+	for(const NamedLods& lods : lodChains)
 	{
-		vertices[k].Pos = cylinder.Vertices[i].Position;
-		vertices[k].Normal = cylinder.Vertices[i].Normal;
-		vertices[k].TexC = cylinder.Vertices[i].TexC;
+		for(size_t level = 1; level < lods.Chain->size(); ++level)
+			batchBuilder.Add(std::string(lods.Name) + "_lod" + std::to_string(level), (*lods.Chain)[level]);
 	}
 
-    for (size_t i = 0; i < cone.Vertices.size(); ++i, ++k)
-    {
-        vertices[k].Pos = cone.Vertices[i].Position;
-		vertices[k].Normal = cone.Vertices[i].Normal;
-		vertices[k].TexC = cone.Vertices[i].TexC;
-    }
+	auto geo = std::make_unique<MeshGeometry>();
+	geo->Name = "shapeGeo";
 
-    for (size_t i = 0; i < triPrism.Vertices.size(); ++i, ++k)
-    {
-        vertices[k].Pos = triPrism.Vertices[i].Position;
-		vertices[k].Normal = triPrism.Vertices[i].Normal;
-		vertices[k].TexC = triPrism.Vertices[i].TexC;
-    }
+	std::vector<Vertex> vertices;
+	std::vector<std::uint16_t> indices;
+	batchBuilder.Build(vertices, indices, geo->DrawArgs);
 
-    for (size_t i = 0; i < diamond.Vertices.size(); ++i, ++k)
-    {
-        vertices[k].Pos = diamond.Vertices[i].Position;
-		vertices[k].Normal = diamond.Vertices[i].Normal;
-		vertices[k].TexC = diamond.Vertices[i].TexC;
-    }
+	for(const NamedLods& lods : lodChains)
+	{
+		std::vector<SubmeshGeometry>& chain = mLodChains[lods.Name];
+		chain.push_back(geo->DrawArgs[lods.Name]);
+		for(size_t level = 1; level < lods.Chain->size(); ++level)
+			chain.push_back(geo->DrawArgs[std::string(lods.Name) + "_lod" + std::to_string(level)]);
+	}
 
-    for (size_t i = 0; i < pyramid.Vertices.size(); ++i, ++k)
-    {
-        vertices[k].Pos = pyramid.Vertices[i].Position;
-		vertices[k].Normal = pyramid.Vertices[i].Normal;
-		vertices[k].TexC = pyramid.Vertices[i].TexC;
-    }
+	// The packed format needs the submesh bounds, so the buffers are made last.
+	const void* vertexData = vertices.data();
+	UINT vertexByteStride = sizeof(Vertex);
+	std::vector<VertexPacking::PackedVertex> packedVertices;
+	if(mShapeVertexFormat == VertexFormat::Packed)
+	{
+		PackSubmeshVertices(*geo, vertices, indices.data(), packedVertices);
 
-     for (size_t i = 0; i < torus.Vertices.size(); ++i, ++k)
-    {
-        vertices[k].Pos = torus.Vertices[i].Position;
-		vertices[k].Normal = torus.Vertices[i].Normal;
-		vertices[k].TexC = torus.Vertices[i].TexC;
-    }
-     for (size_t i = 0; i < wedge.Vertices.size(); ++i, ++k)
-     {
-         vertices[k].Pos = wedge.Vertices[i].Position;
-		 vertices[k].Normal = wedge.Vertices[i].Normal;
-		 vertices[k].TexC = wedge.Vertices[i].TexC;
-     }
-     for (size_t i = 0; i < torus2.Vertices.size(); ++i, ++k)
-     {
-         vertices[k].Pos = torus2.Vertices[i].Position;
-		 vertices[k].Normal = torus2.Vertices[i].Normal;
-		 vertices[k].TexC = torus2.Vertices[i].TexC;
-     }
-     for (size_t i = 0; i < cylinder2.Vertices.size(); ++i, ++k)
-     {
-         vertices[k].Pos = cylinder2.Vertices[i].Position;
-		 vertices[k].Normal = cylinder2.Vertices[i].Normal;
-		 vertices[k].TexC = cylinder2.Vertices[i].TexC;
-     }
+		char line[96];
+		snprintf(line, sizeof(line), "shapeGeo packed: %u -> %u bytes\n",
+			(UINT)(vertices.size()*sizeof(Vertex)), (UINT)(packedVertices.size()*sizeof(VertexPacking::PackedVertex)));
+		::OutputDebugStringA(line);
 
+		vertexData = packedVertices.data();
+		vertexByteStride = sizeof(VertexPacking::PackedVertex);
+	}
 
-	std::vector<std::uint16_t> indices;
-	indices.insert(indices.end(), std::begin(box.GetIndices16()), std::end(box.GetIndices16()));
-	indices.insert(indices.end(), std::begin(grid.GetIndices16()), std::end(grid.GetIndices16()));
-    indices.insert(indices.end(), std::begin(sandDunes.GetIndices16()), std::end(sandDunes.GetIndices16()));
-	indices.insert(indices.end(), std::begin(sphere.GetIndices16()), std::end(sphere.GetIndices16()));
-	indices.insert(indices.end(), std::begin(cylinder.GetIndices16()), std::end(cylinder.GetIndices16()));
-	indices.insert(indices.end(), std::begin(cone.GetIndices16()), std::end(cone.GetIndices16()));
-	indices.insert(indices.end(), std::begin(triPrism.GetIndices16()), std::end(triPrism.GetIndices16()));
-	indices.insert(indices.end(), std::begin(diamond.GetIndices16()), std::end(diamond.GetIndices16()));
-	indices.insert(indices.end(), std::begin(pyramid.GetIndices16()), std::end(pyramid.GetIndices16()));
-	indices.insert(indices.end(), std::begin(torus.GetIndices16()), std::end(torus.GetIndices16()));
-    indices.insert(indices.end(), std::begin(wedge.GetIndices16()), std::end(wedge.GetIndices16()));
-    indices.insert(indices.end(), std::begin(torus2.GetIndices16()), std::end(torus2.GetIndices16()));
-    indices.insert(indices.end(), std::begin(cylinder2.GetIndices16()), std::end(cylinder2.GetIndices16()));
-
-
-    const UINT vbByteSize = (UINT)vertices.size() * sizeof(Vertex);
+    const UINT vbByteSize = (UINT)vertices.size() * vertexByteStride;
     const UINT ibByteSize = (UINT)indices.size()  * sizeof(std::uint16_t);
 
-	auto geo = std::make_unique<MeshGeometry>();
-	geo->Name = "shapeGeo";
-
 	ThrowIfFailed(D3DCreateBlob(vbByteSize, &geo->VertexBufferCPU));
-	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertices.data(), vbByteSize);
+	CopyMemory(geo->VertexBufferCPU->GetBufferPointer(), vertexData, vbByteSize);
 
 	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
 	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
 
 	geo->VertexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), vertices.data(), vbByteSize, geo->VertexBufferUploader);
+		mCommandList.Get(), vertexData, vbByteSize, geo->VertexBufferUploader);
 
 	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
 		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
 
-	geo->VertexByteStride = sizeof(Vertex);
+	geo->VertexByteStride = vertexByteStride;
 	geo->VertexBufferByteSize = vbByteSize;
 	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
 	geo->IndexBufferByteSize = ibByteSize;
 
-	geo->DrawArgs["box"] = boxSubmesh;
-	geo->DrawArgs["grid"] = gridSubmesh;
-    geo->DrawArgs["sandDunes"] = sandDunesSubmesh;
-	geo->DrawArgs["sphere"] = sphereSubmesh;
-	geo->DrawArgs["cylinder"] = cylinderSubmesh;
-	geo->DrawArgs["cone"] = coneSubmesh;
-	geo->DrawArgs["prism"] = triPrismSubmesh;
-	geo->DrawArgs["diamond"] = diamondSubmesh;
-	geo->DrawArgs["pyramid"] = pyramidSubmesh;
-	geo->DrawArgs["torus"] = torusSubmesh;
-    geo->DrawArgs["wedge"] = wedgeSubmesh;
-    geo->DrawArgs["torus2"] = torus2Submesh;
-    geo->DrawArgs["cylinder2"] = cylinder2Submesh;
-
 	mGeometries[geo->Name] = std::move(geo);
 }
 
 void ShapesApp::BuildWavesGeometry()
 {
-    std::vector<std::uint16_t> indices(3 * mWaves->TriangleCount()); // 3 indices per face
-	assert(mWaves->VertexCount() < 0x0000ffff);
+	const char* geoNames[(int)WaveSurface::Count] = { "waterGeo", "mazeWaterGeo" };
+	assert(mWaves->SurfaceCount() == (int)WaveSurface::Count);
 
-    // Iterate over each quad.
-    int m = mWaves->RowCount();
-    int n = mWaves->ColumnCount();
-    int k = 0;
-    for(int i = 0; i < m - 1; ++i)
-    {
-        for(int j = 0; j < n - 1; ++j)
-        {
-            indices[k] = i*n + j;
-            indices[k + 1] = i*n + j + 1;
-            indices[k + 2] = (i + 1)*n + j;
+	for(int surface = 0; surface < (int)WaveSurface::Count; ++surface)
+	{
+		const Waves& waves = mWaves->Surface(surface);
 
-            indices[k + 3] = (i + 1)*n + j;
-            indices[k + 4] = i*n + j + 1;
-            indices[k + 5] = (i + 1)*n + j + 1;
+		std::vector<std::uint16_t> indices(3 * waves.TriangleCount()); // 3 indices per face
+		assert(waves.VertexCount() < 0x0000ffff);
 
-            k += 6; // next quad
-        }
-    }
+		// Iterate over each quad.
+		int m = waves.RowCount();
+		int n = waves.ColumnCount();
+		int k = 0;
+		for(int i = 0; i < m - 1; ++i)
+		{
+			for(int j = 0; j < n - 1; ++j)
+			{
+				indices[k] = i*n + j;
+				indices[k + 1] = i*n + j + 1;
+				indices[k + 2] = (i + 1)*n + j;
+
+				indices[k + 3] = (i + 1)*n + j;
+				indices[k + 4] = i*n + j + 1;
+				indices[k + 5] = (i + 1)*n + j + 1;
+
+				k += 6; // next quad
+			}
+		}
 
-	UINT vbByteSize = mWaves->VertexCount()*sizeof(Vertex);
-	UINT ibByteSize = (UINT)indices.size()*sizeof(std::uint16_t);
+		UINT vbByteSize = waves.VertexCount()*sizeof(Vertex);
+		UINT ibByteSize = (UINT)indices.size()*sizeof(std::uint16_t);
 
-	auto geo = std::make_unique<MeshGeometry>();
-	geo->Name = "waterGeo";
+		auto geo = std::make_unique<MeshGeometry>();
+		geo->Name = geoNames[surface];
 
-	// Set dynamically.
-	geo->VertexBufferCPU = nullptr;
-	geo->VertexBufferGPU = nullptr;
+		// Set dynamically.
+		geo->VertexBufferCPU = nullptr;
+		geo->VertexBufferGPU = nullptr;
 
-	ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
-	CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
+		ThrowIfFailed(D3DCreateBlob(ibByteSize, &geo->IndexBufferCPU));
+		CopyMemory(geo->IndexBufferCPU->GetBufferPointer(), indices.data(), ibByteSize);
 
-	geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
-		mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
+		geo->IndexBufferGPU = d3dUtil::CreateDefaultBuffer(md3dDevice.Get(),
+			mCommandList.Get(), indices.data(), ibByteSize, geo->IndexBufferUploader);
 
-	geo->VertexByteStride = sizeof(Vertex);
-	geo->VertexBufferByteSize = vbByteSize;
-	geo->IndexFormat = DXGI_FORMAT_R16_UINT;
-	geo->IndexBufferByteSize = ibByteSize;
+		geo->VertexByteStride = sizeof(Vertex);
+		geo->VertexBufferByteSize = vbByteSize;
+		geo->IndexFormat = DXGI_FORMAT_R16_UINT;
+		geo->IndexBufferByteSize = ibByteSize;
 
-	SubmeshGeometry submesh;
-	submesh.IndexCount = (UINT)indices.size();
-	submesh.StartIndexLocation = 0;
-	submesh.BaseVertexLocation = 0;
+		SubmeshGeometry submesh;
+		submesh.IndexCount = (UINT)indices.size();
+		submesh.StartIndexLocation = 0;
+		submesh.BaseVertexLocation = 0;
 
-	geo->DrawArgs["grid"] = submesh;
+		// The vertices are rewritten every frame; UpdateWaveBounds raises the height
+		// as the crests grow.
+		submesh.Bounds.Center = XMFLOAT3(0.0f, 0.0f, 0.0f);
+		submesh.Bounds.Extents = XMFLOAT3(0.5f*waves.Width(), waves.MaxAbsHeight(), 0.5f*waves.Depth());
 
-	mGeometries["waterGeo"] = std::move(geo);
+		geo->DrawArgs["grid"] = submesh;
+
+		mWavesGeo[surface] = geo.get();
+		mGeometries[geo->Name] = std::move(geo);
+	}
 }
 
 void ShapesApp::BuildTreeSpritesGeometry()
@@ -1407,6 +1800,12 @@ void ShapesApp::BuildTreeSpritesGeometry()
 	submesh.StartIndexLocation = 0;
 	submesh.BaseVertexLocation = 0;
 
+	// The geometry shader expands each point into a billboard of up to Size.
+	BoundingBox::CreateFromPoints(submesh.Bounds, vertices.size(), &vertices[0].Pos, sizeof(TreeSpriteVertex));
+	submesh.Bounds.Extents.x += 0.5f*m_size;
+	submesh.Bounds.Extents.y += 0.5f*m_size;
+	submesh.Bounds.Extents.z += 0.5f*m_size;
+
 	geo->DrawArgs["points"] = submesh;
 
 	mGeometries["treeSpritesGeo"] = std::move(geo);
@@ -1510,14 +1909,54 @@ void ShapesApp::BuildPSOs()
 	treeSpritePsoDesc.RasterizerState.CullMode = D3D12_CULL_MODE_NONE;
 
 	ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&treeSpritePsoDesc, IID_PPV_ARGS(&mPSOs["treeSprites"])));
+
+	//
+	// The color.hlsl PSOs again, reading packed vertices.
+	//
+	D3D12_GRAPHICS_PIPELINE_STATE_DESC* colorPsoDescs[] = { &opaquePsoDesc, &transparentPsoDesc, &alphaTestedPsoDesc };
+	const char* colorPsoNames[] = { "opaque", "transparent", "alphaTested" };
+	for(int i = 0; i < (int)_countof(colorPsoDescs); ++i)
+	{
+		D3D12_GRAPHICS_PIPELINE_STATE_DESC packedPsoDesc = *colorPsoDescs[i];
+		packedPsoDesc.InputLayout = { mPackedInputLayout.data(), (UINT)mPackedInputLayout.size() };
+		packedPsoDesc.VS =
+		{
+			reinterpret_cast<BYTE*>(mShaders["packedVS"]->GetBufferPointer()),
+			mShaders["packedVS"]->GetBufferSize()
+		};
+		ThrowIfFailed(md3dDevice->CreateGraphicsPipelineState(&packedPsoDesc, IID_PPV_ARGS(&mPSOs[std::string(colorPsoNames[i]) + "Packed"])));
+	}
+
+	const int floatFormat = (int)VertexFormat::Float;
+	const int packedFormat = (int)VertexFormat::Packed;
+	mLayerPSOs[floatFormat][(int)RenderLayer::Opaque] = mPSOs["opaque"].Get();
+	mLayerPSOs[floatFormat][(int)RenderLayer::Transparent] = mPSOs["transparent"].Get();
+	mLayerPSOs[floatFormat][(int)RenderLayer::AlphaTested] = mPSOs["alphaTested"].Get();
+	mLayerPSOs[floatFormat][(int)RenderLayer::AlphaTestedTreeSprites] = mPSOs["treeSprites"].Get();
+	mLayerPSOs[packedFormat][(int)RenderLayer::Opaque] = mPSOs["opaquePacked"].Get();
+	mLayerPSOs[packedFormat][(int)RenderLayer::Transparent] = mPSOs["transparentPacked"].Get();
+	mLayerPSOs[packedFormat][(int)RenderLayer::AlphaTested] = mPSOs["alphaTestedPacked"].Get();
+	mLayerPSOs[packedFormat][(int)RenderLayer::AlphaTestedTreeSprites] = mPSOs["treeSprites"].Get();
 }
 
 void ShapesApp::BuildFrameResources()
 {
+	std::vector<UINT> waveVertCounts;
+	for(int k = 0; k < mWaves->SurfaceCount(); ++k)
+		waveVertCounts.push_back((UINT)mWaves->Surface(k).VertexCount());
+
+	// Every item of an instanced layer can be visible at once.
+	UINT instanceCount = 0;
+	for(int layer = 0; layer < (int)RenderLayer::Count; ++layer)
+	{
+		if(IsInstancedLayer((RenderLayer)layer))
+			instanceCount += (UINT)mRitemLayer[layer].size();
+	}
+
     for(int i = 0; i < gNumFrameResources; ++i)
     {
         mFrameResources.push_back(std::make_unique<FrameResource>(md3dDevice.Get(),
-            1, (UINT)mAllRitems.size(), (UINT)mMaterials.size(), mWaves->VertexCount()));
+            1, (UINT)mAllRitems.size(), (UINT)mMaterials.size(), instanceCount, waveVertCounts));
     }
 }
 
@@ -1629,6 +2068,12 @@ void ShapesApp::SetRenderItemInfo(RenderItem& Ritem, std::string itemType, XMMAT
     Ritem.IndexCount = Ritem.Geo->DrawArgs[itemType].IndexCount;
     Ritem.StartIndexLocation = Ritem.Geo->DrawArgs[itemType].StartIndexLocation;
     Ritem.BaseVertexLocation = Ritem.Geo->DrawArgs[itemType].BaseVertexLocation;
+    Ritem.LocalBounds = Ritem.Geo->DrawArgs[itemType].Bounds;
+    Ritem.Format = mShapeVertexFormat;
+
+    auto lods = mLodChains.find(itemType);
+    if(lods != mLodChains.end())
+        Ritem.Lods = &lods->second;
 
      mRitemLayer[(int)layer].push_back(&Ritem);
    
@@ -1641,11 +2086,12 @@ void ShapesApp::buildWaterwall(float xLen, float zLen, float xPos, float zPos, f
 		XMStoreFloat4x4(&waterRitem->World, WaterWorld);
 		waterRitem->ObjCBIndex = objCBIndex++;
 		waterRitem->Mat = mMaterials["water0"].get();
-		waterRitem->Geo = mGeometries["waterGeo"].get();
+		waterRitem->Geo = mGeometries["mazeWaterGeo"].get();
 		waterRitem->PrimitiveType = D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST;
 		waterRitem->IndexCount = waterRitem->Geo->DrawArgs["grid"].IndexCount;
 		waterRitem->StartIndexLocation = waterRitem->Geo->DrawArgs["grid"].StartIndexLocation;
 		waterRitem->BaseVertexLocation = waterRitem->Geo->DrawArgs["grid"].BaseVertexLocation;
+		waterRitem->LocalBounds = waterRitem->Geo->DrawArgs["grid"].Bounds;
 
 		waterRitem->bounds.Center = { xPos, 23, zPos};
 		waterRitem->bounds.Extents = {halfWidth, 25.0f, halfHeight};
@@ -1669,6 +2115,7 @@ void ShapesApp::BuildRenderItems()
 	mAllRitems.push_back(std::move(gridRitem));
 
     //tower objects
+    SceneGraph::NodeId towerNodes[4];
     for (int i = 0; i < 4; ++i)
     {
         float theta = i * thetaSquareStep + thetaSquareStep * 0.5;
@@ -1679,12 +2126,18 @@ void ShapesApp::BuildRenderItems()
         auto poleRitem = std::make_unique<RenderItem>();
         auto sphereRitem = std::make_unique<RenderItem>();
         auto flagRitem = std::make_unique<RenderItem>();
-       
 
-        XMMATRIX towerWorld = XMMatrixScaling(6.0f, 10.0f, 6.0f) * XMMatrixTranslation(cRadius, 5.0f, sRadius); //keep in mind the base cylinder has a height of 2
-        XMMATRIX poleWorld = XMMatrixScaling(0.2f, 2.0f, 0.2f) * XMMatrixTranslation(cRadius, 21.0f, sRadius);
-        XMMATRIX sphereWorld = XMMatrixScaling(0.3f, 0.3f, 0.3f) * XMMatrixTranslation(cRadius, 23.1f, sRadius);
-        XMMATRIX flagWorld = XMMatrixScaling(1.5f, 1.0f, 0.1f) * XMMatrixTranslation(cRadius - 1, 22.5f, sRadius);
+        // The tower parts are placed relative to a node at the tower's base, so
+        // moving the tower moves all of them.
+        XMFLOAT4X4 towerBase;
+        XMStoreFloat4x4(&towerBase, XMMatrixTranslation(cRadius, 0.0f, sRadius));
+        towerNodes[i] = mSceneGraph.AddNode(SceneGraph::NoParent, ToFloat4x4(towerBase));
+        mNodeRitems.push_back(nullptr);
+
+        XMMATRIX towerWorld = XMMatrixScaling(6.0f, 10.0f, 6.0f) * XMMatrixTranslation(0.0f, 5.0f, 0.0f); //keep in mind the base cylinder has a height of 2
+        XMMATRIX poleWorld = XMMatrixScaling(0.2f, 2.0f, 0.2f) * XMMatrixTranslation(0.0f, 21.0f, 0.0f);
+        XMMATRIX sphereWorld = XMMatrixScaling(0.3f, 0.3f, 0.3f) * XMMatrixTranslation(0.0f, 23.1f, 0.0f);
+        XMMATRIX flagWorld = XMMatrixScaling(1.5f, 1.0f, 0.1f) * XMMatrixTranslation(-1.0f, 22.5f, 0.0f);
 
         SetRenderItemInfo(*towerRitem, "cylinder", towerWorld, "bricks0", RenderLayer::Opaque);
 
@@ -1694,7 +2147,11 @@ void ShapesApp::BuildRenderItems()
         SetRenderItemInfo(*flagRitem, "box", flagWorld, "flag0", RenderLayer::Opaque);
 
         SetRenderItemInfo(*sphereRitem, "sphere", sphereWorld, "plastic0", RenderLayer::Opaque);
-   
+
+        AttachRitem(*towerRitem, towerNodes[i]);
+        AttachRitem(*poleRitem, towerNodes[i]);
+        AttachRitem(*sphereRitem, towerNodes[i]);
+        AttachRitem(*flagRitem, towerNodes[i]);
 
         mAllRitems.push_back(std::move(towerRitem));
         mAllRitems.push_back(std::move(poleRitem));
@@ -1705,22 +2162,25 @@ void ShapesApp::BuildRenderItems()
         if (i < 3)
         {
             auto roofRitem = std::make_unique<RenderItem>();
-            XMMATRIX roofWorld = XMMatrixScaling(8.0f, 6.0f, 8.0f) * XMMatrixTranslation(cRadius, 17.0f, sRadius);
+            XMMATRIX roofWorld = XMMatrixScaling(8.0f, 6.0f, 8.0f) * XMMatrixTranslation(0.0f, 17.0f, 0.0f);
             SetRenderItemInfo(*roofRitem, "cone", roofWorld, "sand0", RenderLayer::Opaque);
+            AttachRitem(*roofRitem, towerNodes[i]);
             mAllRitems.push_back(std::move(roofRitem));
         }
     }
     
-    //adding pale and torus on their own
+    //adding pale and torus on their own, on top of the last tower (at w2, -d2)
 
     auto paleRitem = std::make_unique<RenderItem>();
-    XMMATRIX paleWorld = XMMatrixScaling(3.5f, 3.0f, 3.5f) * XMMatrixTranslation(w2, 17.5f, -d2);
+    XMMATRIX paleWorld = XMMatrixScaling(3.5f, 3.0f, 3.5f) * XMMatrixTranslation(0.0f, 17.5f, 0.0f);
     SetRenderItemInfo(*paleRitem, "cylinder2", paleWorld, "plastic0", RenderLayer::Opaque);
+    AttachRitem(*paleRitem, towerNodes[3]);
     mAllRitems.push_back(std::move(paleRitem));
 
     auto torusRitem = std::make_unique<RenderItem>();
-    XMMATRIX torusWorld = XMMatrixScaling(1.7f, 2.0f, 1.7f) * XMMatrixTranslation(w2, 14.5f, -d2) ;
+    XMMATRIX torusWorld = XMMatrixScaling(1.7f, 2.0f, 1.7f) * XMMatrixTranslation(0.0f, 14.5f, 0.0f) ;
     SetRenderItemInfo(*torusRitem, "torus2", torusWorld, "plastic0", RenderLayer::Opaque);
+    AttachRitem(*torusRitem, towerNodes[3]);
     mAllRitems.push_back(std::move(torusRitem));
 
 
@@ -1792,7 +2252,7 @@ void ShapesApp::BuildRenderItems()
 			waterRitem->IndexCount = waterRitem->Geo->DrawArgs["grid"].IndexCount;
 			waterRitem->StartIndexLocation = waterRitem->Geo->DrawArgs["grid"].StartIndexLocation;
 			waterRitem->BaseVertexLocation = waterRitem->Geo->DrawArgs["grid"].BaseVertexLocation;
-			mWavesRitem = waterRitem.get();
+			waterRitem->LocalBounds = waterRitem->Geo->DrawArgs["grid"].Bounds;
 
 			mRitemLayer[(int)RenderLayer::Transparent].push_back(waterRitem.get());
 			XMMATRIX WaterTexworld = XMMatrixScaling(5, 15, 2);
@@ -1812,7 +2272,7 @@ void ShapesApp::BuildRenderItems()
 			waterRitem->IndexCount = waterRitem->Geo->DrawArgs["grid"].IndexCount;
 			waterRitem->StartIndexLocation = waterRitem->Geo->DrawArgs["grid"].StartIndexLocation;
 			waterRitem->BaseVertexLocation = waterRitem->Geo->DrawArgs["grid"].BaseVertexLocation;
-			mWavesRitem = waterRitem.get();
+			waterRitem->LocalBounds = waterRitem->Geo->DrawArgs["grid"].Bounds;
 
 			mRitemLayer[(int)RenderLayer::Transparent].push_back(waterRitem.get());
 			XMMATRIX WaterTexworld = XMMatrixScaling(2, 4, 2);
@@ -1900,6 +2360,7 @@ void ShapesApp::BuildRenderItems()
 	coralSpritesRitem->IndexCount = coralSpritesRitem->Geo->DrawArgs["points"].IndexCount;
 	coralSpritesRitem->StartIndexLocation = coralSpritesRitem->Geo->DrawArgs["points"].StartIndexLocation;
 	coralSpritesRitem->BaseVertexLocation = coralSpritesRitem->Geo->DrawArgs["points"].BaseVertexLocation;
+	coralSpritesRitem->LocalBounds = coralSpritesRitem->Geo->DrawArgs["points"].Bounds;
 	mRitemLayer[(int)RenderLayer::AlphaTestedTreeSprites].push_back(coralSpritesRitem.get());
 	mAllRitems.push_back(std::move(coralSpritesRitem));
 
@@ -1926,40 +2387,223 @@ void ShapesApp::BuildRenderItems()
 			buildWaterwall(width, length,  
 				boxMaze[i].posX, boxMaze[i].posZ, boxMaze[i].widthX * 0.5f, boxMaze[i].lengthZ * 0.5f );
 	}
+
+	// Every item's constants have to be uploaded once.
+	for(auto& e : mAllRitems)
+		MarkRitemDirty(*e);
+}
+
+
+// Call after changing ritem's World or TexTransform.
+void ShapesApp::MarkRitemDirty(RenderItem& ritem)
+{
+	ritem.NumFramesDirty = gNumFrameResources;
+	if(!ritem.QueuedDirty)
+	{
+		ritem.QueuedDirty = true;
+		mDirtyRitems.push_back(&ritem);
+	}
+}
+
+// Makes ritem's current World relative to the parent node.
+void ShapesApp::AttachRitem(RenderItem& ritem, SceneGraph::NodeId parent)
+{
+	ritem.Node = mSceneGraph.AddNode(parent, ToFloat4x4(ritem.World));
+	mNodeRitems.push_back(&ritem);
+}
+
+// Recomputes the world transforms of moved scene graph nodes and queues the
+// affected items' constants for upload.
+void ShapesApp::UpdateSceneGraph()
+{
+	if(mSceneGraph.UpdateWorld() == 0)
+		return;
+
+	mSceneGraph.ForEachUpdated([this](SceneGraph::NodeId node)
+	{
+		RenderItem* ritem = mNodeRitems[node];
+		if(ritem == nullptr)
+			return;
+
+		ritem->World = ToXMFloat4x4(mSceneGraph.World(node));
+		MarkRitemDirty(*ritem);
+	});
 }
 
+void ShapesApp::BuildFrameGraph()
+{
+	// The stages write disjoint data: object, material and pass constants of the
+	// current frame resource, and the wave vertex buffers.  Material constants wait
+	// for the animated materials and object constants for moved scene graph nodes
+	// and grown water bounds.  The wave bounds follow the scene graph because both
+	// queue dirty items.  D3DApp::Run passes mTimer to Update.
+	auto animateMaterials = mFrameGraph.Add("AnimateMaterials", [this] { AnimateMaterials(mTimer); });
+	auto materialCBs = mFrameGraph.Add("UpdateMaterialCBs", [this] { UpdateMaterialCBs(mTimer); });
+	auto sceneGraph = mFrameGraph.Add("UpdateSceneGraph", [this] { UpdateSceneGraph(); });
+	auto objectCBs = mFrameGraph.Add("UpdateObjectCBs", [this] { UpdateObjectCBs(mTimer); });
+	mFrameGraph.Add("UpdateMainPassCB", [this] { UpdateMainPassCB(mTimer); });
+	auto waves = mFrameGraph.Add("UpdateWaves", [this] { UpdateWaves(mTimer); });
+	auto waveBounds = mFrameGraph.Add("UpdateWaveBounds", [this] { UpdateWaveBounds(); });
+
+	mFrameGraph.Precede(animateMaterials, materialCBs);
+	mFrameGraph.Precede(sceneGraph, objectCBs);
+	mFrameGraph.Precede(waves, waveBounds);
+	mFrameGraph.Precede(sceneGraph, waveBounds);
+	mFrameGraph.Precede(waveBounds, objectCBs);
+}
+
+// Groups the items of each instanced layer that share geometry, submesh and
+// material; items of other layers get a group each.  Groups keep the layer order of
+// their first item.
+void ShapesApp::BuildInstanceGroups()
+{
+	std::unordered_map<const MeshGeometry*, UINT> geoIds;
+	for(int layer = 0; layer < (int)RenderLayer::Count; ++layer)
+	{
+		auto& groups = mInstanceGroups[layer];
+		groups.clear();
+		const bool instanced = IsInstancedLayer((RenderLayer)layer);
+
+		for(RenderItem* ri : mRitemLayer[layer])
+		{
+			auto it = groups.end();
+			if(instanced)
+			{
+				it = std::find_if(groups.begin(), groups.end(), [ri](const InstanceGroup& group)
+				{
+					return SharesDrawArgs(*group.Items.front(), *ri);
+				});
+			}
+
+			if(it == groups.end())
+			{
+				it = groups.emplace(groups.end());
+				it->GeoId = geoIds.emplace(ri->Geo, (UINT)geoIds.size()).first->second;
+			}
+
+			it->Items.push_back(ri);
+		}
+	}
+}
 
-//The DrawRenderItems method is invoked in the main Draw call:
-void ShapesApp::DrawRenderItems(ID3D12GraphicsCommandList* cmdList, const std::vector<RenderItem*>& ritems)
+void ShapesApp::BuildCollisionGrid()
+{
+	std::vector<Aabb> boxes;
+	boxes.reserve(mAllRitems.size());
+	for(auto& e : mAllRitems)
+		boxes.push_back(ToAabb(e->bounds));
+
+	mCollisionGrid.Build(boxes.data(), (int)boxes.size());
+}
+
+void ShapesApp::BuildCullBoxes()
+{
+	mCullBoxes.Resize((int)mAllRitems.size());
+	for(size_t i = 0; i < mAllRitems.size(); ++i)
+	{
+		RenderItem& ri = *mAllRitems[i];
+		ri.SceneId = (int)i;
+		UpdateWorldBounds(ri);
+		mCullBoxes.Set((int)i, &ri.WorldBounds.Center.x, &ri.WorldBounds.Extents.x);
+	}
+
+	mVisibleMask.resize(CullKernels::MaskWordCount(mCullBoxes.Count()));
+}
+
+// Issues mDrawBatches in mDrawOrder, skipping bindings the previous draw already
+// made.  The instance buffer must be bound to root parameter 4, and the command
+// list must have been reset with the opaque PSO.
+void ShapesApp::DrawBatches(ID3D12GraphicsCommandList* cmdList, DrawStats& stats)
 {
     UINT objCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(ObjectConstants));
     UINT matCBByteSize = d3dUtil::CalcConstantBufferByteSize(sizeof(MaterialConstants));
- 
+
 	auto objectCB = mCurrFrameResource->ObjectCB->Resource();
     auto matCB = mCurrFrameResource->MaterialCB->Resource();
 
-    // For each render item...
-    for(size_t i = 0; i < ritems.size(); ++i)
-    {
-        auto ri = ritems[i];
+	// What the previous draw left bound.
+	ID3D12PipelineState* pso = mLayerPSOs[(int)VertexFormat::Float][(int)RenderLayer::Opaque];
+	const MeshGeometry* geo = nullptr;
+	D3D_PRIMITIVE_TOPOLOGY topology = D3D_PRIMITIVE_TOPOLOGY_UNDEFINED;
+	int srvIndex = -1;
+	int matCBIndex = -1;
+	UINT objCBIndex = ~0u;
 
-        cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
-        cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
-        cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
+	// Returns true if the binding has to be made, counting it either way.
+	auto changes = [&stats](bool same, UINT bindings)
+	{
+		if(same)
+			stats.StateChangesAvoided += bindings;
+		else
+			stats.StateChanges += bindings;
+		return !same;
+	};
 
-		CD3DX12_GPU_DESCRIPTOR_HANDLE tex(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
-		tex.Offset(ri->Mat->DiffuseSrvHeapIndex, mCbvSrvDescriptorSize);
+	for(const SortEntry& entry : mDrawOrder)
+	{
+		const DrawBatch& batch = mDrawBatches[entry.Value];
+		const RenderItem* ri = batch.Proto;
 
-        D3D12_GPU_VIRTUAL_ADDRESS objCBAddress = objectCB->GetGPUVirtualAddress() + ri->ObjCBIndex * objCBByteSize;
-        D3D12_GPU_VIRTUAL_ADDRESS matCBAddress = matCB->GetGPUVirtualAddress() + ri->Mat->MatCBIndex * matCBByteSize;
+		ID3D12PipelineState* batchPso = mLayerPSOs[(int)ri->Format][(int)batch.Layer];
+		if(changes(batchPso == pso, 1))
+		{
+			cmdList->SetPipelineState(batchPso);
+			pso = batchPso;
+		}
 
-		cmdList->SetGraphicsRootDescriptorTable(0, tex);
-        cmdList->SetGraphicsRootConstantBufferView(1, objCBAddress);
-        cmdList->SetGraphicsRootConstantBufferView(3, matCBAddress);
+		if(changes(ri->Geo == geo, 2))
+		{
+			cmdList->IASetVertexBuffers(0, 1, &ri->Geo->VertexBufferView());
+			cmdList->IASetIndexBuffer(&ri->Geo->IndexBufferView());
+			geo = ri->Geo;
+		}
 
-        cmdList->DrawIndexedInstanced(ri->IndexCount, 1, ri->StartIndexLocation, ri->BaseVertexLocation, 0);
-    }
+		if(changes(ri->PrimitiveType == topology, 1))
+		{
+			cmdList->IASetPrimitiveTopology(ri->PrimitiveType);
+			topology = ri->PrimitiveType;
+		}
+
+		if(changes(ri->Mat->DiffuseSrvHeapIndex == srvIndex, 1))
+		{
+			CD3DX12_GPU_DESCRIPTOR_HANDLE tex(mSrvDescriptorHeap->GetGPUDescriptorHandleForHeapStart());
+			tex.Offset(ri->Mat->DiffuseSrvHeapIndex, mCbvSrvDescriptorSize);
+			cmdList->SetGraphicsRootDescriptorTable(0, tex);
+			srvIndex = ri->Mat->DiffuseSrvHeapIndex;
+		}
 
+		if(changes(ri->Mat->MatCBIndex == matCBIndex, 1))
+		{
+			D3D12_GPU_VIRTUAL_ADDRESS matCBAddress = matCB->GetGPUVirtualAddress() + ri->Mat->MatCBIndex * matCBByteSize;
+			cmdList->SetGraphicsRootConstantBufferView(3, matCBAddress);
+			matCBIndex = ri->Mat->MatCBIndex;
+		}
+
+		if(IsInstancedLayer(batch.Layer))
+		{
+			// SV_InstanceID does not include StartInstanceLocation, hence the root constant.
+			cmdList->SetGraphicsRoot32BitConstant(5, batch.InstanceBase, 0);
+
+			if(ri->Format == VertexFormat::Packed)
+			{
+				VertexPacking::PositionQuantization q = VertexPacking::QuantizationFromBox(
+					&batch.VertexBounds->Center.x, &batch.VertexBounds->Extents.x);
+				cmdList->SetGraphicsRoot32BitConstants(5, 3, q.Offset, 1);
+				cmdList->SetGraphicsRoot32BitConstants(5, 3, q.Scale, 4);
+			}
+		}
+		else if(changes(ri->ObjCBIndex == objCBIndex, 1))
+		{
+			D3D12_GPU_VIRTUAL_ADDRESS objCBAddress = objectCB->GetGPUVirtualAddress() + ri->ObjCBIndex * objCBByteSize;
+			cmdList->SetGraphicsRootConstantBufferView(1, objCBAddress);
+			objCBIndex = ri->ObjCBIndex;
+		}
+
+		cmdList->DrawIndexedInstanced(batch.IndexCount, batch.InstanceCount, batch.StartIndexLocation, batch.BaseVertexLocation, 0);
+		++stats.Draws;
+		if(ri->PrimitiveType == D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST)
+			stats.Triangles += batch.IndexCount/3 * batch.InstanceCount;
+	}
 }
 
 std::array<const CD3DX12_STATIC_SAMPLER_DESC, 6> ShapesApp::GetStaticSamplers()